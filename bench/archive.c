@@ -0,0 +1,613 @@
+/*
+ * File:   archive.c
+ * Author: Adrian Jamróz
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "globals.h"
+#include "utils.h"
+#include "storage.h"
+#include "config.h"
+#include "feed.h"
+
+/*
+ * Syntetyczne archiwum i pomiar opóźnień operacji na bazie.
+ *
+ * archive generate <baza> <wiadomości> <źródła> [<miesiące>]
+ *	Dopisuje do bazy wiadomości w kolejności dat, jak przy kolejnych
+ *	pobraniach. Liczba wiadomości na źródło ma rozkład Zipfa, słowa
+ *	również; długość opisu jest logarytmicznie normalna (mediana ok.
+ *	400 B), a daty gęstnieją ku teraźniejszości i skupiają się w dzień.
+ *
+ * archive query <baza> [<powtórzenia>]
+ *	Mierzy feed_get_entries() dla kilku rodzajów zapytań i
+ *	config_get_feeds(), a na kopii bazy feed_flush() i feed_remove().
+ *	Dla każdej operacji podaje percentyle czasu i średnią liczbę stron
+ *	wczytanych z dysku (spoza pamięci podręcznej SQLite).
+ *
+ * Generator jest deterministyczny: te same argumenty dają to samo archiwum.
+ */
+#define	ARCHIVE_SEED		0x2545f4914f6cdd1dULL
+#define	ARCHIVE_WORDS		4000
+#define	ARCHIVE_FEED_SKEW	1.1	/* wykładnik rozkładu Zipfa źródeł */
+#define	ARCHIVE_WORD_SKEW	1.0	/* i słów */
+#define	ARCHIVE_BATCH		10000	/* wiadomości w jednej transakcji */
+#define	ARCHIVE_DEFAULT_MONTHS	12
+#define	ARCHIVE_DEFAULT_RUNS	20
+#define	ARCHIVE_COMMON_WORD	20	/* pozycje słów w rankingu częstości */
+#define	ARCHIVE_RARE_WORD	3000
+#define	ARCHIVE_NAME_WIDTH	36
+
+struct archive_op
+{
+	const char	*ao_name;
+	double		*ao_times;	/* ms */
+	long		ao_pages;
+	int		ao_count;
+};
+
+char *db_location;
+
+static const char *archive_syllables[] = {
+	"ka", "ro", "wie", "ść", "prze", "da", "ny", "ło", "szcz", "ę", "mi", "ta",
+	"źró", "dło", "ką", "po", "rze", "ci", "no", "wa", "ży", "cie", "ju", "że",
+	"sta", "gó", "ra", "mia", "sto", "dzie", "ń", "rok", "ją", "wy", "bo", "cz"
+};
+
+static uint64_t	archive_state = ARCHIVE_SEED;
+static char	*archive_words[ARCHIVE_WORDS];
+static double	archive_word_weights[ARCHIVE_WORDS];
+
+static uint64_t archive_random()
+{
+	archive_state ^= archive_state >> 12;
+	archive_state ^= archive_state << 25;
+	archive_state ^= archive_state >> 27;
+	return archive_state * 0x2545f4914f6cdd1dULL;
+}
+
+static double archive_uniform()
+{
+	return (archive_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double archive_normal()
+{
+	return sqrt(-2.0 * log(1.0 - archive_uniform())) * cos(2.0 * M_PI * archive_uniform());
+}
+
+/*
+ * Skumulowane wagi rozkładu Zipfa (1 / k^s) dla n elementów.
+ */
+static void archive_zipf(double *weights, int n, double s)
+{
+	double sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		weights[i] = sum += 1.0 / pow(i + 1, s);
+}
+
+static int archive_pick(const double *weights, int n)
+{
+	double u = archive_uniform() * weights[n - 1];
+	int low = 0, high = n - 1, mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+
+		if (weights[mid] < u)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/*
+ * Słownik: ARCHIVE_WORDS różnych słów z sylab, zawsze ten sam.
+ */
+static void archive_vocabulary()
+{
+	hash_t *seen = hash_init();
+	char word[64];
+	int i, j, n;
+
+	for (i = 0; i < ARCHIVE_WORDS; i++) {
+		do {
+			*word = '\0';
+			n = 2 + archive_random() % 3;
+
+			for (j = 0; j < n; j++)
+				strcat(word, archive_syllables[archive_random() % N(archive_syllables)]);
+		} while (hash_key_exists(seen, word));
+
+		archive_words[i] = xstrdup(word);
+		hash_set(seen, xstrdup(word), NULL, TRUE);
+	}
+
+	hash_free(seen, TRUE, FALSE);
+	archive_zipf(archive_word_weights, ARCHIVE_WORDS, ARCHIVE_WORD_SKEW);
+}
+
+/*
+ * Tekst z losowych słów o długości co najmniej length bajtów.
+ */
+static char *archive_text(arena_t *arena, size_t length)
+{
+	char *text = arena_alloc(arena, length + 64), *p = text;
+	const char *word;
+
+	while (p - text < length) {
+		word = archive_words[archive_pick(archive_word_weights, ARCHIVE_WORDS)];
+
+		if (p != text)
+			*p++ = ' ';
+
+		p = stpcpy(p, word);
+	}
+
+	return text;
+}
+
+/*
+ * Data wiadomości: gęstość rośnie liniowo ku końcowi przedziału, a
+ * 85% wiadomości przypada między 6:00 a 22:00.
+ */
+static time_t archive_time(time_t end, time_t span)
+{
+	time_t t = end - (time_t)(span * (1.0 - sqrt(archive_uniform())));
+	time_t day = t - t % UNIX_DAY;
+
+	if (archive_uniform() < 0.85)
+		t = day + 6 * UNIX_HOUR + archive_random() % (16 * UNIX_HOUR);
+	else
+		t = day + archive_random() % UNIX_DAY;
+
+	return t < end ? t : end - 1;
+}
+
+static double archive_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int archive_compare_time(const void *a, const void *b)
+{
+	time_t x = *(const time_t *)a, y = *(const time_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static sqlite3_stmt *archive_prepare(storage_handle_t *handle, char *sql)
+{
+	sqlite3_stmt *stmt;
+
+	if (sqlite3_prepare_v2(handle->sh_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+		exit(EXIT_FAILURE);
+	}
+
+	sqlite3_free(sql);
+	return stmt;
+}
+
+/*
+ * Zapisuje wiadomość tymi samymi poleceniami co feed_entry_persist()
+ * (wyzwalacze liczników i FTS5 działają jak zwykle), ale przygotowanymi
+ * raz na partycję; feed_entry_persist() przygotowuje je dla każdej
+ * wiadomości, co przy milionach wiadomości trwałoby godziny. Tytuły są
+ * unikalne z założenia, więc ich nie sprawdzamy. NULL kończy zapis.
+ */
+static void archive_insert(storage_handle_t *handle, feed_entry_t *entry)
+{
+	static char partition[STORAGE_PARTITION_NAME_MAX];
+	static sqlite3_stmt *body, *post;
+	const char *name;
+	int id;
+
+	if (!entry || strcmp(name = storage_partition(handle, entry->fe_pubdate), partition)) {
+		sqlite3_finalize(body);
+		sqlite3_finalize(post);
+		body = post = NULL;
+
+		if (!entry)
+			return;
+
+		strcpy(partition, name);
+		body = archive_prepare(handle, sqlite3_mprintf(
+		    "INSERT INTO %s_body (id, description) VALUES (?, ?)", partition));
+		post = archive_prepare(handle, sqlite3_mprintf(
+		    "INSERT INTO %s (id, feed, pubdate, title, url, guid) VALUES (?, ?, ?, ?, ?, ?)", partition));
+	}
+
+	id = storage_next_id(handle);
+	sqlite3_bind_int(body, 1, id);
+	sqlite3_bind_text(body, 2, entry->fe_description, -1, SQLITE_STATIC);
+	sqlite3_bind_int(post, 1, id);
+	sqlite3_bind_text(post, 2, entry->fe_feed, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(post, 3, entry->fe_pubdate);
+	sqlite3_bind_text(post, 4, entry->fe_title, -1, SQLITE_STATIC);
+	sqlite3_bind_text(post, 5, entry->fe_url, -1, SQLITE_STATIC);
+	sqlite3_bind_text(post, 6, entry->fe_guid, -1, SQLITE_STATIC);
+
+	if (sqlite3_step(body) != SQLITE_DONE || sqlite3_step(post) != SQLITE_DONE) {
+		FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+		exit(EXIT_FAILURE);
+	}
+
+	sqlite3_reset(body);
+	sqlite3_reset(post);
+}
+
+static void archive_generate(long posts, int feeds, int months)
+{
+	storage_handle_t *handle = storage_get();
+	double *weights = xmalloc(sizeof(double) * feeds), started = archive_now(), length;
+	time_t end = time(NULL), span = (time_t)months * 30 * UNIX_DAY;
+	time_t *times = xmalloc(sizeof(time_t) * posts);
+	arena_t *arena = arena_init(ARENA_DEFAULT_SIZE);
+	feed_entry_t entry;
+	feed_t feed;
+	char name[32], *text;
+	long i;
+
+	archive_zipf(weights, feeds, ARCHIVE_FEED_SKEW);
+
+	for (i = 0; i < posts; i++)
+		times[i] = archive_time(end, span);
+
+	qsort(times, posts, sizeof(time_t), archive_compare_time);
+	sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+
+	for (i = 0; i < feeds; i++) {
+		memset(&feed, 0, sizeof(feed));
+		snprintf(name, sizeof(name), "zrodlo%04ld", i);
+		feed.f_name = name;
+		feed.f_url = sqlite3_mprintf("http://example.com/%s.xml", name);
+		feed.f_description = "Źródło syntetyczne";
+		feed_save(handle, &feed);
+		sqlite3_free(feed.f_url);
+	}
+
+	for (i = 0; i < posts; i++) {
+		memset(&entry, 0, sizeof(entry));
+		snprintf(name, sizeof(name), "zrodlo%04d", archive_pick(weights, feeds));
+		entry.fe_feed = name;
+		entry.fe_pubdate = times[i];
+		text = archive_text(arena, 30 + archive_random() % 50);
+		entry.fe_title = arena_alloc(arena, strlen(text) + 32);
+		sprintf(entry.fe_title, "%ld: %s", i, text);
+		entry.fe_url = arena_alloc(arena, 64);
+		sprintf(entry.fe_url, "http://example.com/%s/%ld", name, i);
+		entry.fe_guid = entry.fe_url;
+
+		length = exp(6.0 + 0.8 * archive_normal());
+		entry.fe_description = archive_text(arena, length < 40 ? 40 : (length > 16000 ? 16000 : length));
+
+		archive_insert(handle, &entry);
+		arena_reset(arena);
+
+		if ((i + 1) % ARCHIVE_BATCH == 0) {
+			sqlite3_exec(handle->sh_db, "COMMIT; BEGIN", NULL, NULL, NULL);
+			fprintf(stderr, "\r%ld / %ld wiadomości (%.0f/s)", i + 1, posts,
+			    (i + 1) * 1000.0 / (archive_now() - started));
+		}
+	}
+
+	archive_insert(handle, NULL);
+	sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+	fprintf(stderr, "\rZapisano %ld wiadomości ze %d źródeł w %.1f s.\n", posts, feeds,
+	    (archive_now() - started) / 1000);
+	arena_free(arena);
+	free(weights);
+	free(times);
+}
+
+static void archive_record(struct archive_op *op, double started, int pages)
+{
+	op->ao_times = xrealloc(op->ao_times, sizeof(double) * (op->ao_count + 1));
+	op->ao_times[op->ao_count++] = archive_now() - started;
+	op->ao_pages += pages;
+}
+
+static int archive_compare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static double archive_percentile(struct archive_op *op, double p)
+{
+	int i = (int)ceil(p * op->ao_count) - 1;
+	return op->ao_times[i < 0 ? 0 : i];
+}
+
+/*
+ * Wypisuje nazwę dopełnioną spacjami do width znaków (nie bajtów, jak
+ * printf "%-*s"), by polskie nazwy nie rozjeżdżały kolumn.
+ */
+static void archive_name(const char *name, int width)
+{
+	const char *p;
+	int n = 0;
+
+	for (p = name; *p; p++)
+		n += (*p & 0xc0) != 0x80;
+
+	printf("%s%*s", name, n < width ? width - n : 0, "");
+}
+
+static void archive_report(struct archive_op *op)
+{
+	if (!op->ao_count)
+		return;
+
+	qsort(op->ao_times, op->ao_count, sizeof(double), archive_compare);
+	archive_name(op->ao_name, ARCHIVE_NAME_WIDTH);
+	printf(" %4d %10.2f %10.2f %10.2f %10.2f %9.1f\n", op->ao_count,
+	    archive_percentile(op, 0.5), archive_percentile(op, 0.9), archive_percentile(op, 0.99),
+	    op->ao_times[op->ao_count - 1], (double)op->ao_pages / op->ao_count);
+	free(op->ao_times);
+}
+
+static void archive_entries(const char *name, feed_query_t *fq, int runs)
+{
+	storage_handle_t *handle = storage_get();
+	arena_t *arena = arena_init(ARENA_DEFAULT_SIZE);
+	struct archive_op op = { name };
+	double started;
+	int i;
+
+	for (i = 0; i < runs; i++) {
+		storage_cache_misses(handle);
+		started = archive_now();
+		feed_get_entries(handle, fq, arena);
+		archive_record(&op, started, storage_cache_misses(handle));
+		arena_reset(arena);
+	}
+
+	arena_free(arena);
+	archive_report(&op);
+}
+
+/*
+ * config_get_feeds(): z pamięci podręcznej albo (reload) po zmianie bazy
+ * przez inne połączenie, co wymusza ponowne wczytanie tabeli feeds.
+ */
+static void archive_feeds(int reload, int runs)
+{
+	storage_handle_t *handle = storage_get();
+	struct archive_op op = { reload ? "config_get_feeds (przeładowanie)" : "config_get_feeds" };
+	sqlite3 *other = NULL;
+	double started;
+	int i;
+
+	if (reload)
+		sqlite3_open(db_location, &other);
+
+	/*
+	 * Zapis niczego niezmieniający nie podbija data_version, więc licznik
+	 * redirects pierwszego kanału na przemian zwiększamy i zmniejszamy.
+	 */
+	for (i = 0; i < runs; i++) {
+		if (other)
+			sqlite3_exec(other, i % 2 ? "UPDATE feeds SET redirects = redirects - 1 WHERE rowid = 1" :
+			    "UPDATE feeds SET redirects = redirects + 1 WHERE rowid = 1", NULL, NULL, NULL);
+
+		storage_cache_misses(handle);
+		started = archive_now();
+		config_get_feeds(handle);
+		archive_record(&op, started, storage_cache_misses(handle));
+	}
+
+	if (other) {
+		if (runs % 2)
+			sqlite3_exec(other, "UPDATE feeds SET redirects = redirects - 1 WHERE rowid = 1", NULL, NULL, NULL);
+
+		sqlite3_close(other);
+	}
+
+	archive_report(&op);
+}
+
+static void archive_copy(const char *from, const char *to)
+{
+	char buf[1024 * 1024];
+	int in = open(from, O_RDONLY), out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	ssize_t n;
+
+	if (in < 0 || out < 0) {
+		FAIL("Nie udało się skopiować %s do %s.\n", from, to);
+		exit(EXIT_FAILURE);
+	}
+
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, n) != n) {
+			FAIL("Nie udało się skopiować %s do %s.\n", from, to);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	close(in);
+	close(out);
+}
+
+/*
+ * Nazwy źródeł od największego (według liczby wiadomości).
+ */
+static array_t *archive_feed_names(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle, "SELECT name FROM feeds ORDER BY total DESC, name");
+	array_t *names = array_init(0);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		array_append(names, xstrdup((const char *)sqlite3_column_text(stmt, 0)));
+
+	storage_finalize(stmt);
+	return names;
+}
+
+/*
+ * feed_flush() i feed_remove() zmieniają bazę, więc działają na kopii.
+ * Kolejne wywołania feed_flush() usuwają łącznie najstarszą połowę
+ * archiwum, a feed_remove() usuwa źródła rozłożone po całym rankingu.
+ */
+static void archive_destructive(const char *path, int runs)
+{
+	struct archive_op flush = { "feed_flush" }, remove = { "feed_remove" };
+	storage_handle_t *handle;
+	storage_stmt_t *stmt;
+	array_t *names;
+	time_t oldest, newest;
+	double started;
+	feed_t feed;
+	int i, count;
+
+	db_location = sqlite3_mprintf("%s.kopia", path);
+	archive_copy(path, db_location);
+	handle = storage_get();
+
+	stmt = storage_query(handle, "SELECT MIN(oldest), MAX(newest) FROM feeds");
+	sqlite3_step(stmt);
+	oldest = sqlite3_column_int64(stmt, 0);
+	newest = sqlite3_column_int64(stmt, 1);
+	storage_finalize(stmt);
+
+	for (i = 0; i < runs; i++) {
+		storage_cache_misses(handle);
+		started = archive_now();
+		feed_flush(handle, oldest + (newest - oldest) * (i + 1) / (2 * runs));
+		archive_record(&flush, started, storage_cache_misses(handle));
+	}
+
+	names = archive_feed_names(handle);
+	count = array_count(names);
+
+	for (i = 0; i < runs && i < count; i++) {
+		memset(&feed, 0, sizeof(feed));
+		feed.f_name = array_get(names, (long)i * count / runs);
+		storage_cache_misses(handle);
+		started = archive_now();
+		feed_remove(handle, &feed);
+		archive_record(&remove, started, storage_cache_misses(handle));
+	}
+
+	archive_report(&flush);
+	archive_report(&remove);
+	array_free(names, TRUE, FALSE);
+	storage_close(handle);
+	unlink(db_location);
+	sqlite3_free(db_location);
+}
+
+static void archive_query(const char *path, int runs)
+{
+	storage_handle_t *handle = storage_get();
+	storage_stmt_t *stmt;
+	array_t *names, *partitions;
+	feed_query_t fq;
+	struct stat st;
+	time_t oldest, newest;
+	long posts;
+	int feeds;
+
+	stmt = storage_query(handle, "SELECT SUM(total), COUNT(*), MIN(oldest), MAX(newest) FROM feeds");
+	sqlite3_step(stmt);
+	posts = sqlite3_column_int64(stmt, 0);
+	feeds = sqlite3_column_int(stmt, 1);
+	oldest = sqlite3_column_int64(stmt, 2);
+	newest = sqlite3_column_int64(stmt, 3);
+	storage_finalize(stmt);
+
+	if (!feeds) {
+		FAIL("Baza %s nie zawiera żadnych źródeł.\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	partitions = storage_partitions(handle, 0, FEED_TIME_MAX, NULL);
+	stat(path, &st);
+	printf("Archiwum %s: %ld wiadomości, %d źródeł, %d partycji, %.1f MB.\n\n", path, posts, feeds,
+	    array_count(partitions), st.st_size / (1024.0 * 1024.0));
+	archive_name("operacja", ARCHIVE_NAME_WIDTH);
+	printf(" %4s %10s %10s %10s %10s %9s\n", "n",
+	    "p50 [ms]", "p90 [ms]", "p99 [ms]", "max [ms]", "strony");
+	array_free(partitions, TRUE, FALSE);
+	names = archive_feed_names(handle);
+
+	memset(&fq, 0, sizeof(fq));
+	archive_entries("view", &fq, runs);
+
+	fq.fq_mask = QUERY_ALL | QUERY_HAS_LIMIT;
+	fq.fq_limit = 50;
+	archive_entries("view all limit 50", &fq, runs);
+
+	fq.fq_mask = QUERY_HAS_SOURCE | QUERY_HAS_LIMIT;
+	fq.fq_feed = array_get(names, 0);
+	archive_entries("view feed <największe> limit 50", &fq, runs);
+
+	fq.fq_mask = QUERY_HAS_SOURCE;
+	fq.fq_feed = array_get(names, array_count(names) - 1);
+	archive_entries("view feed <najmniejsze>", &fq, runs);
+
+	memset(&fq, 0, sizeof(fq));
+	fq.fq_mask = QUERY_HAS_FROM_TIME | QUERY_HAS_TO_TIME;
+	fq.fq_from_time = oldest + (newest - oldest) / 2;
+	fq.fq_to_time = fq.fq_from_time + UNIX_DAY;
+	fq.fq_brief = TRUE;
+	archive_entries("view newer/older <doba> brief", &fq, runs);
+
+	memset(&fq, 0, sizeof(fq));
+	fq.fq_highlight_start = fq.fq_highlight_end = "*";
+	fq.fq_match = archive_words[ARCHIVE_COMMON_WORD];
+	archive_entries("search <częste słowo>", &fq, runs);
+
+	fq.fq_match = archive_words[ARCHIVE_RARE_WORD];
+	fq.fq_brief = TRUE;
+	archive_entries("search <rzadkie słowo> brief", &fq, runs);
+
+	archive_feeds(FALSE, runs);
+	archive_feeds(TRUE, runs);
+	array_free(names, TRUE, FALSE);
+	storage_close(handle);
+
+	archive_destructive(path, runs);
+}
+
+static void archive_usage()
+{
+	fprintf(stderr, "Użycie: archive generate <baza> <wiadomości> <źródła> [<miesiące>]\n");
+	fprintf(stderr, "        archive query <baza> [<powtórzenia>]\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		archive_usage();
+
+	db_location = argv[2];
+	archive_vocabulary();
+
+	if (!strcmp(argv[1], "generate") && (argc == 5 || argc == 6)) {
+		archive_generate(atol(argv[3]), atoi(argv[4]), argc == 6 ? atoi(argv[5]) : ARCHIVE_DEFAULT_MONTHS);
+		storage_close(storage_get());
+	} else if (!strcmp(argv[1], "query") && (argc == 3 || argc == 4)) {
+		archive_query(argv[2], argc == 4 ? atoi(argv[3]) : ARCHIVE_DEFAULT_RUNS);
+	} else {
+		archive_usage();
+	}
+
+	return EXIT_SUCCESS;
+}
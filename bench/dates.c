@@ -0,0 +1,97 @@
+/*
+ * File:   dates.c
+ * Author: Adrian Jamróz
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "utils.h"
+
+/*
+ * Porównanie parse_date() z dawnym odczytem dat przez strptime() i
+ * mktime(). Daty RFC 822 w trzech postaciach (ze strefą liczbową, GMT i
+ * bez dnia tygodnia) podajemy na zmianę; strptime() dostaje ten sam
+ * format co przedtem w feed_process(), więc trzeciej postaci, jak dawniej,
+ * nie rozpoznaje. Wynik zależy od TZ (mktime() sięga do bazy stref),
+ * więc warto go podawać razem z pomiarem.
+ *
+ * Użycie: dates [<liczba dat>]
+ */
+#define	DATES_DEFAULT_COUNT	2000000
+#define	DATES_SAMPLES		1024
+
+static char dates_samples[DATES_SAMPLES][64];
+
+static double dates_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void dates_generate()
+{
+	static const char *formats[] = {
+		"%a, %d %b %Y %H:%M:%S +0200", "%a, %d %b %Y %H:%M:%S GMT", "%d %b %Y %H:%M:%S -0500"
+	};
+	time_t t = 1700000000;
+	int i;
+
+	for (i = 0; i < DATES_SAMPLES; i++) {
+		t += 86400 * 3 + 7 * 3600 + 1237;
+		strftime(dates_samples[i], sizeof(dates_samples[i]), formats[i % 3], gmtime(&t));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long i, count = argc > 1 ? atol(argv[1]) : DATES_DEFAULT_COUNT;
+	long old_failed = 0, new_failed = 0;
+	double started, old_time, new_time;
+	time_t sum = 0, value;
+	struct tm tm;
+
+	if (argc > 2 || count <= 0) {
+		fprintf(stderr, "Użycie: dates [<liczba dat>]\n");
+		return EXIT_FAILURE;
+	}
+
+	dates_generate();
+	tzset();
+
+	started = dates_now();
+
+	for (i = 0; i < count; i++) {
+		memset(&tm, 0, sizeof(tm));
+
+		if (!strptime(dates_samples[i % DATES_SAMPLES], "%a, %d %b %Y %T", &tm))
+			old_failed++;
+
+		tm.tm_isdst = -1;
+		sum += mktime(&tm);
+	}
+
+	old_time = dates_now() - started;
+	started = dates_now();
+
+	for (i = 0; i < count; i++) {
+		if (!parse_date(dates_samples[i % DATES_SAMPLES], &value))
+			new_failed++;
+
+		sum += value;
+	}
+
+	new_time = dates_now() - started;
+
+	printf("%ld dat, TZ=%s\n", count, getenv("TZ") ? getenv("TZ") : "(systemowa)");
+	printf("strptime+mktime %8.1f ns/datę, nierozpoznanych %ld\n", old_time * 1e9 / count, old_failed);
+	printf("parse_date      %8.1f ns/datę, nierozpoznanych %ld (%.1fx)\n", new_time * 1e9 / count,
+	    new_failed, old_time / new_time);
+
+	/* Suma tylko po to, by kompilator nie usunął pętli. */
+	fprintf(stderr, "(suma kontrolna %ld)\n", (long)sum);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/*
+ * File:   feedsrv.c
+ * Author: Adrian Jamróz
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+ * Serwer syntetycznych kanałów RSS dla obciążenia treningowego (zob.
+ * bench/workload.sh). Na żądanie "GET /<nazwa>-<n>.xml" zwraca kanał z n
+ * wiadomościami; treść zależy tylko od nazwy i n, a daty od chwili
+ * uruchomienia serwera (co FEEDSRV_SPACING sekund wstecz). Połączenia
+ * obsługujemy po kolei, jak HTTP/1.0.
+ *
+ * Użycie: feedsrv <port>
+ */
+#define	FEEDSRV_SPACING		420
+#define	FEEDSRV_ITEMS_MAX	100000
+
+static const char *feedsrv_syllables[] = {
+	"ka", "ro", "wie", "ść", "prze", "da", "ny", "ło", "szcz", "ę", "mi", "ta",
+	"źró", "dło", "ką", "po", "rze", "ci", "no", "wa", "ży", "cie", "ju", "że"
+};
+
+static uint64_t feedsrv_state;
+static time_t feedsrv_now;
+
+static uint32_t feedsrv_random()
+{
+	feedsrv_state ^= feedsrv_state << 13;
+	feedsrv_state ^= feedsrv_state >> 7;
+	feedsrv_state ^= feedsrv_state << 17;
+	return feedsrv_state >> 32;
+}
+
+static void feedsrv_words(FILE *f, int count)
+{
+	int i, j, n;
+
+	for (i = 0; i < count; i++) {
+		n = 1 + feedsrv_random() % 4;
+
+		for (j = 0; j < n; j++)
+			fputs(feedsrv_syllables[feedsrv_random() % (sizeof(feedsrv_syllables) / sizeof(char *))], f);
+
+		fputc(i < count - 1 ? ' ' : '.', f);
+	}
+}
+
+static char *feedsrv_feed(const char *name, int items, size_t *len)
+{
+	char *buf, date[64];
+	const char *p;
+	FILE *f = open_memstream(&buf, len);
+	time_t t;
+	int i;
+
+	feedsrv_state = 0x9e3779b97f4a7c15ULL;
+	for (p = name; *p; p++)
+		feedsrv_state = (feedsrv_state ^ (unsigned char)*p) * 0x100000001b3ULL;
+
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\"><channel>\n");
+	fprintf(f, "<title>%s</title><link>http://example.com/%s/</link>\n", name, name);
+	fprintf(f, "<description>Kanał syntetyczny %s</description>\n", name);
+
+	for (i = 0; i < items; i++) {
+		t = feedsrv_now - (time_t)i * FEEDSRV_SPACING;
+		strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S +0000", gmtime(&t));
+		fprintf(f, "<item><title>%s %d: ", name, items - i);
+		feedsrv_words(f, 4 + feedsrv_random() % 6);
+		fprintf(f, "</title><link>http://example.com/%s/%d</link>", name, items - i);
+		fprintf(f, "<guid>http://example.com/%s/%d</guid><pubDate>%s</pubDate><description>", name, items - i, date);
+		feedsrv_words(f, 20 + feedsrv_random() % 80);
+		fprintf(f, " &lt;p&gt;");
+		feedsrv_words(f, feedsrv_random() % 40);
+		fprintf(f, "&lt;/p&gt;</description></item>\n");
+	}
+
+	fprintf(f, "</channel></rss>\n");
+	fclose(f);
+	return buf;
+}
+
+static void feedsrv_serve(int client)
+{
+	char request[1024], name[64], header[256], *body = NULL;
+	FILE *f = fdopen(client, "r+");
+	size_t len = 0;
+	int items = 0;
+
+	if (!f) {
+		close(client);
+		return;
+	}
+
+	if (!fgets(request, sizeof(request), f) ||
+	    sscanf(request, "GET /%63[^-/]-%d.xml", name, &items) < 2 ||
+	    items < 0 || items > FEEDSRV_ITEMS_MAX) {
+		fputs("HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n", f);
+		fclose(f);
+		return;
+	}
+
+	/* Nagłówki żądania pomijamy. */
+	while (fgets(request, sizeof(request), f) && strcmp(request, "\r\n") && strcmp(request, "\n"))
+		;
+
+	body = feedsrv_feed(name, items, &len);
+	snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: application/rss+xml\r\n"
+	    "Content-Length: %zu\r\nConnection: close\r\n\r\n", len);
+	fputs(header, f);
+	fwrite(body, 1, len, f);
+	fclose(f);
+	free(body);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	int fd, client, on = 1;
+
+	if (argc != 2) {
+		fprintf(stderr, "Użycie: feedsrv <port>\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(argv[1]));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+		perror("feedsrv");
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	feedsrv_now = time(NULL);
+
+	while (1) {
+		if ((client = accept(fd, NULL, NULL)) >= 0)
+			feedsrv_serve(client);
+	}
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# File:   latency.sh
+# Author: Adrian Jamróz
+#
+# Opóźnienia operacji na bazie przy rosnącej wielkości archiwum: dla
+# każdej skali z $SCALES generuje (jeśli jeszcze nie istnieje) syntetyczne
+# archiwum w $DIR i mierzy je przez "archive query".
+#
+# Użycie: latency.sh [<powtórzenia>]
+#
+# Zmienne: SCALES  - liczby wiadomości (domyślnie "100000 1000000";
+#                    10000000 to ok. 25 min generowania i 12,5 GB na dysku)
+#          FEEDS   - liczba źródeł (domyślnie 2000)
+#          MONTHS  - ile miesięcy wstecz sięga archiwum (domyślnie 12)
+#          DIR     - katalog na bazy (domyślnie /tmp/rss-archive)
+#
+
+BENCH=$(dirname "$0")
+SCALES=${SCALES:-"100000 1000000"}
+FEEDS=${FEEDS:-2000}
+MONTHS=${MONTHS:-12}
+DIR=${DIR:-/tmp/rss-archive}
+
+if [ $# -gt 1 ]; then
+	echo "Użycie: $0 [<powtórzenia>]" >&2
+	exit 1
+fi
+
+mkdir -p "$DIR" || exit 1
+
+for posts in $SCALES; do
+	db=$DIR/archive-$posts-$FEEDS-$MONTHS.db
+
+	# Przerwane generowanie zostawiłoby niepełną bazę; budujemy obok.
+	if [ ! -f "$db" ]; then
+		rm -f "$db.tmp"
+		"$BENCH/archive" generate "$db.tmp" "$posts" "$FEEDS" "$MONTHS" && mv "$db.tmp" "$db" || exit 1
+	fi
+
+	"$BENCH/archive" query "$db" $1 || exit 1
+	echo
+done
@@ -0,0 +1,95 @@
+#!/bin/sh
+#
+# File:   workload.sh
+# Author: Adrian Jamróz
+#
+# Obciążenie reprezentatywne dla rss: pobranie syntetycznych kanałów
+# (bench/feedsrv), ponowna aktualizacja (same znane wiadomości), view,
+# view brief, search, eksport NDJSON/TSV i list.
+#
+# Użycie: workload.sh <rss>               - jedno przejście (trening PGO)
+#         workload.sh <rss> <rss-wzorzec> - porównanie: każdy krok
+#                                           $REPEAT razy, mediana czasu
+#                                           poleceń (rss -t) w ms
+#
+
+BENCH=$(dirname "$0")
+PORT=${PORT:-8642}
+REPEAT=${REPEAT:-5}
+URL=http://127.0.0.1:$PORT
+
+if [ $# -lt 1 ] || [ $# -gt 2 ]; then
+	echo "Użycie: $0 <rss> [<rss-wzorzec>]" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d)
+"$BENCH/feedsrv" "$PORT" &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; rm -rf "$DIR"' EXIT
+sleep 0.2
+
+STEPS="pobranie aktualizacja view view_brief search eksport list"
+
+step_commands()
+{
+	case $1 in
+		pobranie)	echo "add a $URL/a-4000.xml; add b $URL/b-2000.xml; add c $URL/c-1000.xml;" \
+				    "add d $URL/d-500.xml; add e $URL/e-200.xml; add f $URL/f-100.xml" ;;
+		aktualizacja)	echo "update" ;;
+		view)		echo "view all" ;;
+		view_brief)	echo "view all brief" ;;
+		search)		echo "search kawie; search rze brief; search feed a dło" ;;
+		eksport)	echo "set output_format ndjson; view all; set output_format tsv; view all; set output_format human" ;;
+		list)		echo "list" ;;
+	esac
+}
+
+# Wykonuje krok i wypisuje czas poleceń w ms.
+run_step()
+{
+	"$1" -t -d "$2" -c "$(step_commands "$3")" </dev/null 2>&1 >/dev/null |
+	    sed -n 's/^Czasy: .*polecenia \([0-9.]*\) ms.*/\1/p'
+}
+
+median()
+{
+	sort -n | awk '{ v[NR] = $1 } END { print NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+if [ $# -eq 1 ]; then
+	for step in $STEPS; do
+		run_step "$1" "$DIR/train.db" "$step" >/dev/null
+	done
+
+	exit 0
+fi
+
+tag1=$(echo "$1" | tr -c 'a-zA-Z0-9\n' '_')
+tag2=$(echo "$2" | tr -c 'a-zA-Z0-9\n' '_')
+i=0
+
+# Przebiegi obu programów na przemian, by zmiany obciążenia maszyny
+# rozkładały się na oba po równo.
+while [ $i -lt "$REPEAT" ]; do
+	for tag in "$tag1" "$tag2"; do
+		[ "$tag" = "$tag1" ] && bin=$1 || bin=$2
+		rm -f "$DIR/$tag.db"
+
+		for step in $STEPS; do
+			run_step "$bin" "$DIR/$tag.db" "$step" >>"$DIR/$tag.$step"
+		done
+	done
+
+	i=$((i + 1))
+done
+
+printf "Porównanie: %s względem %s (mediana z %d przebiegów, ms)\n\n" "$1" "$2" "$REPEAT"
+printf "%-14s %12s %12s %9s\n" "krok" "wzorzec" "badany" "zmiana"
+
+for step in $STEPS; do
+	a=$(median <"$DIR/$tag2.$step")
+	b=$(median <"$DIR/$tag1.$step")
+	awk -v s="$step" -v a="$a" -v b="$b" \
+	    'BEGIN { printf "%-14s %12.2f %12.2f %+8.1f%%\n", s, a, b, (a > 0 ? (b - a) * 100 / a : 0) }'
+done
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <ctype.h>
 #include <readline/readline.h>
 #include "utils.h"
 #include "config.h"
@@ -14,20 +15,35 @@
 #include "globals.h"
 #include "http.h"
 #include "help.h"
+#include "render.h"
 
 void	cli_sigpipe(int);
+int	cli_retain(feed_t *);
+int	cli_output_format();
+int	cli_vacuum_pages();
 void	do_help(array_t *);
 void	do_add_source(array_t *);
 void	do_remove_source(array_t *);
 void	do_list_sources(array_t *);
 void	do_update(array_t *);
 void	do_view(array_t *);
+void	do_search(array_t *);
+void	do_read(array_t *);
 void	do_flush(array_t *);
+void	do_compress(array_t *);
 void	do_set(array_t *);
 void	do_about(array_t *);
+void	do_mem(array_t *);
 void	do_exit(array_t *);
 time_t	parse_time_diff(const char *);
 
+/*
+ * Arena na czas wykonania jednego polecenia: argumenty, wiersze z bazy
+ * i wiadomości do wyświetlenia. Opróżniana po każdym poleceniu.
+ */
+static arena_t *cli_arena = NULL;
+static int cli_batch_mode = FALSE;
+
 struct callback_table {
 	char	*ct_command;
 	void	(*ct_function)(array_t *);
@@ -40,51 +56,98 @@ struct callback_table cli_callbacks[] = {
 	{ "list", do_list_sources },
 	{ "update", do_update },
 	{ "view", do_view },
+	{ "search", do_search },
+	{ "read", do_read },
 	{ "flush", do_flush },
+	{ "compress", do_compress },
 	{ "set", do_set },
 	{ "about", do_about },
+	{ "mem", do_mem },
 	{ "exit", do_exit },
 };
 
+/*
+ * Wykonuje jeden wiersz poleceń (tryb interaktywny, polecenie z wiersza
+ * wywołania, serwer); zwraca FALSE dla nieznanego polecenia.
+ */
+int cli_execute(const char *line)
+{
+	int i;
+	int found = 0;
+	array_t *args;
+
+	if (!cli_arena)
+		cli_arena = arena_init(ARENA_DEFAULT_SIZE);
+
+	arena_reset(cli_arena);
+	args = array_init_split_string(cli_arena, arena_strdup(cli_arena, line), " ");
+
+	if (array_count(args) < 1)
+		return TRUE;
+	
+	for(i = 0; i < N(cli_callbacks); i++) {
+		if (!strcmp(cli_callbacks[i].ct_command, array_get(args, 0))) {
+			cli_callbacks[i].ct_function(args);
+			found = 1;
+			break;
+		}
+		
+		found = 0;
+	}
+	
+	if (!found)
+		xprintf("Nieznane polecenie. Aby zobaczyć pomoc, wpisz 'help'.\n");
+
+	/* Zwolnione strony oddajemy po trochu, po każdym poleceniu. */
+	if (storage_opened())
+		storage_compact(storage_get(), cli_vacuum_pages());
+
+	return found;
+}
+
 void cli_mainloop()
 {
 	signal(SIGPIPE, cli_sigpipe);
 	
 	while (1) {
-		int i;
-		int found = 0;
 		char *line = readline("rss> ");
-		array_t *args = array_init_split_string(line, " ");
 
-		if (array_count(args) < 1)
-			continue;
-		
-		for(i = 0; i < N(cli_callbacks); i++) {
-			if (!strcmp(cli_callbacks[i].ct_command, array_get(args, 0))) {
-				cli_callbacks[i].ct_function(args);
-				array_free(args, TRUE, FALSE);
-				found = 1;
-				break;
-			}
-			
-			found = 0;
+		/* Koniec wejścia (Ctrl-D) działa jak 'exit'. */
+		if (!line) {
+			xprintf("\n");
+			do_exit(NULL);
 		}
-		
-		if (!found)
-			xprintf("Nieznane polecenie. Aby zobaczyć pomoc, wpisz 'help'.\n");
 
+		cli_execute(line);
 		free(line);
 	}
 }
 
+/*
+ * Tryb wsadowy (-c, -f, polecenie w argumentach, serwer): pytania nie
+ * czytają odpowiedzi, bo stdin może być samym skryptem poleceń.
+ */
+void cli_batch()
+{
+	cli_batch_mode = TRUE;
+}
+
 int cli_ask(const char *question)
 {
-	char ch;
+	int ch;
 	xprintf("%s ", question);
+
+	if (cli_batch_mode) {
+		xprintf("(tryb wsadowy: odpowiedź domyślna)\n");
+		return TRUE;
+	}
+
+	fflush(stdout);
 	ch = getchar();
 	
 	switch (ch) {
-		case 't': case 'y': case 'T': case '\n':
+		/* Bez odpowiedzi (koniec wejścia) przyjmujemy domyślną. */
+		case 't': case 'y': case 'T': case '\n': case EOF:
 			return TRUE;
 		case 'n': case 'N':
 			return FALSE;
@@ -135,6 +198,7 @@ void do_help(array_t *args)
 
 void do_add_source(array_t *args)
 {
+	char *url;
 	feed_t *feed;
 	
 	if (array_count(args) != 3) {
@@ -143,7 +207,12 @@ void do_add_source(array_t *args)
 		return;
 	}
 	
-	feed = feed_create(xstrdup(array_get(args, 2)));
+	if (!(url = http_canonicalize_url(array_get(args, 2), NULL))) {
+		FAIL("add: nieprawidłowy adres źródła: %s\n", (char *)array_get(args, 2));
+		return;
+	}
+
+	feed = feed_create(url);
 	feed->f_name = xstrdup(array_get(args, 1));
 	feed_save(storage_get(), feed);
 	
@@ -167,7 +236,6 @@ void do_remove_source(array_t *args)
 	if (hash_key_exists(feeds, name))
 		feed_remove(storage_get(), hash_get(feeds, name));
 
-	hash_free(feeds, TRUE, TRUE);
 	xprintf("Źródło %s zostało usunięte.\n", name);
 }
 
@@ -182,11 +250,37 @@ void do_list_sources(array_t *args)
 	
 	FOREACH_HASH(feeds, i, key, value) {
 		feed_t *feed = (feed_t *)value;
-		xprintf("%s (%s)\t%s\n", key, feed->f_url, feed->f_description);
-		
+		xprintf("%s (%s)\t%s", key, feed->f_url, feed->f_description);
+
+		if (feed->f_redirects)
+			xprintf(" [przekierowań: %d]", feed->f_redirects);
+
+		xprintf("\n\twiadomości: %d, nowych: %d", feed->f_total, feed->f_unseen);
+
+		if (feed->f_total) {
+			char newest[32], oldest[32];
+
+			strftime(newest, sizeof(newest), "%Y-%m-%d %H:%M", localtime(&feed->f_newest));
+			strftime(oldest, sizeof(oldest), "%Y-%m-%d %H:%M", localtime(&feed->f_oldest));
+			xprintf(", od %s do %s", oldest, newest);
+		}
+
+		xprintf("\n");
 	}
+}
+
+/*
+ * Po aktualizacji źródła usuwa wiadomości ponad jego limity (max_items,
+ * max_age). Zwraca liczbę usuniętych wiadomości.
+ */
+int cli_retain(feed_t *feed)
+{
+	int removed = feed_retain(storage_get(), feed);
+
+	if (removed)
+		xprintf("Usunięto %d najstarszych wiadomości ponad limity źródła %s.\n", removed, feed->f_name);
 
-	hash_free(feeds, TRUE, TRUE);
+	return removed;
 }
 
 void do_update(array_t *args)
@@ -195,7 +289,7 @@ void do_update(array_t *args)
 	const char *name;
 	void *value;
 	feed_t *feed;
-	int i;
+	int i, removed = 0;
 
 	if (array_count(args) == 2) {
 		if (!hash_key_exists(feeds, array_get(args, 1))) {
@@ -206,6 +300,7 @@ void do_update(array_t *args)
 		feed = hash_get(feeds, array_get(args, 1));
 		xprintf("Aktualizacja źródła: %s\n", feed->f_name);
 		feed_download(storage_get(), feed);
+		removed += cli_retain(feed);
 	}
 	
 	if (array_count(args) == 1) {
@@ -213,100 +308,300 @@ void do_update(array_t *args)
 			feed = (feed_t *)value;
 			xprintf("Aktualizacja źródła: %s\n", (char *)name);
 			feed_download(storage_get(), feed);
+			removed += cli_retain(feed);
 		} 
 	}
 
-	hash_free(feeds, TRUE, TRUE);
+	/* Przedrostki adresów usuniętych wiadomości sprzątamy raz dla wszystkich źródeł. */
+	if (removed)
+		storage_prune_prefixes(storage_get());
 }
 
-void do_view(array_t *args)
+/*
+ * Wspólne parametry 'view' i 'search': feed, newer, older, limit, all, brief.
+ * Argumenty niebędące parametrami dopisuje do terms (o ile terms != NULL).
+ * Zwraca FALSE przy błędnej wartości parametru.
+ */
+int cli_parse_query(array_t *args, feed_query_t *fq, array_t *terms)
 {
-	int use_colors, i, limit = 0;
-	char *use_pager = NULL;
-	void *data;
-	feed_query_t fq = { 0 };
-	FILE *f = NULL;
-	feed_entry_t *fe;
-	array_t *entries = NULL;
-	hash_t *feeds = config_get_feeds(storage_get());
-	
-	use_colors = !strcmp(config_get(storage_get(), "use_colors"), "on");
-	
-	FOREACH_ARRAY(args, i, data) {
-		char *cmd = (char *)data;
-		
+	int i, limit;
+
+	for (i = 1; i < array_count(args); i++) {
+		char *cmd = (char *)array_get(args, i);
+		char *value = array_get(args, i + 1);
+
+		if (!strcmp(cmd, "all")) {
+			fq->fq_mask = QUERY_ALL;
+			continue;
+		}
+
+		if (!strcmp(cmd, "brief")) {
+			fq->fq_brief = TRUE;
+			continue;
+		}
+
+		if (strcmp(cmd, "feed") && strcmp(cmd, "newer") && strcmp(cmd, "older") && strcmp(cmd, "limit")) {
+			if (terms)
+				array_append(terms, cmd);
+
+			continue;
+		}
+
+		if (!value) {
+			xprintf("%s: brak wartości parametru.\n", cmd);
+			return FALSE;
+		}
+
+		i++;
+
 		if (!strcmp(cmd, "feed")) {
-			fq.fq_mask = QUERY_HAS_SOURCE;
-			fq.fq_feed = xstrdup(array_get(args, ++i));
+			fq->fq_mask |= QUERY_HAS_SOURCE;
+			fq->fq_feed = value;
 		}
 		
 		if (!strcmp(cmd, "newer")) {
-			fq.fq_mask |= QUERY_HAS_FROM_TIME;
-			fq.fq_from_time = parse_time_diff(array_get(args, ++i));
+			fq->fq_mask |= QUERY_HAS_FROM_TIME;
+			fq->fq_from_time = parse_time_diff(value);
 		}
 		
 		if (!strcmp(cmd, "older")) {
-			fq.fq_mask |= QUERY_HAS_TO_TIME;
-			fq.fq_to_time = parse_time_diff(array_get(args, ++i));
+			fq->fq_mask |= QUERY_HAS_TO_TIME;
+			fq->fq_to_time = parse_time_diff(value);
 		}
 
 		if (!strcmp(cmd, "limit")) {
-			if (!(limit = strtoul(array_get(args, ++i), NULL, 10))) {
+			if (!(limit = strtoul(value, NULL, 10))) {
 				xprintf("limit: proszę podać wartość numeryczną.\n");
-				goto cleanup;
+				return FALSE;
 			}
 			
-			fq.fq_mask |= QUERY_HAS_LIMIT;
-			fq.fq_limit = limit;
+			fq->fq_mask |= QUERY_HAS_LIMIT;
+			fq->fq_limit = limit;
 		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Format wypisywanych wiadomości (zmienna output_format).
+ */
+int cli_output_format()
+{
+	char *value = config_get(storage_get(), "output_format");
+	int ret = render_format(value);
+
+	if (ret < 0) {
+		if (*value && strcmp(value, "<brak>"))
+			xprintf("output_format: nieznany format '%s', używam 'human'.\n", value);
+
+		ret = RENDER_HUMAN;
+	}
+
+	free(value);
+	return ret;
+}
+
+/*
+ * Wypisuje wiadomości w formacie output_format; tekst dla człowieka przez
+ * pager, jeśli use_pager = on. Wiadomości z wyszukiwania mają zamiast
+ * pełnego opisu fragment z zaznaczonymi trafieniami (fe_snippet). Przy
+ * brief każda wiadomość to id, data, źródło i tytuł oraz adres; opis
+ * wyświetla polecenie 'read'.
+ */
+void cli_show_entries(array_t *entries, int use_colors, int brief)
+{
+	int i, format = cli_output_format();
+	void *data;
+	render_t render;
+	char *use_pager = config_get(storage_get(), "use_pager");
+	FILE *f = (format == RENDER_HUMAN && !strcmp(use_pager, "on") && isatty(STDOUT_FILENO))
+	    ? popen(PAGER, "w")
+	    : stdout;
+
+	render_begin(&render, f, format, use_colors, brief);
+
+	FOREACH_ARRAY(entries, i, data)
+		render_entry(&render, (feed_entry_t *)data);
+
+	render_end(&render);
+
+	if (f != stdout)
+	        pclose(f);
+
+	free(use_pager);
+}
+
+int cli_use_colors()
+{
+	char *value = config_get(storage_get(), "use_colors");
+	int ret = !strcmp(value, "on");
+
+	free(value);
+	return ret;
+}
+
+int cli_vacuum_pages()
+{
+	char *value = config_get(storage_get(), "vacuum_pages");
+	int ret = atoi(value);
+
+	free(value);
+	return ret;
+}
 
-		if (!strcmp(cmd, "all"))
-			fq.fq_mask = QUERY_ALL;
+/*
+ * Przy show_stats wypisuje, ile stron bazy wczytało zapytanie i ile
+ * kosztowało rozpakowanie opisów wyświetlonych wiadomości.
+ */
+void cli_query_report(const storage_codec_stats_t *before, int pages)
+{
+	storage_codec_stats_t *after = storage_codec_stats();
+	char *show_stats = config_get(storage_get(), "show_stats");
+
+	if (strcmp(show_stats, "on")) {
+		free(show_stats);
+		return;
 	}
+
+	xprintf("Wczytano %d stron bazy danych.\n", pages);
+
+	if (after->cs_decoded > before->cs_decoded)
+		xprintf("Rozpakowano %lu opisów (%zu B) w %.2f ms.\n",
+		    after->cs_decoded - before->cs_decoded, after->cs_decoded_bytes - before->cs_decoded_bytes,
+		    (after->cs_decode_time - before->cs_decode_time) * 1000);
+
+	free(show_stats);
+}
+
+static int cli_compare_id(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return x < y ? -1 : x > y;
+}
+
+void do_view(array_t *args)
+{
+	int i;
+	void *data;
+	feed_query_t fq = { 0 };
+	array_t *entries;
+	hash_t *shown = hash_init_arena(cli_arena);
+	const char *name;
+	storage_codec_stats_t codec = *storage_codec_stats();
+	int pages, *ids;
 	
-	entries = feed_get_entries(storage_get(), &fq);
+	if (!cli_parse_query(args, &fq, NULL))
+		return;
+
+	storage_cache_misses(storage_get());
+	entries = feed_get_entries(storage_get(), &fq, cli_arena);
+	pages = storage_cache_misses(storage_get());
 	
+	/* Pusty wynik w NDJSON i TSV to po prostu brak wierszy. */
 	if (array_count(entries) == 0) {
-		printf("Nie znaleziono pasujących wiadomości.\n");
-		goto cleanup;
+		if (cli_output_format() == RENDER_HUMAN)
+			printf("Nie znaleziono pasujących wiadomości.\n");
+		return;
 	}
-	
-	use_pager = config_get(storage_get(), "use_pager");
-	f = (!strcmp(use_pager, "on"))
-	    ? popen(PAGER, "w")
-	    : stdout;
-	    
+
+	cli_show_entries(entries, cli_use_colors(), fq.fq_brief);
+	cli_query_report(&codec, pages);
+
+	ids = arena_alloc(cli_arena, array_count(entries) * sizeof(int));
+
 	FOREACH_ARRAY(entries, i, data) {
-		char date[256];
-		struct tm *tmp;
-		fe = (feed_entry_t *)data;
+		feed_entry_t *fe = (feed_entry_t *)data;
 
-		tmp = localtime(&(fe->fe_pubdate));
-		strftime(date, sizeof(date), "%A, %d %B %Y, %H:%M:%S", tmp);
-	
-		if (use_colors) {
-			fprintf(f, "\033[1mŹródło: %s\033[0m\n", fe->fe_feed);
-			fprintf(f, "\033[1mData: %s \033[0m\n", date);
-			fprintf(f, "\033[1mURL: %s\033[0m\n", fe->fe_url);
-			fprintf(f, "\033[1;31m%s\033[0m\n", fe->fe_title);
-		} else {
-			fprintf(f, "Źródło: %s\n", fe->fe_feed);
-			fprintf(f, "Data: %s\n", date);
-			fprintf(f, "URL: %s\n", fe->fe_url);
-			fprintf(f, "Tytuł: %s\n", fe->fe_title);
+		ids[i] = fe->fe_id;
+
+		if (!hash_key_exists(shown, fe->fe_feed))
+			hash_set(shown, fe->fe_feed, NULL, FALSE);
+	}
+
+	/* Wyświetlone wiadomości przestają być nowe (licznik w 'list'). */
+	qsort(ids, array_count(entries), sizeof(int), cli_compare_id);
+
+	FOREACH_HASH(shown, i, name, data)
+		feed_mark_seen(storage_get(), name, ids, array_count(entries));
+}
+
+void do_search(array_t *args)
+{
+	int i, use_colors = cli_use_colors();
+	void *data;
+	feed_query_t fq = { 0 };
+	array_t *entries, *terms = array_init_arena(cli_arena, 0);
+	char *match = "";
+
+	if (!cli_parse_query(args, &fq, terms))
+		return;
+
+	if (!array_count(terms)) {
+		printf("Niepoprawna składnia. Aby uzyskać pomoc na temat tego polecenia, wpisz 'help search'.\n");
+		return;
+	}
+
+	/*
+	 * Słowa ze znakami spoza składni FTS5 (np. "e-mail", "c++") ujmujemy
+	 * w cudzysłów, żeby nie były brane za operatory.
+	 */
+	FOREACH_ARRAY(terms, i, data) {
+		char *term = data, *joined, *p;
+		int quote = FALSE;
+
+		for (p = term; *p && *term != '"'; p++) {
+			if (!isalnum((unsigned char)*p) && !(*p & 0x80) && !strchr("*:()", *p))
+				quote = TRUE;
 		}
-		
-		fprintf(f, "%s\n", fe->fe_description);
-		fprintf(f, "\n");
+
+		joined = arena_alloc(cli_arena, strlen(match) + strlen(term) + 4);
+		sprintf(joined, quote ? "%s%s\"%s\"" : "%s%s%s", match, i ? " " : "", term);
+		match = joined;
 	}
+
+	/* "all" w wyszukiwaniu znosi jedynie pozostałe filtry. */
+	if (fq.fq_mask == QUERY_ALL)
+		fq.fq_mask = 0;
+
+	fq.fq_match = match;
+	fq.fq_highlight_start = use_colors ? "\033[1;33m" : "*";
+	fq.fq_highlight_end = use_colors ? "\033[0m" : "*";
+	entries = feed_get_entries(storage_get(), &fq, cli_arena);
 	
-cleanup:
-	if (f && f != stdout)
-	        fclose(f);
-	
-	free(use_pager);
-	array_free(entries, TRUE, TRUE);
-	hash_free(feeds, TRUE, TRUE);
+	if (!entries)
+		return;
+
+	/* Pusty wynik w NDJSON i TSV to po prostu brak wierszy. */
+	if (array_count(entries) == 0) {
+		if (cli_output_format() == RENDER_HUMAN)
+			printf("Nie znaleziono pasujących wiadomości.\n");
+		return;
+	}
+
+	cli_show_entries(entries, use_colors, fq.fq_brief);
+}
+
+void do_read(array_t *args)
+{
+	feed_entry_t *entry;
+	array_t *entries;
+	char *end;
+	long id;
+
+	if (array_count(args) != 2 || (id = strtol(array_get(args, 1), &end, 10)) <= 0 || *end) {
+		printf("Niepoprawna składnia. Aby uzyskać pomoc na temat tego polecenia, wpisz 'help read'.\n");
+		return;
+	}
+
+	if (!(entry = feed_get_entry(storage_get(), id, cli_arena))) {
+		xprintf("Nie ma wiadomości o numerze %ld.\n", id);
+		return;
+	}
+
+	entries = array_init_arena(cli_arena, 0);
+	array_append(entries, entry);
+	cli_show_entries(entries, cli_use_colors(), FALSE);
 }
 
 void do_flush(array_t *args)
@@ -316,11 +611,46 @@ void do_flush(array_t *args)
 		return;
 	}
 	
-	feed_flush(storage_get(), parse_time_diff(array_get(args, 1)));
+	if (!feed_flush(storage_get(), parse_time_diff(array_get(args, 1)))) {
+		FAIL("Nie usunięto żadnych wiadomości.\n");
+		return;
+	}
+
 	xprintf("Usunięto wiadomości starsze niż %s.\n", array_get(args, 1));
 	return;
 }
 
+void do_compress(array_t *args)
+{
+	hash_t *feeds;
+	const char *name;
+	void *value;
+	int i;
+
+	if (array_count(args) != 2) {
+		printf("Niepoprawna składnia. Aby uzyskać pomoc na temat tego polecenia, wpisz 'help compress'.\n");
+		return;
+	}
+
+	feeds = config_get_feeds(storage_get());
+
+	if (!strcmp(array_get(args, 1), "all")) {
+		FOREACH_HASH(feeds, i, name, value) {
+			xprintf("Przepisywanie źródła: %s\n", name);
+			feed_compress(storage_get(), (feed_t *)value);
+		}
+	} else if (hash_key_exists(feeds, array_get(args, 1))) {
+		feed_compress(storage_get(), hash_get(feeds, array_get(args, 1)));
+	} else {
+		xprintf("Nie ma źródła o nazwie %s.\n", array_get(args, 1));
+		return;
+	}
+
+	/* Przepisane wiersze zostawiają strony tabel w większości puste. */
+	storage_prune_prefixes(storage_get());
+	storage_vacuum(storage_get());
+}
+
 void do_set(array_t *args)
 {
 	if (array_count(args) == 1) {
@@ -333,14 +663,12 @@ void do_set(array_t *args)
 		FOREACH_HASH(config, i, key, value) {
 			xprintf("%s: %s\n", key, (char *)value);
 		}
-
-		hash_free(config, TRUE, FALSE);
 	}
 	
 	if (array_count(args) == 2) {
-		char *varname = array_get(args, 1);
+		char *varname = array_get(args, 1), *old;
+
 		if (varname[0] == '-') {
-			char *old;
 			/* Ustaw NULLa. */
 			varname++;
 			old = config_get(storage_get(), varname);
@@ -348,9 +676,11 @@ void do_set(array_t *args)
 			xprintf("%s: %s -> <null>\n", varname, old);
 		} else {
 			/* Wyświetl zawartość zmiennej */
-			xprintf("%s: %s\n", varname, config_get(storage_get(), varname));
+			old = config_get(storage_get(), varname);
+			xprintf("%s: %s\n", varname, old);
 		}
 		
+		free(old);
 		return;
 	}
 	
@@ -360,6 +690,7 @@ void do_set(array_t *args)
 		char *old = config_get(storage_get(), varname);
 		config_set(storage_get(), varname, array_get(args, 2));
 		xprintf("%s: %s -> %s\n", varname, *old != '\0' ? old : "<brak>" , (char *)array_get(args, 2));
+		free(old);
 		return;
 	}
 	
@@ -372,9 +703,23 @@ void do_about(array_t *args)
 	xprintf("Wersja 0.0.1, październik 2008.\n");
 }
 
+void do_mem(array_t *args)
+{
+	int top = 10;
+
+	if (array_count(args) == 2 && !(top = strtoul(array_get(args, 1), NULL, 10))) {
+		xprintf("mem: proszę podać liczbę wyświetlanych miejsc.\n");
+		return;
+	}
+
+	mem_report(stdout, top);
+}
+
 void do_exit(array_t *args)
 {
-	storage_close(storage_get());
+	if (storage_opened())
+		storage_close(storage_get());
+
 	exit(EXIT_SUCCESS);
 }
 
@@ -7,6 +7,8 @@
 #define	__CLI_H
 
 void cli_mainloop();
+int cli_execute(const char *);
+void cli_batch();
 
 #endif	/* __CLI_H */
 
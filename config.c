@@ -8,77 +8,243 @@
 #include <unistd.h>
 #include <string.h>
 #include <sqlite3.h>
-#include <sqlite3.h>
 #include "storage.h"
 #include "utils.h"
 #include "feed.h"
 
-hash_t *config_get_feeds(storage_handle_t *handle)
+/*
+ * Pamięć podręczna tabel config i feeds, wczytywanych przy pierwszym
+ * użyciu. Nasze zapisy (config_set(), feed_save(), feed_remove())
+ * uaktualniają ją na bieżąco. Zmiany z innych procesów wykrywa PRAGMA
+ * data_version. Liczniki źródeł (total, unseen, ...) zmieniają też
+ * wyzwalacze partycji w naszym połączeniu, dlatego listę źródeł
+ * sprawdzamy dodatkowo licznikiem zmian połączenia
+ * (sqlite3_total_changes()).
+ */
+static hash_t	*config_values;		/* nazwa -> wartość (NULL: <brak>) */
+static int	config_values_version;
+static hash_t	*config_feeds;		/* nazwa -> feed_t */
+static int	config_feeds_version, config_feeds_changes, config_feeds_loaded;
+
+static void config_feed_copy(feed_t *feed, const feed_t *from)
 {
-	storage_stmt_t *stmt = storage_query(handle, "SELECT * FROM feeds");
-	hash_t *row, *ret = hash_init();
-	
+	if (!feed->f_url || strcmp(feed->f_url, from->f_url)) {
+		free(feed->f_url);
+		feed->f_url = xstrdup(from->f_url);
+	}
+
+	if (!feed->f_description || strcmp(feed->f_description, from->f_description ? from->f_description : "")) {
+		free(feed->f_description);
+		feed->f_description = xstrdup(from->f_description ? from->f_description : "");
+	}
+
+	feed->f_last_update = from->f_last_update;
+	feed->f_redirects = from->f_redirects;
+}
+
+/*
+ * Wczytuje tabelę feeds. Obiekty źródeł, które nadal istnieją, są
+ * uaktualniane w miejscu, więc wskaźniki na nie pozostają ważne.
+ */
+static void config_feeds_load(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle,
+	    "SELECT name, url, description, updated, redirects, total, unseen, newest, oldest FROM feeds");
+	hash_t *row, *feeds = hash_init();
+	feed_t *feed, loaded = { 0 };
+	const char *name;
+	void *value;
+	int i;
+
+	config_feeds_version = storage_data_version(handle);
+
 	while (storage_step(stmt, &row) == SQLITE_ROW) {
-		feed_t *feed = feed_create(hash_get(row, "url"));
-		feed->f_name = hash_get_string(row, "name");
-		feed->f_description = hash_get_string(row, "description");
-		feed->f_last_update = hash_get_int(row, "updated");
-		hash_set(ret, xstrdup(hash_get(row, "name")), feed, TRUE);
-		hash_free(row, FALSE, FALSE);
+		if (!config_feeds || !(feed = hash_get(config_feeds, hash_get(row, "name")))) {
+			feed = feed_create(NULL);
+			feed->f_name = xstrdup(hash_get(row, "name"));
+		}
+
+		loaded.f_url = hash_get(row, "url");
+		loaded.f_description = hash_get(row, "description");
+		loaded.f_last_update = hash_get_int64(row, "updated");
+		loaded.f_redirects = hash_get_int(row, "redirects");
+		config_feed_copy(feed, &loaded);
+		feed->f_total = hash_get_int(row, "total");
+		feed->f_unseen = hash_get_int(row, "unseen");
+		feed->f_newest = hash_get_int64(row, "newest");
+		feed->f_oldest = hash_get_int64(row, "oldest");
+		hash_set(feeds, xstrdup(feed->f_name), feed, TRUE);
+		hash_free(row, TRUE, FALSE);
 	}
-	
+
 	storage_finalize(stmt);
-	return ret;
+
+	if (config_feeds) {
+		FOREACH_HASH(config_feeds, i, name, value) {
+			if (!hash_key_exists(feeds, name))
+				DELETE(value);
+		}
+
+		hash_free(config_feeds, FALSE, FALSE);
+	}
+
+	config_feeds = feeds;
+	config_feeds_changes = sqlite3_total_changes(handle->sh_db);
+	config_feeds_loaded = TRUE;
 }
 
-char *config_get(storage_handle_t *handle, const char *name)
+/*
+ * Uwzględnia zapis, który zmienił changes wierszy: jeśli poza nim
+ * połączenie niczego nie zmieniło, lista źródeł pozostaje aktualna.
+ */
+static void config_feeds_written(storage_handle_t *handle, int changes)
 {
-	char *ret, *sql = sqlite3_mprintf("SELECT * FROM config WHERE name = %Q", name);
-	storage_stmt_t *stmt = storage_query(handle, sql);
-	hash_t *row = NULL;
-	
-	storage_step(stmt, &row);
-	storage_finalize(stmt);
-	sqlite3_free(sql);
-	ret = row ? hash_get(row, "value") : xstrdup("");
-
-	if (!ret)
-		ret = xstrdup("<brak>");
-	
-	if (row) {
-		free(hash_get(row, "name"));
-	        hash_free(row, FALSE, FALSE);
+	if (config_feeds_changes + changes == sqlite3_total_changes(handle->sh_db))
+		config_feeds_changes += changes;
+}
+
+/*
+ * Zwraca źródła (nazwa -> feed_t). Tablica i źródła należą do pamięci
+ * podręcznej; nie wolno ich zwalniać.
+ */
+hash_t *config_get_feeds(storage_handle_t *handle)
+{
+	if (!config_feeds_loaded || config_feeds_version != storage_data_version(handle) ||
+	    config_feeds_changes != sqlite3_total_changes(handle->sh_db))
+		config_feeds_load(handle);
+
+	return config_feeds;
+}
+
+/*
+ * Zapis przez pamięć podręczną po feed_save(): uaktualnia (lub dodaje)
+ * kopię źródła, chyba że to właśnie ona została zapisana.
+ */
+void config_feed_saved(storage_handle_t *handle, feed_t *feed)
+{
+	feed_t *cached;
+
+	if (!config_feeds_loaded)
+		return;
+
+	if (!(cached = hash_get(config_feeds, feed->f_name))) {
+		cached = feed_create(NULL);
+		cached->f_name = xstrdup(feed->f_name);
+		hash_set(config_feeds, xstrdup(feed->f_name), cached, TRUE);
 	}
-	
-	return ret;
+
+	if (cached != feed)
+		config_feed_copy(cached, feed);
+
+	config_feeds_written(handle, sqlite3_changes(handle->sh_db));
 }
 
-hash_t *config_get_all(storage_handle_t *handle)
+/*
+ * Zapis przez pamięć podręczną po feed_remove(). Usunięcie wiadomości
+ * zmienia wiele wierszy, więc liczby zmian nie sprawdzamy: do pamięci
+ * podręcznej trafi to przy najbliższym odczycie listy źródeł.
+ */
+void config_feed_removed(storage_handle_t *handle, const char *name)
 {
-	char *sql = "SELECT * FROM config";
-	hash_t *row, *ret = hash_init();
-	storage_stmt_t *stmt = storage_query(handle, sql);
-	
+	feed_t *cached;
+
+	if (!config_feeds_loaded || !(cached = hash_get(config_feeds, name)))
+		return;
+
+	hash_unset(config_feeds, name, FALSE);
+	DELETE(cached);
+}
+
+static hash_t *config_values_get(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt;
+	hash_t *row;
+	int version = storage_data_version(handle);
+
+	if (config_values && config_values_version == version)
+		return config_values;
+
+	hash_free(config_values, TRUE, FALSE);
+	config_values = hash_init();
+	config_values_version = version;
+	stmt = storage_query(handle, "SELECT * FROM config");
+
 	while (storage_step(stmt, &row) == SQLITE_ROW) {
-		hash_set(
-			ret, 
-			hash_get(row, "name"),
-			hash_get(row, "value"),
-			TRUE
-		);
-		
+		hash_set(config_values, hash_get(row, "name"), hash_get(row, "value"), TRUE);
 		hash_free(row, FALSE, FALSE);
 	}
-	
+
 	storage_finalize(stmt);
-	return ret;
+	return config_values;
+}
+
+/*
+ * Zwraca kopię wartości zmiennej: "" dla nieistniejącej, "<brak>" dla
+ * ustawionej na NULL.
+ */
+char *config_get(storage_handle_t *handle, const char *name)
+{
+	hash_t *values = config_values_get(handle);
+	char *value;
+
+	if (!hash_key_exists(values, name))
+		return xstrdup("");
+
+	value = hash_get(values, name);
+	return xstrdup(value ? value : "<brak>");
+}
+
+/*
+ * Zwraca wszystkie zmienne (nazwa -> wartość); tablica należy do pamięci
+ * podręcznej.
+ */
+hash_t *config_get_all(storage_handle_t *handle)
+{
+	return config_values_get(handle);
 }
 
 void config_set(storage_handle_t *handle, const char *name, const char *value)
 {
 	char *sql = sqlite3_mprintf("INSERT OR REPLACE INTO config VALUES (%Q, %Q)", name, value);
 	storage_stmt_t *stmt = storage_query(handle, sql);
+	hash_t *values = config_values_get(handle);
+
 	storage_step(stmt, NULL);
 	storage_finalize(stmt);
 	sqlite3_free(sql);
+
+	/* REPLACE przenosi wiersz na koniec tabeli; kolejność jak w bazie. */
+	hash_unset(values, name, TRUE);
+	hash_set(values, xstrdup(name), value ? xstrdup(value) : NULL, TRUE);
+	config_feeds_written(handle, sqlite3_changes(handle->sh_db));
+}
+
+/*
+ * Wartość zmiennej dla konkretnego źródła: "<źródło>.<zmienna>", a jeśli
+ * takiej nie ustawiono - zmienna globalna.
+ */
+char *config_get_feed(storage_handle_t *handle, const char *feed, const char *name)
+{
+	char *ret, *key = sqlite3_mprintf("%s.%s", feed, name);
+
+	ret = config_get(handle, key);
+	sqlite3_free(key);
+
+	if (*ret && strcmp(ret, "<brak>"))
+		return ret;
+
+	free(ret);
+	return config_get(handle, name);
+}
+
+int config_get_feed_int(storage_handle_t *handle, const char *feed, const char *name, int fallback)
+{
+	char *end, *value = config_get_feed(handle, feed, name);
+	long ret = strtol(value, &end, 10);
+
+	if (end == value)
+		ret = fallback;
+
+	free(value);
+	return ret;
 }
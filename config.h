@@ -8,11 +8,16 @@
 
 #include "utils.h"
 #include "storage.h"
+#include "feed.h"
 
 hash_t	*config_get_feeds(storage_handle_t *);
+void	config_feed_saved(storage_handle_t *, feed_t *);
+void	config_feed_removed(storage_handle_t *, const char *);
 char	*config_get(storage_handle_t *, const char *);
 hash_t	*config_get_all(storage_handle_t *);
 void	config_set(storage_handle_t *, const char *, const char *);
+char	*config_get_feed(storage_handle_t *, const char *, const char *);
+int	config_get_feed_int(storage_handle_t *, const char *, const char *, int);
 
 #endif	/* __CONFIG_H */
 
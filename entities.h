@@ -0,0 +1,115 @@
+/*
+ * File:   entities.h
+ * Author: Adrian Jamróz
+ */
+
+#ifndef __ENTITIES_H
+#define __ENTITIES_H
+
+#include <stdint.h>
+
+/*
+ * Nazwane encje HTML 4 (oraz &apos;) z idealną funkcją mieszającą typu
+ * "hash and displace": kubełek wyznacza FNV-1a z podstawą
+ * HTML_ENTITY_BASIS1, a pozycję w html_entity_slots - FNV-1a z podstawą
+ * HTML_ENTITY_BASIS2 przesunięty o html_entity_disp[kubełek]. Każdej
+ * nazwie odpowiada inna pozycja, więc wyszukiwanie to jedno porównanie.
+ * Tablice wygenerowano skryptem na podstawie listy encji HTML 4; przy
+ * zmianie listy trzeba je wygenerować ponownie.
+ */
+#define	HTML_ENTITY_BASIS1	2166136261U
+#define	HTML_ENTITY_BASIS2	0xbd726eb7U
+#define	HTML_ENTITY_BUCKETS	128
+#define	HTML_ENTITY_SLOTS	512
+#define	HTML_ENTITY_MAXLEN	8
+
+static const struct { const char *name; uint16_t cp; } html_entities[] = {
+	{ "AElig", 198 }, { "Aacute", 193 }, { "Acirc", 194 }, { "Agrave", 192 }, { "Alpha", 913 }, { "Aring", 197 },
+	{ "Atilde", 195 }, { "Auml", 196 }, { "Beta", 914 }, { "Ccedil", 199 }, { "Chi", 935 }, { "Dagger", 8225 },
+	{ "Delta", 916 }, { "ETH", 208 }, { "Eacute", 201 }, { "Ecirc", 202 }, { "Egrave", 200 }, { "Epsilon", 917 },
+	{ "Eta", 919 }, { "Euml", 203 }, { "Gamma", 915 }, { "Iacute", 205 }, { "Icirc", 206 }, { "Igrave", 204 },
+	{ "Iota", 921 }, { "Iuml", 207 }, { "Kappa", 922 }, { "Lambda", 923 }, { "Mu", 924 }, { "Ntilde", 209 },
+	{ "Nu", 925 }, { "OElig", 338 }, { "Oacute", 211 }, { "Ocirc", 212 }, { "Ograve", 210 }, { "Omega", 937 },
+	{ "Omicron", 927 }, { "Oslash", 216 }, { "Otilde", 213 }, { "Ouml", 214 }, { "Phi", 934 }, { "Pi", 928 },
+	{ "Prime", 8243 }, { "Psi", 936 }, { "Rho", 929 }, { "Scaron", 352 }, { "Sigma", 931 }, { "THORN", 222 },
+	{ "Tau", 932 }, { "Theta", 920 }, { "Uacute", 218 }, { "Ucirc", 219 }, { "Ugrave", 217 }, { "Upsilon", 933 },
+	{ "Uuml", 220 }, { "Xi", 926 }, { "Yacute", 221 }, { "Yuml", 376 }, { "Zeta", 918 }, { "aacute", 225 },
+	{ "acirc", 226 }, { "acute", 180 }, { "aelig", 230 }, { "agrave", 224 }, { "alefsym", 8501 }, { "alpha", 945 },
+	{ "amp", 38 }, { "and", 8743 }, { "ang", 8736 }, { "apos", 39 }, { "aring", 229 }, { "asymp", 8776 },
+	{ "atilde", 227 }, { "auml", 228 }, { "bdquo", 8222 }, { "beta", 946 }, { "brvbar", 166 }, { "bull", 8226 },
+	{ "cap", 8745 }, { "ccedil", 231 }, { "cedil", 184 }, { "cent", 162 }, { "chi", 967 }, { "circ", 710 },
+	{ "clubs", 9827 }, { "cong", 8773 }, { "copy", 169 }, { "crarr", 8629 }, { "cup", 8746 }, { "curren", 164 },
+	{ "dArr", 8659 }, { "dagger", 8224 }, { "darr", 8595 }, { "deg", 176 }, { "delta", 948 }, { "diams", 9830 },
+	{ "divide", 247 }, { "eacute", 233 }, { "ecirc", 234 }, { "egrave", 232 }, { "empty", 8709 }, { "emsp", 8195 },
+	{ "ensp", 8194 }, { "epsilon", 949 }, { "equiv", 8801 }, { "eta", 951 }, { "eth", 240 }, { "euml", 235 },
+	{ "euro", 8364 }, { "exist", 8707 }, { "fnof", 402 }, { "forall", 8704 }, { "frac12", 189 }, { "frac14", 188 },
+	{ "frac34", 190 }, { "frasl", 8260 }, { "gamma", 947 }, { "ge", 8805 }, { "gt", 62 }, { "hArr", 8660 },
+	{ "harr", 8596 }, { "hearts", 9829 }, { "hellip", 8230 }, { "iacute", 237 }, { "icirc", 238 }, { "iexcl", 161 },
+	{ "igrave", 236 }, { "image", 8465 }, { "infin", 8734 }, { "int", 8747 }, { "iota", 953 }, { "iquest", 191 },
+	{ "isin", 8712 }, { "iuml", 239 }, { "kappa", 954 }, { "lArr", 8656 }, { "lambda", 955 }, { "lang", 9001 },
+	{ "laquo", 171 }, { "larr", 8592 }, { "lceil", 8968 }, { "ldquo", 8220 }, { "le", 8804 }, { "lfloor", 8970 },
+	{ "lowast", 8727 }, { "loz", 9674 }, { "lrm", 8206 }, { "lsaquo", 8249 }, { "lsquo", 8216 }, { "lt", 60 },
+	{ "macr", 175 }, { "mdash", 8212 }, { "micro", 181 }, { "middot", 183 }, { "minus", 8722 }, { "mu", 956 },
+	{ "nabla", 8711 }, { "nbsp", 160 }, { "ndash", 8211 }, { "ne", 8800 }, { "ni", 8715 }, { "not", 172 },
+	{ "notin", 8713 }, { "nsub", 8836 }, { "ntilde", 241 }, { "nu", 957 }, { "oacute", 243 }, { "ocirc", 244 },
+	{ "oelig", 339 }, { "ograve", 242 }, { "oline", 8254 }, { "omega", 969 }, { "omicron", 959 }, { "oplus", 8853 },
+	{ "or", 8744 }, { "ordf", 170 }, { "ordm", 186 }, { "oslash", 248 }, { "otilde", 245 }, { "otimes", 8855 },
+	{ "ouml", 246 }, { "para", 182 }, { "part", 8706 }, { "permil", 8240 }, { "perp", 8869 }, { "phi", 966 },
+	{ "pi", 960 }, { "piv", 982 }, { "plusmn", 177 }, { "pound", 163 }, { "prime", 8242 }, { "prod", 8719 },
+	{ "prop", 8733 }, { "psi", 968 }, { "quot", 34 }, { "rArr", 8658 }, { "radic", 8730 }, { "rang", 9002 },
+	{ "raquo", 187 }, { "rarr", 8594 }, { "rceil", 8969 }, { "rdquo", 8221 }, { "real", 8476 }, { "reg", 174 },
+	{ "rfloor", 8971 }, { "rho", 961 }, { "rlm", 8207 }, { "rsaquo", 8250 }, { "rsquo", 8217 }, { "sbquo", 8218 },
+	{ "scaron", 353 }, { "sdot", 8901 }, { "sect", 167 }, { "shy", 173 }, { "sigma", 963 }, { "sigmaf", 962 },
+	{ "sim", 8764 }, { "spades", 9824 }, { "sub", 8834 }, { "sube", 8838 }, { "sum", 8721 }, { "sup", 8835 },
+	{ "sup1", 185 }, { "sup2", 178 }, { "sup3", 179 }, { "supe", 8839 }, { "szlig", 223 }, { "tau", 964 },
+	{ "there4", 8756 }, { "theta", 952 }, { "thetasym", 977 }, { "thinsp", 8201 }, { "thorn", 254 }, { "tilde", 732 },
+	{ "times", 215 }, { "trade", 8482 }, { "uArr", 8657 }, { "uacute", 250 }, { "uarr", 8593 }, { "ucirc", 251 },
+	{ "ugrave", 249 }, { "uml", 168 }, { "upsih", 978 }, { "upsilon", 965 }, { "uuml", 252 }, { "weierp", 8472 },
+	{ "xi", 958 }, { "yacute", 253 }, { "yen", 165 }, { "yuml", 255 }, { "zeta", 950 }, { "zwj", 8205 },
+	{ "zwnj", 8204 },
+};
+
+static const uint8_t html_entity_disp[HTML_ENTITY_BUCKETS] = {
+	2, 0, 0, 0, 0, 0, 0, 3, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 2, 0, 0, 0, 1, 1, 0,
+	1, 0, 0, 0, 2, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 2, 3, 0, 0, 0, 0, 0, 0, 3, 0, 0, 2, 0, 0, 1, 0, 2,
+	0, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0, 4, 1, 0, 0, 3, 0, 0, 4, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 2, 0, 7, 0, 0, 1, 3, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 2, 6, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const uint8_t html_entity_slots[HTML_ENTITY_SLOTS] = {
+	68, 253, 0, 0, 233, 0, 0, 242, 0, 0, 111, 183, 0, 0, 175, 118, 65, 202, 135, 212, 0, 0, 0, 0,
+	133, 116, 186, 157, 85, 220, 2, 252, 25, 0, 29, 0, 42, 0, 0, 0, 0, 52, 0, 46, 140, 169, 0, 244,
+	143, 0, 0, 0, 141, 1, 0, 248, 6, 0, 180, 43, 56, 148, 60, 0, 0, 125, 156, 0, 187, 0, 0, 0,
+	0, 230, 0, 232, 77, 211, 206, 235, 21, 0, 0, 0, 0, 62, 0, 217, 0, 199, 224, 0, 226, 0, 0, 192,
+	247, 0, 0, 0, 91, 239, 0, 0, 0, 5, 249, 0, 207, 74, 0, 0, 0, 194, 0, 0, 0, 0, 0, 0,
+	0, 0, 227, 16, 41, 122, 172, 53, 0, 182, 243, 0, 0, 0, 0, 0, 113, 92, 31, 0, 90, 9, 0, 54,
+	28, 0, 238, 102, 7, 0, 214, 163, 130, 67, 0, 0, 0, 153, 0, 241, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 50, 0, 0, 128, 0, 0, 234, 120, 178, 123, 0, 189, 73, 201, 34, 162, 69, 188, 0, 0, 0, 179, 95,
+	55, 0, 0, 0, 101, 59, 225, 0, 0, 0, 0, 240, 136, 0, 0, 164, 0, 0, 185, 209, 167, 88, 0, 0,
+	71, 0, 160, 47, 165, 218, 0, 195, 245, 0, 0, 0, 213, 127, 0, 159, 0, 0, 107, 0, 117, 96, 0, 150,
+	0, 0, 0, 0, 134, 61, 0, 0, 0, 170, 132, 236, 0, 0, 0, 0, 75, 0, 0, 203, 93, 0, 86, 0,
+	0, 66, 228, 190, 0, 0, 0, 0, 121, 108, 0, 0, 0, 216, 57, 138, 0, 99, 0, 0, 0, 0, 0, 13,
+	104, 0, 221, 0, 0, 0, 208, 0, 0, 0, 0, 0, 147, 0, 154, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	151, 0, 0, 0, 0, 0, 200, 246, 131, 0, 0, 0, 0, 19, 87, 0, 0, 0, 210, 204, 8, 0, 72, 17,
+	115, 10, 119, 0, 0, 3, 83, 168, 174, 70, 0, 4, 0, 0, 78, 97, 81, 197, 198, 103, 0, 145, 0, 49,
+	231, 12, 0, 0, 84, 32, 0, 100, 0, 229, 27, 205, 80, 0, 51, 152, 0, 0, 109, 215, 64, 0, 110, 0,
+	18, 89, 15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 173, 0, 0, 38, 0, 0, 0, 0, 0, 139,
+	126, 0, 0, 0, 184, 23, 39, 0, 223, 0, 98, 0, 58, 48, 22, 0, 176, 0, 0, 166, 0, 76, 45, 11,
+	146, 137, 171, 63, 144, 79, 33, 0, 158, 0, 0, 30, 0, 0, 0, 0, 0, 82, 0, 24, 250, 0, 237, 124,
+	0, 0, 14, 0, 177, 0, 0, 0, 0, 44, 0, 222, 26, 0, 40, 105, 0, 35, 193, 219, 191, 0, 196, 36,
+	0, 0, 0, 0, 0, 106, 142, 251, 0, 0, 0, 0, 0, 149, 37, 155, 20, 129, 0, 0, 0, 0, 161, 181,
+	0, 94, 114, 112, 0, 0, 0, 0,
+};
+
+/*
+ * Znaki, na które przeglądarki zamieniają odwołania &#128; - &#159;
+ * (zakres kontrolny C1, w praktyce teksty w windows-1252).
+ */
+static const uint16_t html_cp1252[32] = {
+	0x20ac, 0xfffd, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+	0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0xfffd, 0x017d, 0xfffd,
+	0xfffd, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+	0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0xfffd, 0x017e, 0x0178
+};
+
+#endif	/* __ENTITIES_H */
@@ -3,11 +3,11 @@
  * Author: Adrian Jamróz
  */
      
-#define _XOPEN_SOURCE
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -40,107 +40,945 @@ feed_entry_t *feed_entry_create()
 
 void feed_entry_free(feed_entry_t *entry)
 {
+	/* Pola wiadomości przydzielonej z areny zwalnia arena_reset(). */
+	if (entry->fe_arena)
+		return;
+
 	if (entry->fe_feed) free(entry->fe_feed);
 	if (entry->fe_title) free(entry->fe_title);
 	if (entry->fe_url) free(entry->fe_url);
 	if (entry->fe_description) free(entry->fe_description);
+	if (entry->fe_guid) free(entry->fe_guid);
 }
 
-int feed_entry_persist(storage_handle_t *handle, feed_entry_t *entry)
+/*
+ * Pamięć podręczna ostatnich wiadomości: pierścień kopii wiadomości nie
+ * starszych niż fr_floor, wczytywany przy pierwszym domyślnym 'view'
+ * i uzupełniany przez feed_entry_persist(). Odpowiada na 'view' bez
+ * parametrów bez zapytań do bazy. Wypchnięcie
+ * wiadomości z pełnego pierścienia podnosi fr_floor; usuwanie wiadomości
+ * (flush, remove, limity źródeł) i zmiany bazy z innych procesów
+ * (storage_data_version()) unieważniają całą zawartość.
+ */
+struct feed_recent
 {
-	int ret;
-	char *sql = sqlite3_mprintf(
-		"INSERT OR REPLACE INTO posts VALUES (NULL, %Q, %u, %Q, %Q, %Q);",
+	feed_entry_t	*fr_entries[FEED_RECENT_SIZE];
+	int		fr_months[FEED_RECENT_SIZE];
+	int		fr_first;
+	int		fr_count;
+	int		fr_loaded;
+	int		fr_version;
+	time_t		fr_floor;
+};
+
+static struct feed_recent feed_recent;
+
+static feed_entry_t **feed_recent_slot(int i)
+{
+	return &feed_recent.fr_entries[(feed_recent.fr_first + i) % FEED_RECENT_SIZE];
+}
+
+static void feed_recent_invalidate()
+{
+	int i;
+
+	for (i = 0; i < feed_recent.fr_count; i++)
+		managed_delete(*feed_recent_slot(i));
+
+	feed_recent.fr_first = feed_recent.fr_count = 0;
+	feed_recent.fr_loaded = FALSE;
+}
+
+/*
+ * Dopisuje kopię zapisanej wiadomości; przy replace wiadomość o tym samym
+ * tytule (zastąpioną w bazie) usuwa z pierścienia.
+ */
+static void feed_recent_add(const feed_entry_t *entry, int replace)
+{
+	feed_entry_t *copy, **slot;
+	struct tm tm;
+	int i;
+
+	if (!feed_recent.fr_loaded || entry->fe_pubdate < feed_recent.fr_floor)
+		return;
+
+	for (i = 0; replace && i < feed_recent.fr_count; i++) {
+		if (strcmp((*feed_recent_slot(i))->fe_title, entry->fe_title))
+			continue;
+
+		managed_delete(*feed_recent_slot(i));
+
+		for (; i < feed_recent.fr_count - 1; i++) {
+			*feed_recent_slot(i) = *feed_recent_slot(i + 1);
+			feed_recent.fr_months[(feed_recent.fr_first + i) % FEED_RECENT_SIZE] =
+			    feed_recent.fr_months[(feed_recent.fr_first + i + 1) % FEED_RECENT_SIZE];
+		}
+
+		feed_recent.fr_count--;
+		break;
+	}
+
+	if (feed_recent.fr_count == FEED_RECENT_SIZE) {
+		slot = feed_recent_slot(0);
+
+		if ((*slot)->fe_pubdate >= feed_recent.fr_floor)
+			feed_recent.fr_floor = (*slot)->fe_pubdate + 1;
+
+		managed_delete(*slot);
+		feed_recent.fr_first = (feed_recent.fr_first + 1) % FEED_RECENT_SIZE;
+		feed_recent.fr_count--;
+	}
+
+	copy = feed_entry_create();
+	copy->fe_id = entry->fe_id;
+	copy->fe_pubdate = entry->fe_pubdate;
+	copy->fe_feed = xstrdup(entry->fe_feed ? entry->fe_feed : "");
+	copy->fe_title = xstrdup(entry->fe_title ? entry->fe_title : "");
+	copy->fe_url = xstrdup(entry->fe_url ? entry->fe_url : "");
+	copy->fe_description = xstrdup(entry->fe_description ? entry->fe_description : "");
+	copy->fe_guid = entry->fe_guid ? xstrdup(entry->fe_guid) : NULL;
+
+	/* Miesiąc (partycja) wiadomości, do odtworzenia kolejności wyników z bazy. */
+	gmtime_r(&entry->fe_pubdate, &tm);
+	feed_recent.fr_months[(feed_recent.fr_first + feed_recent.fr_count) % FEED_RECENT_SIZE] =
+	    (tm.tm_year + 1900) * 100 + tm.tm_mon + 1;
+	*feed_recent_slot(feed_recent.fr_count++) = copy;
+}
+
+static int feed_recent_compare_pubdate(const void *a, const void *b)
+{
+	const feed_entry_t *x = *(feed_entry_t **)a, *y = *(feed_entry_t **)b;
+
+	if (x->fe_pubdate != y->fe_pubdate)
+		return x->fe_pubdate < y->fe_pubdate ? -1 : 1;
+
+	return x->fe_id - y->fe_id;
+}
+
+/*
+ * Wczytuje do pierścienia wiadomości z ostatniej doby (i późniejsze),
+ * od najstarszej, żeby przy przepełnieniu wypchnąć właśnie najstarsze.
+ */
+static void feed_recent_load(storage_handle_t *handle)
+{
+	arena_t *arena = arena_init(FEED_ARENA_SIZE);
+	feed_query_t query = { 0 };
+	array_t *entries;
+	int i;
+
+	feed_recent_invalidate();
+	feed_recent.fr_version = storage_data_version(handle);
+	query.fq_mask = QUERY_HAS_FROM_TIME;
+	query.fq_from_time = feed_recent.fr_floor = time(NULL) - UNIX_DAY;
+
+	if ((entries = feed_get_entries(handle, &query, arena))) {
+		qsort(entries->a_data, entries->a_count, sizeof(void *), feed_recent_compare_pubdate);
+		feed_recent.fr_loaded = TRUE;
+
+		for (i = 0; i < entries->a_count; i++)
+			feed_recent_add(entries->a_data[i], FALSE);
+	}
+
+	arena_free(arena);
+}
+
+struct feed_recent_match
+{
+	feed_entry_t	*rm_entry;
+	int		rm_month;
+};
+
+/*
+ * Porządek jak w wynikach z bazy: partycje kolejno, w partycji wg id.
+ */
+static int feed_recent_compare(const void *a, const void *b)
+{
+	const struct feed_recent_match *x = a, *y = b;
+
+	if (x->rm_month != y->rm_month)
+		return x->rm_month - y->rm_month;
+
+	return x->rm_entry->fe_id - y->rm_entry->fe_id;
+}
+
+/*
+ * Odpowiada na zapytanie z pierścienia; NULL, gdy zapytanie wymaga bazy.
+ * Zwrócone wiadomości należą do pierścienia i pozostają ważne do jego
+ * najbliższej zmiany.
+ */
+static array_t *feed_recent_query(storage_handle_t *handle, feed_query_t *query, arena_t *arena)
+{
+	struct feed_recent_match *matches;
+	time_t from = time(NULL) - UNIX_DAY;
+	feed_entry_t *entry;
+	array_t *ret;
+	int i, count = 0;
+
+	if (query->fq_mask || query->fq_match)
+		return NULL;
+
+	if (feed_recent.fr_loaded && feed_recent.fr_version != storage_data_version(handle))
+		feed_recent_invalidate();
+
+	if (!feed_recent.fr_loaded)
+		feed_recent_load(handle);
+
+	if (!feed_recent.fr_loaded || from < feed_recent.fr_floor)
+		return NULL;
+
+	matches = arena_alloc(arena, (feed_recent.fr_count + 1) * sizeof(*matches));
+
+	for (i = 0; i < feed_recent.fr_count; i++) {
+		entry = *feed_recent_slot(i);
+
+		if (entry->fe_pubdate < from)
+			continue;
+
+		matches[count].rm_entry = entry;
+		matches[count++].rm_month = feed_recent.fr_months[(feed_recent.fr_first + i) % FEED_RECENT_SIZE];
+	}
+
+	qsort(matches, count, sizeof(*matches), feed_recent_compare);
+	ret = array_init_arena(arena, 0);
+
+	for (i = 0; i < count; i++)
+		array_append(ret, matches[i].rm_entry);
+
+	return ret;
+}
+
+/*
+ * Wiąże zakodowaną wartość kolumny jako BLOB, a niezakodowaną jako tekst.
+ */
+static void feed_bind(storage_stmt_t *stmt, int column, const void *encoded, int len, const char *text)
+{
+	if (encoded)
+		sqlite3_bind_blob(stmt, column, encoded, len, SQLITE_STATIC);
+	else if (text)
+		sqlite3_bind_text(stmt, column, text, -1, SQLITE_STATIC);
+	else
+		sqlite3_bind_null(stmt, column);
+}
+
+/*
+ * Zapisuje wiadomość we właściwej partycji. Przy dictionary >= 0 opis
+ * i adres są kodowane (storage_encode_text(), storage_encode_url()).
+ */
+int feed_entry_persist(storage_handle_t *handle, feed_entry_t *entry, int dictionary)
+{
+	int id, ret, url_len = 0, description_len = 0;
+	void *url = NULL, *description = NULL;
+	char *sql, partition[STORAGE_PARTITION_NAME_MAX], previous[STORAGE_PARTITION_NAME_MAX];
+	const char *name;
+	storage_stmt_t *stmt;
+
+	/* Do bazy trafia wyłącznie poprawny UTF-8. */
+	if (entry->fe_title) entry->fe_title = utf8_repair(entry->fe_arena, entry->fe_title);
+	if (entry->fe_url) entry->fe_url = utf8_repair(entry->fe_arena, entry->fe_url);
+	if (entry->fe_description) entry->fe_description = utf8_repair(entry->fe_arena, entry->fe_description);
+
+	if (!(name = storage_partition(handle, entry->fe_pubdate)))
+		return FALSE;
+
+	strcpy(partition, name);
+
+	/*
+	 * Usunięcie poprzedniej wersji, numer i oba wiersze zapisujemy razem:
+	 * przy błędzie nie zostaje osierocony opis ani zużyty numer.
+	 */
+	sqlite3_exec(handle->sh_db, "SAVEPOINT entry", NULL, NULL, NULL);
+
+	/*
+	 * Tytuł jest unikalny w całym archiwum; REPLACE w partycji nie usunie
+	 * wiadomości o tym samym tytule z innego miesiąca, więc robimy to sami.
+	 */
+	sql = sqlite3_mprintf("SELECT pubdate FROM posts WHERE title = %Q", entry->fe_title);
+	stmt = storage_query(handle, sql);
+	sqlite3_free(sql);
+
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		storage_partition_name(sqlite3_column_int64(stmt, 0), previous);
+		storage_finalize(stmt);
+
+		if (strcmp(previous, partition)) {
+			sql = sqlite3_mprintf("DELETE FROM %s WHERE title = %Q", previous, entry->fe_title);
+			sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL);
+			sqlite3_free(sql);
+		}
+	} else {
+		storage_finalize(stmt);
+	}
+
+	if (dictionary >= 0 && entry->fe_url)
+		url = storage_encode_url(handle, entry->fe_url, &url_len);
+
+	if (dictionary >= 0 && entry->fe_description)
+		description = storage_encode_text(handle, dictionary, entry->fe_description, &description_len);
+
+	/* Opis musi już być w bazie, gdy wyzwalacz partycji doda wiadomość do indeksu FTS5. */
+	if (!(id = storage_next_id(handle))) {
+		ret = SQLITE_ERROR;
+	} else {
+		sql = sqlite3_mprintf("INSERT INTO %s_body (id, description) VALUES (%d, ?)", partition, id);
+		stmt = storage_query(handle, sql);
+		feed_bind(stmt, 1, description, description_len, entry->fe_description);
+		ret = storage_step(stmt, NULL);
+		storage_finalize(stmt);
+		sqlite3_free(sql);
+	}
+
+	sql = sqlite3_mprintf(
+		"INSERT OR REPLACE INTO %s (id, feed, pubdate, title, url, guid) "
+		"VALUES (%d, %Q, %lld, %Q, ?, %Q);",
+		partition,
+		id,
 		entry->fe_feed,
-		entry->fe_pubdate,
+		(long long)entry->fe_pubdate,
 		entry->fe_title,
-		entry->fe_url,
-		entry->fe_description
+		entry->fe_guid
 	);
 	
-	storage_stmt_t *stmt = storage_query(handle, sql);
-	
-	if ((ret = storage_step(stmt, NULL)) != SQLITE_DONE) {
+	if (ret == SQLITE_DONE) {
+		stmt = storage_query(handle, sql);
+		feed_bind(stmt, 1, url, url_len, entry->fe_url);
+		ret = storage_step(stmt, NULL);
+		storage_finalize(stmt);
+	}
+
+	sqlite3_free(sql);
+	free(url);
+	free(description);
+
+	if (ret != SQLITE_DONE) {
 		FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+		sqlite3_exec(handle->sh_db, "ROLLBACK TO entry; RELEASE entry", NULL, NULL, NULL);
 		return FALSE;
 	}
-	
-	storage_finalize(stmt);
-	sqlite3_free(sql);
+
+	sqlite3_exec(handle->sh_db, "RELEASE entry", NULL, NULL, NULL);
+	entry->fe_id = id;
+	feed_recent_add(entry, TRUE);
 	return TRUE;
 }
 
+/*
+ * Przestrzenie nazw elementów, które rozpoznajemy w kanałach.
+ */
+enum {
+	FEED_NS_NONE,
+	FEED_NS_ATOM,
+	FEED_NS_RSS1,
+	FEED_NS_RDF,
+	FEED_NS_DC,
+	FEED_NS_CONTENT,
+	FEED_NS_OTHER
+};
+
+enum {
+	FEED_FORMAT_UNKNOWN,
+	FEED_FORMAT_RSS,
+	FEED_FORMAT_ATOM,
+	FEED_FORMAT_RDF
+};
+
+static const struct {
+	const char	*href;
+	int		id;
+} feed_namespaces[] = {
+	{ "http://www.w3.org/2005/Atom", FEED_NS_ATOM },
+	{ "http://purl.org/rss/1.0/", FEED_NS_RSS1 },
+	{ "http://www.w3.org/1999/02/22-rdf-syntax-ns#", FEED_NS_RDF },
+	{ "http://purl.org/dc/elements/1.1/", FEED_NS_DC },
+	{ "http://purl.org/rss/1.0/modules/content/", FEED_NS_CONTENT }
+};
+
+void	feed_on_title(feed_entry_t *, xmlNode *);
+void	feed_on_link(feed_entry_t *, xmlNode *);
+void	feed_on_atom_link(feed_entry_t *, xmlNode *);
+void	feed_on_description(feed_entry_t *, xmlNode *);
+void	feed_on_content(feed_entry_t *, xmlNode *);
+void	feed_on_date(feed_entry_t *, xmlNode *);
+void	feed_on_updated(feed_entry_t *, xmlNode *);
+void	feed_on_guid(feed_entry_t *, xmlNode *);
+
+/*
+ * Idealna funkcja mieszająca dla elementów z feed_elements: różna pozycja
+ * dla każdej pary (przestrzeń nazw, nazwa). Po zmianie tablicy trzeba
+ * dobrać nowe współczynniki, tak by pozycje się nie powtarzały.
+ */
+#define	FEED_ELEMENT_SLOTS	32
+#define	FEED_ELEMENT_HASH(ns, name, len) \
+	(((ns) * 2 + (len) * 6 + (name)[0] + (name)[(len) - 1] * 6) & (FEED_ELEMENT_SLOTS - 1))
+
+static const struct {
+	int		ns;
+	const char	*name;
+	void		(*handler)(feed_entry_t *, xmlNode *);
+} feed_elements[FEED_ELEMENT_SLOTS] = {
+	[0] = { FEED_NS_ATOM, "published", feed_on_date },
+	[2] = { FEED_NS_DC, "date", feed_on_date },
+	[6] = { FEED_NS_NONE, "link", feed_on_link },
+	[7] = { FEED_NS_ATOM, "content", feed_on_content },
+	[8] = { FEED_NS_ATOM, "link", feed_on_atom_link },
+	[10] = { FEED_NS_RSS1, "link", feed_on_link },
+	[15] = { FEED_NS_ATOM, "id", feed_on_guid },
+	[16] = { FEED_NS_NONE, "title", feed_on_title },
+	[17] = { FEED_NS_CONTENT, "encoded", feed_on_content },
+	[18] = { FEED_NS_ATOM, "title", feed_on_title },
+	[20] = { FEED_NS_RSS1, "title", feed_on_title },
+	[21] = { FEED_NS_ATOM, "summary", feed_on_description },
+	[23] = { FEED_NS_NONE, "guid", feed_on_guid },
+	[24] = { FEED_NS_NONE, "pubDate", feed_on_date },
+	[25] = { FEED_NS_ATOM, "updated", feed_on_updated },
+	[26] = { FEED_NS_NONE, "description", feed_on_description },
+	[30] = { FEED_NS_RSS1, "description", feed_on_description }
+};
+
+int feed_namespace_id(const char *href)
+{
+	int i;
+
+	if (!href)
+		return FEED_NS_NONE;
+
+	for (i = 0; i < N(feed_namespaces); i++) {
+		if (!strcmp(href, feed_namespaces[i].href))
+			return feed_namespaces[i].id;
+	}
+
+	return FEED_NS_OTHER;
+}
+
+/*
+ * Przestrzeń nazw elementu. Wynik nie jest zapamiętywany między
+ * wywołaniami: zwolnione xmlNs innego dokumentu (albo węzła czytnika)
+ * mogą wrócić pod tym samym adresem, a lista przestrzeni jest krótka.
+ */
+int feed_namespace(xmlNode *node)
+{
+	if (!node->ns || !node->ns->href)
+		return FEED_NS_NONE;
+
+	return feed_namespace_id((char *)node->ns->href);
+}
+
+/*
+ * Zawartość tekstowa węzłów (jak xmlNodeGetContent()), kopiowana od razu
+ * do areny wiadomości zamiast na stertę.
+ */
+static size_t feed_text_length(xmlNode *node)
+{
+	size_t len = 0;
+
+	for (; node; node = node->next) {
+		if (node->type == XML_TEXT_NODE || node->type == XML_CDATA_SECTION_NODE)
+			len += strlen((char *)node->content);
+		else if (node->type == XML_ELEMENT_NODE)
+			len += feed_text_length(node->children);
+	}
+
+	return len;
+}
+
+static char *feed_text_copy(xmlNode *node, char *out)
+{
+	for (; node; node = node->next) {
+		if (node->type == XML_TEXT_NODE || node->type == XML_CDATA_SECTION_NODE) {
+			size_t len = strlen((char *)node->content);
+			memcpy(out, node->content, len);
+			out += len;
+		} else if (node->type == XML_ELEMENT_NODE) {
+			out = feed_text_copy(node->children, out);
+		}
+	}
+
+	return out;
+}
+
+static char *feed_text(feed_entry_t *entry, xmlNode *children)
+{
+	char *ret = arena_alloc(entry->fe_arena, feed_text_length(children) + 1);
+	*feed_text_copy(children, ret) = '\0';
+	return ret;
+}
+
+void feed_on_title(feed_entry_t *entry, xmlNode *node)
+{
+	entry->fe_title = feed_text(entry, node->children);
+}
+
+void feed_on_link(feed_entry_t *entry, xmlNode *node)
+{
+	entry->fe_url = feed_text(entry, node->children);
+}
+
+void feed_on_atom_link(feed_entry_t *entry, xmlNode *node)
+{
+	xmlAttr *rel = xmlHasProp(node, (xmlChar *)"rel"), *href = xmlHasProp(node, (xmlChar *)"href");
+
+	if (href && (!rel || !strcmp(feed_text(entry, rel->children), "alternate")))
+		entry->fe_url = feed_text(entry, href->children);
+}
+
+void feed_on_description(feed_entry_t *entry, xmlNode *node)
+{
+	entry->fe_description = strip_html(feed_text(entry, node->children));
+}
+
+void feed_on_content(feed_entry_t *entry, xmlNode *node)
+{
+	/* Pełna treść zastępuje opis tylko wtedy, gdy kanał nie podał streszczenia. */
+	if (!entry->fe_description)
+		entry->fe_description = strip_html(feed_text(entry, node->children));
+}
+
+void feed_on_date(feed_entry_t *entry, xmlNode *node)
+{
+	/* Nierozpoznana data zostaje zerem; feed_download() wstawi czas pobrania. */
+	if (!parse_date(feed_text(entry, node->children), &entry->fe_pubdate))
+		entry->fe_pubdate = 0;
+}
+
+void feed_on_updated(feed_entry_t *entry, xmlNode *node)
+{
+	if (!entry->fe_pubdate)
+		feed_on_date(entry, node);
+}
+
+void feed_on_guid(feed_entry_t *entry, xmlNode *node)
+{
+	entry->fe_guid = feed_text(entry, node->children);
+}
+
+/*
+ * Wypełnia wiadomość przydzieloną z areny (entry->fe_arena) treścią
+ * elementu item/entry.
+ */
 int feed_process(feed_entry_t *entry, xmlNode *node)
 {
-	char *pubdate_str;
-	struct tm pubdate;
+	int len, slot, ns;
+	const char *name;
 	xmlNode *ptr;
 	
-	if (strcmp((char *)node->name, "item")) {
-		errno = EINVAL;
-		return FALSE;
+	for (ptr = node->children; ptr; ptr = ptr->next) {
+		if (ptr->type != XML_ELEMENT_NODE)
+			continue;
+
+		name = (const char *)ptr->name;
+		len = strlen(name);
+		ns = feed_namespace(ptr);
+		slot = FEED_ELEMENT_HASH(ns, name, len);
+
+		if (feed_elements[slot].handler && feed_elements[slot].ns == ns && !strcmp(feed_elements[slot].name, name))
+			feed_elements[slot].handler(entry, ptr);
 	}
+
+	/* Klucz wiadomości: guid/id, a w razie jego braku adres lub tytuł. */
+	if (!entry->fe_guid && (entry->fe_url || entry->fe_title))
+		entry->fe_guid = entry->fe_url ? entry->fe_url : entry->fe_title;
 	
-	for (ptr = node->children; ptr; ptr = ptr->next) {
-		if (!strcmp((char *)ptr->name, "pubDate")) {
-			pubdate_str = (char *)xmlNodeGetContent(ptr);
-		    	entry->fe_pubdate = (!strptime(pubdate_str, "%a, %d %b %Y %T", &pubdate))
-		    	    ? time(NULL)
-		    	    : mktime(&pubdate);
-		
-			free(pubdate_str);
-		}
-		
-		if (!strcmp((char *)ptr->name, "title")) entry->fe_title = (char *)xmlNodeGetContent(ptr);
-		if (!strcmp((char *)ptr->name, "link")) entry->fe_url = (char *)xmlNodeGetContent(ptr);
-		if (!strcmp((char *)ptr->name, "description")) { 
-			char *description = strip_html((char *)xmlNodeGetContent(ptr));
-			entry->fe_description = description;
+	return TRUE;
+}
+
+/*
+ * Rozpoznaje format kanału po elemencie głównym: rss (RSS 0.9x i 2.0),
+ * feed (Atom) lub rdf:RDF (RSS 1.0).
+ */
+int feed_detect_format(const char *name, int ns)
+{
+	if (ns == FEED_NS_NONE && !strcmp(name, "rss"))
+		return FEED_FORMAT_RSS;
+
+	if (ns == FEED_NS_ATOM && !strcmp(name, "feed"))
+		return FEED_FORMAT_ATOM;
+
+	if (ns == FEED_NS_RDF && !strcmp(name, "RDF"))
+		return FEED_FORMAT_RDF;
+
+	return FEED_FORMAT_UNKNOWN;
+}
+
+/*
+ * Czy bieżący element to wiadomość: rss/channel/item, feed/entry lub
+ * rdf:RDF/item (w RSS 1.0 wiadomości leżą poza elementem channel).
+ */
+int feed_is_item(xmlTextReaderPtr reader, int format)
+{
+	int depth = xmlTextReaderDepth(reader);
+	const char *name = (const char *)xmlTextReaderConstLocalName(reader);
+	int ns = feed_namespace_id((const char *)xmlTextReaderConstNamespaceUri(reader));
+
+	switch (format) {
+		case FEED_FORMAT_RSS:
+			return depth == 2 && ns == FEED_NS_NONE && !strcmp(name, "item");
+
+		case FEED_FORMAT_ATOM:
+			return depth == 1 && ns == FEED_NS_ATOM && !strcmp(name, "entry");
+
+		case FEED_FORMAT_RDF:
+			return depth == 1 && ns == FEED_NS_RSS1 && !strcmp(name, "item");
+	}
+
+	return FALSE;
+}
+
+/*
+ * Liczba wiadomości w dokumencie, liczona po samych znacznikach, bez parsowania.
+ */
+int feed_count_items(const char *text, int format)
+{
+	int ret = 0;
+	const char *tag = (format == FEED_FORMAT_ATOM) ? "<entry" : "<item";
+	size_t len = strlen(tag);
+
+	while ((text = strstr(text, tag))) {
+		text += len;
+		if (*text == '>' || *text == ' ' || *text == '\t' || *text == '\n' || *text == '\r')
+			ret++;
+	}
+
+	return ret;
+}
+
+static int feed_compare_key(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Klucze (guid) ostatnio zapisanych wiadomości źródła. Kanały zwykle
+ * podają wiadomości od najnowszych, więc te klucze wystarczają, by
+ * rozpoznać moment, od którego dalsza część kanału jest już znana.
+ * Wczytujemy je raz na pobranie i sortujemy, by każdą wiadomość kanału
+ * sprawdzać przez bsearch() zamiast liniowo.
+ */
+static char **feed_recent_keys(storage_handle_t *handle, feed_t *feed, arena_t *arena, int *count)
+{
+	char **ret = arena_alloc(arena, FEED_RECENT_KEYS * sizeof(char *));
+	char *sql = sqlite3_mprintf(
+		"SELECT guid FROM posts WHERE feed = %Q AND guid IS NOT NULL ORDER BY id DESC LIMIT %d",
+		feed->f_name, FEED_RECENT_KEYS);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+	int i, n = 0;
+
+	while (n < FEED_RECENT_KEYS && sqlite3_step(stmt) == SQLITE_ROW)
+		ret[n++] = arena_strdup(arena, (const char *)sqlite3_column_text(stmt, 0));
+
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+	qsort(ret, n, sizeof(char *), feed_compare_key);
+
+	for (*count = 0, i = 0; i < n; i++)
+		if (!*count || strcmp(ret[*count - 1], ret[i]))
+			ret[(*count)++] = ret[i];
+
+	return ret;
+}
+
+/*
+ * Odtwarza filtr Blooma ze wszystkich kluczy zapisanych wiadomości źródła.
+ * Filtr ma zapas na dwukrotnie więcej kluczy, niż jest ich obecnie.
+ */
+bloom_t *feed_bloom_rebuild(storage_handle_t *handle, feed_t *feed, int count)
+{
+	bloom_t *bloom = bloom_init(count * 2 > FEED_BLOOM_MIN_KEYS ? count * 2 : FEED_BLOOM_MIN_KEYS, FEED_BLOOM_FP_RATE);
+	char *sql = sqlite3_mprintf("SELECT guid FROM posts WHERE feed = %Q AND guid IS NOT NULL", feed->f_name);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		bloom_add(bloom, (const char *)sqlite3_column_text(stmt, 0));
+
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+	return bloom;
+}
+
+/*
+ * Wczytuje zapisany filtr źródła; jeśli go brak, jest uszkodzony albo
+ * przekroczył pojemność (rośnie odsetek fałszywych trafień), budujemy nowy.
+ */
+bloom_t *feed_bloom_load(storage_handle_t *handle, feed_t *feed, int *rebuilt)
+{
+	bloom_t *bloom = NULL;
+	int count = 0;
+	char *sql = sqlite3_mprintf(
+		"SELECT bloom, total FROM feeds WHERE name = %Q", feed->f_name);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		bloom = bloom_load(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
+		count = sqlite3_column_int(stmt, 1);
+	}
+
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+
+	if (bloom && bloom->b_count >= count && bloom->b_count <= bloom_capacity(bloom, FEED_BLOOM_FP_RATE)) {
+		*rebuilt = FALSE;
+		return bloom;
+	}
+
+	bloom_free(bloom);
+	*rebuilt = TRUE;
+	return feed_bloom_rebuild(handle, feed, count);
+}
+
+void feed_bloom_save(storage_handle_t *handle, feed_t *feed, bloom_t *bloom)
+{
+	int nbytes;
+	void *data = bloom_save(bloom, &nbytes);
+	char *sql = sqlite3_mprintf("UPDATE feeds SET bloom = ? WHERE name = %Q", feed->f_name);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+
+	sqlite3_bind_blob(stmt, 1, data, nbytes, SQLITE_STATIC);
+	storage_step(stmt, NULL);
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+	free(data);
+}
+
+/*
+ * Sprawdza w bazie (indeks posts_feed_guid), czy wiadomość o danym kluczu
+ * została już zapisana. Wołane tylko, gdy filtr Blooma zgłosi trafienie.
+ */
+int feed_entry_exists(storage_handle_t *handle, feed_entry_t *entry)
+{
+	int ret;
+	char *sql = sqlite3_mprintf(
+		"SELECT 1 FROM posts WHERE feed = %Q AND guid = %Q LIMIT 1",
+		entry->fe_feed, entry->fe_guid);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+
+	ret = sqlite3_step(stmt) == SQLITE_ROW;
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+	return ret;
+}
+
+void feed_save(storage_handle_t *handle, feed_t *feed)
+{
+	char *sql = sqlite3_mprintf(
+		"INSERT INTO feeds (name, url, description, updated, redirects) "
+		"VALUES (%Q, %Q, %Q, %lld, %d) "
+		"ON CONFLICT (name) DO UPDATE SET url = excluded.url, "
+		"description = excluded.description, updated = excluded.updated, "
+		"redirects = excluded.redirects",
+		feed->f_name,
+		feed->f_url,
+		feed->f_description,
+		(long long)feed->f_last_update,
+		feed->f_redirects
+	);
+	
+	storage_stmt_t *stmt = storage_query(handle, sql);
+	storage_step(stmt, NULL);
+	config_feed_saved(handle, feed);
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+}
+
+void feed_remove(storage_handle_t *handle, feed_t *feed)
+{
+	array_t *partitions = storage_partitions(handle, 0, FEED_TIME_MAX, NULL);
+	char *sql, *partition;
+	storage_stmt_t *stmt;
+	int i;
+
+	feed_recent_invalidate();
+	sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		sql = sqlite3_mprintf("DELETE FROM %s WHERE feed = %Q", partition, feed->f_name);
+		stmt = storage_query(handle, sql);
+		storage_step(stmt, NULL);
+		storage_finalize(stmt);
+		sqlite3_free(sql);
+	}
+
+	sql = sqlite3_mprintf("DELETE FROM dictionaries WHERE feed = %Q", feed->f_name);
+	sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL);
+	sqlite3_free(sql);
+
+	sql = sqlite3_mprintf("DELETE FROM feeds WHERE name = %Q", feed->f_name);
+	stmt = storage_query(handle, sql);
+	storage_step(stmt, NULL);
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+
+	storage_prune_prefixes(handle);
+	sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+	array_free(partitions, TRUE, FALSE);
+	config_feed_removed(handle, feed->f_name);
+}
+
+/*
+ * Zwraca limit czasu (zmienna w sekundach) w milisekundach; 0 oznacza brak
+ * limitu, a nieustawiona lub nieczytelna zmienna - wartość domyślną.
+ */
+int feed_get_timeout(storage_handle_t *handle, const char *name, int fallback)
+{
+	char *end, *value = config_get(handle, name);
+	double seconds = strtod(value, &end);
+	int ret = (end == value || seconds < 0) ? fallback : (int)(seconds * 1000);
+
+	free(value);
+	return ret;
+}
+
+/*
+ * Ustala kodowanie treści kanału: zmienna charset (wymuszenie), znacznik
+ * BOM, parametr charset nagłówka Content-Type, deklaracja XML. Kodowanie
+ * niepodane albo UTF-8 sprawdzamy; niepoprawny UTF-8 traktujemy jako
+ * fallback_charset (u nas zwykle windows-1250 albo ISO-8859-2).
+ */
+char *feed_detect_charset(storage_handle_t *handle, feed_t *feed, http_response_t *response)
+{
+	char *charset = config_get_feed(handle, feed->f_name, "charset");
+	const char *body = response->hs_body;
+
+	if (*charset && strcmp(charset, "<brak>"))
+		return charset;
+
+	free(charset);
+
+	if (!strncmp(body, "\xef\xbb\xbf", 3))
+		return xstrdup("UTF-8");
+
+	if ((charset = charset_from_content_type(http_get_header(response, "Content-Type"))))
+		return charset;
+
+	return charset_from_xml(body);
+}
+
+/*
+ * Sprowadza treść odpowiedzi do UTF-8 przed parsowaniem; parser dostaje
+ * potem zawsze kodowanie "UTF-8", niezależnie od deklaracji w dokumencie.
+ */
+void feed_transcode(storage_handle_t *handle, feed_t *feed, http_response_t *response)
+{
+	char *charset = feed_detect_charset(handle, feed, response), *body;
+	size_t length = strlen(response->hs_body);
+
+	if (!charset || !strcasecmp(charset, "UTF-8") || !strcasecmp(charset, "UTF8") || !strcasecmp(charset, "US-ASCII")) {
+		if (utf8_validate(response->hs_body, response->hs_body + length) == response->hs_body + length) {
+			free(charset);
+			return;
 		}
+
+		free(charset);
+		charset = config_get_feed(handle, feed->f_name, "fallback_charset");
+		xprintf("Treść źródła %s nie jest poprawnym UTF-8; przyjęto kodowanie %s.\n", feed->f_name, charset);
 	}
-	
-	return TRUE;
+
+	if (!(body = charset_to_utf8(charset, response->hs_body, length))) {
+		FAIL("Nieznane kodowanie \"%s\" źródła %s.\n", charset, feed->f_name);
+		free(charset);
+		return;
+	}
+
+	free(response->hs_body);
+	response->hs_body = body;
+	free(charset);
 }
 
-void feed_save(storage_handle_t *handle, feed_t *feed)
+/*
+ * Uczy nowy słownik na ostatnich opisach źródła i zapisuje go w bazie.
+ * Zwraca id słownika albo 0, gdy opisów jest za mało.
+ */
+int feed_dictionary_train(storage_handle_t *handle, feed_t *feed)
 {
-	char *sql = sqlite3_mprintf(
-		"INSERT OR REPLACE INTO feeds VALUES (%Q, %Q, %Q, %q)",
-		feed->f_name,
-		feed->f_url,
-		feed->f_description,
-		feed->f_last_update
-	);
-	
-	storage_stmt_t *stmt = storage_query(handle, sql);
-	storage_step(stmt, NULL);
-	storage_finalize(stmt);
-	sqlite3_free(sql);
+	const char **samples = xmalloc(FEED_DICTIONARY_SAMPLES * sizeof(char *));
+	array_t *partitions = storage_partitions(handle, 0, FEED_TIME_MAX, NULL);
+	int i, count = 0, ret = 0;
+	size_t size;
+	void *data;
+	storage_stmt_t *stmt;
+	char *sql;
+
+	/* Partycje od najnowszej, aż zbierzemy dość próbek. */
+	for (i = array_count(partitions) - 1; i >= 0 && count < FEED_DICTIONARY_SAMPLES; i--) {
+		sql = sqlite3_mprintf(
+			"SELECT rss_inflate(b.description) FROM %s AS p JOIN %s_body AS b ON b.id = p.id "
+			"WHERE p.feed = %Q AND b.description IS NOT NULL ORDER BY p.id DESC LIMIT %d",
+			array_get(partitions, i), array_get(partitions, i), feed->f_name,
+			FEED_DICTIONARY_SAMPLES - count);
+		stmt = storage_query(handle, sql);
+		sqlite3_free(sql);
+
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+			samples[count++] = xstrdup((const char *)sqlite3_column_text(stmt, 0));
+
+		storage_finalize(stmt);
+	}
+
+	array_free(partitions, TRUE, FALSE);
+
+	if (count >= FEED_DICTIONARY_MIN_SAMPLES && (data = dict_train(samples, count, STORAGE_DICTIONARY_MAX, &size))) {
+		sql = sqlite3_mprintf("INSERT INTO dictionaries (feed, created, data) VALUES (%Q, %lld, ?)",
+		    feed->f_name, (long long)time(NULL));
+		stmt = storage_query(handle, sql);
+		sqlite3_bind_blob(stmt, 1, data, size, SQLITE_STATIC);
+
+		if (storage_step(stmt, NULL) == SQLITE_DONE)
+			ret = sqlite3_last_insert_rowid(handle->sh_db);
+
+		storage_finalize(stmt);
+		sqlite3_free(sql);
+		free(data);
+	}
+
+	while (count)
+		free((void *)samples[--count]);
+
+	free(samples);
+	return ret;
 }
 
-void feed_remove(storage_handle_t *handle, feed_t *feed)
+/*
+ * Zwraca id słownika, którym kodujemy nowe opisy źródła: -1, gdy kompresja
+ * jest wyłączona, 0 - kompresja bez słownika (źródło ma za mało opisów).
+ */
+int feed_dictionary(storage_handle_t *handle, feed_t *feed)
 {
-	char *sql = sqlite3_mprintf("DELETE FROM posts WHERE feed = %Q", feed->f_name);
-	storage_stmt_t *stmt = storage_query(handle, sql);
-	storage_step(stmt, NULL);
-	storage_finalize(stmt);
-	sqlite3_free(sql);
+	char *compress = config_get_feed(handle, feed->f_name, "compress"), *sql;
+	storage_stmt_t *stmt;
+	int ret = -1;
 
-	sql = sqlite3_mprintf("DELETE FROM feeds WHERE name = %Q", feed->f_name);
-	stmt = storage_query(handle, sql);
-	storage_step(stmt, NULL);
-	storage_finalize(stmt);
-	sqlite3_free(sql);
+	if (compress && !strcmp(compress, "on")) {
+		sql = sqlite3_mprintf("SELECT MAX(id) FROM dictionaries WHERE feed = %Q", feed->f_name);
+		stmt = storage_query(handle, sql);
+		ret = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+		storage_finalize(stmt);
+		sqlite3_free(sql);
+
+		if (!ret && feed->f_total >= FEED_DICTIONARY_MIN_SAMPLES)
+			ret = feed_dictionary_train(handle, feed);
+	}
+
+	free(compress);
+	return ret;
 }
 
 void feed_download(storage_handle_t *handle, feed_t *feed)
 {
-	int done = 0;
+	int done = 0, undated = 0;
+	time_t fetched = time(NULL);
+	char *show_timings, *tls_verify;
 	hash_t *headers = hash_init();
 	http_request_t *request;
 	http_response_t *response;
-	xmlDoc *document;
-	xmlNode *root, *ptr, *ptr0;
+	xmlTextReaderPtr reader;
+	xmlNode *node;
+	feed_entry_t *entry;
+	char **recent;
+	int status, format = FEED_FORMAT_UNKNOWN, early_exit;
+	int known = 0, consecutive = 0, processed = 0, skipped_items = 0;
+	int seen, lookups = 0, false_positives = 0, rebuilt, dictionary, fetched_ok, recent_count;
+	storage_codec_stats_t codec = *storage_codec_stats();
+	long length, skipped_bytes = 0;
+	bloom_t *bloom;
+	char *show_stats;
+	static arena_t *arena = NULL;
 	
 	hash_set(headers, xstrdup("User-Agent"), xstrdup("rss/0.0.2"), FALSE);
 
@@ -153,119 +991,686 @@ void feed_download(storage_handle_t *handle, feed_t *feed)
 		return;
 	}
 	
+	request->hr_name = xstrdup(feed->f_name);
+	request->hr_connect_timeout = feed_get_timeout(handle, "connect_timeout", HTTP_DEFAULT_CONNECT_TIMEOUT);
+	request->hr_first_byte_timeout = feed_get_timeout(handle, "first_byte_timeout", HTTP_DEFAULT_FIRST_BYTE_TIMEOUT);
+	request->hr_transfer_timeout = feed_get_timeout(handle, "transfer_timeout", HTTP_DEFAULT_TRANSFER_TIMEOUT);
+	request->hr_tls_verify = strcmp(tls_verify = config_get(handle, "tls_verify"), "off");
+	request->hr_tls_ca_file = config_get(handle, "tls_ca_file");
+	free(tls_verify);
 	response = http_send_request(request);
-	document = xmlReadDoc((uint8_t *)response->hs_body, NULL, "UTF-8", XML_PARSE_NOCDATA);
-	root = xmlDocGetRootElement(document);
-	
-	if (!document) {
-		FAIL("libxml2: dokument pod podanym adresem jest nieprawidłowy.\n");
+
+	fetched_ok = response->hs_status >= 200 && response->hs_status < 300 && response->hs_body;
+
+	if (response->hs_redirects || response->hs_location) {
+		feed->f_redirects += response->hs_redirects;
+
+		/* Nowy adres zapisujemy dopiero, gdy pobranie spod niego się udało. */
+		if (fetched_ok && response->hs_location && strcmp(response->hs_location, feed->f_url)) {
+			xprintf("Źródło %s zostało trwale przeniesione pod adres %s.\n", feed->f_name, response->hs_location);
+			free(feed->f_url);
+			feed->f_url = xstrdup(response->hs_location);
+		}
+
+		feed_save(handle, feed);
+	}
+
+	if (!fetched_ok) {
+		if (response->hs_status)
+			FAIL("Serwer zwrócił kod %d; źródło %s nie zostało zaktualizowane.\n", response->hs_status, feed->f_name);
+
 		http_free_request(request);
 		return;
 	}
-	
-	for (ptr = root->children; ptr; ptr = ptr->next) {
-		if (!strcmp((char *)ptr->name, "channel")) {
-			for (ptr0 = ptr->children; ptr0; ptr0 = ptr0->next) {
-				feed_entry_t *entry = feed_entry_create();
-				entry->fe_feed = xstrdup(feed->f_name);
-
-				if (!feed_process(entry, ptr0)) {
-					DELETE(entry);
-					continue;
-				}
-				
-				if (!feed_entry_persist(handle, entry)) {
-					DELETE(entry);
-					continue;
-				}	
-				
-				DELETE(entry);
-				done++;	
+
+	/*
+	 * Dokument czytamy strumieniowo, wiadomość po wiadomości, aby móc
+	 * przerwać parsowanie po early_exit kolejnych już znanych wiadomościach.
+	 */
+	feed_transcode(handle, feed, response);
+	length = strlen(response->hs_body);
+	/*
+	 * Wszystko, co dotyczy pojedynczych wiadomości (pola, klucze, wiersze
+	 * z bazy), żyje w arenie opróżnianej po przetworzeniu źródła.
+	 */
+	if (!arena)
+		arena = arena_init(FEED_ARENA_SIZE);
+
+	recent = feed_recent_keys(handle, feed, arena, &recent_count);
+	bloom = feed_bloom_load(handle, feed, &rebuilt);
+	early_exit = config_get_feed_int(handle, feed->f_name, "early_exit", FEED_DEFAULT_EARLY_EXIT);
+	sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+	dictionary = feed_dictionary(handle, feed);
+	reader = xmlReaderForMemory(response->hs_body, length, feed->f_url, "UTF-8", XML_PARSE_NOCDATA | XML_PARSE_IGNORE_ENC);
+	status = reader ? xmlTextReaderRead(reader) : -1;
+
+	while (status == 1) {
+		if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+			status = xmlTextReaderRead(reader);
+			continue;
+		}
+
+		if (format == FEED_FORMAT_UNKNOWN) {
+			format = feed_detect_format((const char *)xmlTextReaderConstLocalName(reader),
+			    feed_namespace_id((const char *)xmlTextReaderConstNamespaceUri(reader)));
+
+			if (format == FEED_FORMAT_UNKNOWN) {
+				FAIL("Nieznany format kanału (element główny: %s).\n", xmlTextReaderConstName(reader));
+				break;
 			}
 		}
-	}
+
+		if (!feed_is_item(reader, format)) {
+			status = xmlTextReaderRead(reader);
+			continue;
+		}
+
+		if (!(node = xmlTextReaderExpand(reader))) {
+			status = -1;
+			break;
+		}
+
+		entry = arena_calloc(arena, sizeof(feed_entry_t));
+		entry->fe_arena = arena;
+		entry->fe_feed = feed->f_name;
+		feed_process(entry, node);
+		status = xmlTextReaderNext(reader);
+		processed++;
+
+		/*
+		 * Klucze spoza ostatnio zapisanych sprawdzamy najpierw w filtrze;
+		 * zapytanie do bazy wykonujemy tylko przy (być może fałszywym) trafieniu.
+		 */
+		seen = entry->fe_guid && bsearch(&entry->fe_guid, recent, recent_count, sizeof(char *), feed_compare_key);
+
+		if (!seen && entry->fe_guid && bloom_check(bloom, entry->fe_guid)) {
+			lookups++;
+
+			if (!(seen = feed_entry_exists(handle, entry)))
+				false_positives++;
+		}
+
+		if (seen) {
+			known++;
+
+			if (early_exit && ++consecutive >= early_exit && status == 1) {
+				long consumed = xmlTextReaderByteConsumed(reader);
+				skipped_bytes = length - consumed;
+				skipped_items = feed_count_items(response->hs_body, format) - processed;
+				break;
+			}
+
+			continue;
+		}
+
+		consecutive = 0;
 		
-	xmlFreeDoc(document);	
-	http_free_request(request);
+		if (!entry->fe_pubdate) {
+			entry->fe_pubdate = fetched;
+			undated++;
+		}
+
+		if (feed_entry_persist(handle, entry, dictionary)) {
+			if (entry->fe_guid)
+				bloom_add(bloom, entry->fe_guid);
+
+			done++;
+		}
+	}
+
+	if (status == -1)
+		FAIL("libxml2: dokument pod podanym adresem jest nieprawidłowy.\n");
+
+	if (reader)
+		xmlFreeTextReader(reader);
+
+	if (done || rebuilt)
+		feed_bloom_save(handle, feed, bloom);
+
+	sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
 	printf("Zapisano %d nowych wiadomości ze źródła %s.\n", done, feed->f_name);
+
+	if (skipped_bytes)
+		xprintf("Pominięto %d znanych wiadomości; nie przetworzono pozostałych %d wiadomości (ok. %ld B).\n",
+		    known, skipped_items, skipped_bytes);
+
+	if (undated)
+		xprintf("Nie rozpoznano daty %d wiadomości; przyjęto czas pobrania.\n", undated);
+
+	show_timings = config_get(handle, "show_timings");
+	if (!strcmp(show_timings, "on")) {
+		http_timing_t *timing = &response->hs_timing;
+		xprintf("Czasy: połączenie %ld ms", timing->ht_connect);
+
+		if (request->hr_tls)
+			xprintf(", TLS %ld ms%s", timing->ht_tls, timing->ht_resumed ? " (sesja wznowiona)" : "");
+
+		xprintf(", pierwszy bajt %ld ms, całość %ld ms.\n", timing->ht_first_byte, timing->ht_total);
+	}
+
+	show_stats = config_get(handle, "show_stats");
+	if (!strcmp(show_stats, "on")) {
+		xprintf("Filtr znanych wiadomości%s: %u kluczy, %u B, szac. fałszywe trafienia %.2f%%; "
+		    "zapytań do bazy %d, w tym fałszywych trafień %d.\n",
+		    rebuilt ? " (odbudowany)" : "", bloom->b_count, bloom->b_bits / 8,
+		    bloom_fp_rate(bloom) * 100, lookups, false_positives);
+		xprintf("Pamięć tymczasowa źródła: %zu B w arenie.\n", arena->ar_allocated);
+
+		if (dictionary >= 0)
+			feed_codec_report(&codec, storage_codec_stats());
+	}
+
+	free(show_stats);
+	free(show_timings);
+	bloom_free(bloom);
+	arena_reset(arena);
+	http_free_request(request);
 }
 
-void feed_flush(storage_handle_t *handle, time_t amount)
+/*
+ * Usuwa wiadomości nie nowsze niż podany czas. Partycje, które w całości
+ * mieszczą się w tym przedziale, są usuwane w całości (bez usuwania
+ * kolejnych wierszy); wiersze kasujemy tylko w partycji z granicą.
+ * Wszystko dzieje się w jednej transakcji, wycofywanej przy pierwszym
+ * błędzie, by liczniki w feeds zgadzały się z partycjami. Zwraca FALSE
+ * przy błędzie.
+ */
+int feed_flush(storage_handle_t *handle, time_t amount)
 {
-	char *sql = sqlite3_mprintf("DELETE FROM posts WHERE pubdate <= %u\n", amount);
-	storage_stmt_t *stmt = storage_query(handle, sql);
-	storage_step(stmt, NULL);
+	array_t *partitions = storage_partitions(handle, 0, amount, NULL);
+	char *sql, *partition, boundary[STORAGE_PARTITION_NAME_MAX], next[STORAGE_PARTITION_NAME_MAX];
+	int i, dropped = 0, ret = TRUE;
+
+	feed_recent_invalidate();
+
+	/* Jeśli następna sekunda należy już do kolejnego miesiąca, granicy nie ma. */
+	storage_partition_name(amount, boundary);
+	storage_partition_name(amount + 1, next);
+
+	sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		if (!strcmp(partition, boundary) && !strcmp(partition, next)) {
+			sql = sqlite3_mprintf("DELETE FROM %s WHERE pubdate <= %lld", partition, (long long)amount);
+			ret = sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) == SQLITE_OK;
+			sqlite3_free(sql);
+
+			if (!ret) {
+				FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+				break;
+			}
+
+			continue;
+		}
+
+		/* Usunięcie tabeli nie uruchamia wyzwalaczy, więc liczniki poprawiamy tu. */
+		sql = sqlite3_mprintf(
+			"UPDATE feeds SET total = total - removed.posts, unseen = unseen - removed.fresh "
+			"FROM (SELECT p.feed, COUNT(*) AS posts, "
+			"SUM(p.id > (SELECT f.seen FROM feeds AS f WHERE f.name = p.feed) "
+			"AND NOT EXISTS (SELECT 1 FROM seen_posts AS s WHERE s.id = p.id)) AS fresh "
+			"FROM %s AS p GROUP BY p.feed) AS removed WHERE feeds.name = removed.feed;"
+			"DELETE FROM seen_posts WHERE id IN (SELECT id FROM %s)",
+			partition, partition);
+
+		if (sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+			FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+			ret = FALSE;
+		} else {
+			/* storage_partition_drop() sam zgłasza błąd. */
+			ret = storage_partition_drop(handle, partition);
+			dropped++;
+		}
+
+		sqlite3_free(sql);
+
+		if (!ret)
+			break;
+	}
+
+	if (ret && dropped && sqlite3_exec(handle->sh_db,
+	    "UPDATE feeds SET "
+	    "newest = (SELECT MAX(pubdate) FROM posts WHERE feed = feeds.name), "
+	    "oldest = (SELECT MIN(pubdate) FROM posts WHERE feed = feeds.name)",
+	    NULL, NULL, NULL) != SQLITE_OK) {
+		FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+		ret = FALSE;
+	}
+
+	/* storage_prune_prefixes() sam zgłasza błąd. */
+	if (ret)
+		ret = storage_prune_prefixes(handle);
+
+	sqlite3_exec(handle->sh_db, ret ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL);
+	array_free(partitions, TRUE, FALSE);
+	return ret;
+}
+
+/*
+ * Usuwa najstarsze wiadomości źródła ponad limity max_items (liczba) i
+ * max_age (dni); 0 oznacza brak limitu. Kasujemy partiami po
+ * FEED_RETENTION_BATCH wiadomości, każdą w osobnej transakcji, a partycje,
+ * które przy tym opustoszały, usuwamy. Zwraca liczbę usuniętych wiadomości.
+ */
+int feed_retain(storage_handle_t *handle, feed_t *feed)
+{
+	int max_items = config_get_feed_int(handle, feed->f_name, "max_items", 0);
+	int max_age = config_get_feed_int(handle, feed->f_name, "max_age", 0);
+	time_t cutoff = max_age > 0 ? time(NULL) - (time_t)max_age * UNIX_DAY : 0;
+	int i, excess, batch, changes, removed = 0;
+	array_t *partitions;
+	storage_stmt_t *stmt;
+	char *sql, *partition, *older;
+
+	if (max_items <= 0 && !cutoff)
+		return 0;
+
+	sql = sqlite3_mprintf("SELECT total FROM feeds WHERE name = %Q", feed->f_name);
+	stmt = storage_query(handle, sql);
+	excess = max_items > 0 && sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) - max_items : 0;
 	storage_finalize(stmt);
 	sqlite3_free(sql);
+
+	if (excess <= 0 && !cutoff)
+		return 0;
+
+	older = sqlite3_mprintf(" AND pubdate <= %lld", (long long)cutoff);
+
+	/* Partycje od najstarszej; nadmiar liczby wiadomości usuwamy bez względu na datę. */
+	partitions = storage_partitions(handle, 0, excess > 0 ? FEED_TIME_MAX : cutoff, NULL);
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		do {
+			batch = excess > 0 && excess < FEED_RETENTION_BATCH ? excess : FEED_RETENTION_BATCH;
+			sql = sqlite3_mprintf(
+				"DELETE FROM %s WHERE id IN (SELECT id FROM %s WHERE feed = %Q%s ORDER BY pubdate LIMIT %d)",
+				partition, partition, feed->f_name,
+				excess > 0 ? "" : older, batch);
+
+			sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+			changes = sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) == SQLITE_OK
+			    ? sqlite3_changes(handle->sh_db) : 0;
+			sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+			sqlite3_free(sql);
+
+			removed += changes;
+			excess -= changes;
+		} while (changes == batch && (excess > 0 || cutoff));
+
+		sql = sqlite3_mprintf("SELECT 1 FROM %s LIMIT 1", partition);
+		stmt = storage_query(handle, sql);
+		changes = sqlite3_step(stmt) == SQLITE_ROW;
+		storage_finalize(stmt);
+		sqlite3_free(sql);
+
+		if (!changes)
+			storage_partition_drop(handle, partition);
+
+		if (excess <= 0 && !cutoff)
+			break;
+	}
+
+	array_free(partitions, TRUE, FALSE);
+	sqlite3_free(older);
+
+	if (removed)
+		feed_recent_invalidate();
+
+	return removed;
 }
 
-array_t *feed_get_entries(storage_handle_t *handle, feed_query_t *query)
+/*
+ * Wypisuje, ile zajęły opisy i adresy zakodowane między dwoma odczytami
+ * statystyk kodowania.
+ */
+void feed_codec_report(const storage_codec_stats_t *before, const storage_codec_stats_t *after)
 {
-	array_t *ret;
+	size_t text = after->cs_text_bytes - before->cs_text_bytes;
+	size_t encoded = after->cs_encoded_bytes - before->cs_encoded_bytes;
+	size_t url = after->cs_url_bytes - before->cs_url_bytes;
+	size_t url_encoded = after->cs_url_encoded_bytes - before->cs_url_encoded_bytes;
+
+	if (!text && !url)
+		return;
+
+	xprintf("Kompresja: opisy %zu B -> %zu B (%.1f%%), adresy %zu B -> %zu B (%.1f%%); "
+	    "skompresowano %lu opisów.\n",
+	    text, encoded, text ? encoded * 100.0 / text : 100.0,
+	    url, url_encoded, url ? url_encoded * 100.0 / url : 100.0,
+	    after->cs_encoded - before->cs_encoded);
+}
+
+/*
+ * Przepisuje opisy i adresy wszystkich wiadomości źródła zgodnie z bieżącą
+ * wartością zmiennej compress: uczy nowy słownik i koduje nim opisy albo
+ * zapisuje je bez kompresji. Partycje przepisujemy partiami, każdą
+ * w osobnej transakcji; na koniec usuwamy nieużywane już słowniki.
+ */
+int feed_compress(storage_handle_t *handle, feed_t *feed)
+{
+	array_t *partitions = storage_partitions(handle, 0, FEED_TIME_MAX, NULL);
+	storage_codec_stats_t codec = *storage_codec_stats();
+	char *sql, *partition, *compress = config_get_feed(handle, feed->f_name, "compress");
+	int i, id, last, count, rows = 0, dictionary = -1, url_len, description_len;
+	void *url, *description;
+	storage_stmt_t *stmt, *update, *update_body;
+
+	if (compress && !strcmp(compress, "on")) {
+		sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+		dictionary = feed_dictionary_train(handle, feed);
+		sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+	}
+
+	free(compress);
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		last = 0;
+
+		do {
+			sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL);
+			sql = sqlite3_mprintf(
+				"SELECT p.id, rss_inflate(p.url), rss_inflate(b.description) "
+				"FROM %s AS p LEFT JOIN %s_body AS b ON b.id = p.id "
+				"WHERE p.feed = %Q AND p.id > %d ORDER BY p.id LIMIT %d",
+				partition, partition, feed->f_name, last, FEED_RETENTION_BATCH);
+			stmt = storage_query(handle, sql);
+			sqlite3_free(sql);
+
+			sql = sqlite3_mprintf("UPDATE %s SET url = ? WHERE id = ?", partition);
+			update = storage_query(handle, sql);
+			sqlite3_free(sql);
+
+			sql = sqlite3_mprintf("UPDATE %s_body SET description = ? WHERE id = ?", partition);
+			update_body = storage_query(handle, sql);
+			sqlite3_free(sql);
+
+			for (count = 0; sqlite3_step(stmt) == SQLITE_ROW; count++) {
+				const char *text_url = (const char *)sqlite3_column_text(stmt, 1);
+				const char *text = (const char *)sqlite3_column_text(stmt, 2);
+
+				id = last = sqlite3_column_int(stmt, 0);
+				url = dictionary >= 0 && text_url ? storage_encode_url(handle, text_url, &url_len) : NULL;
+				description = dictionary >= 0 && text
+				    ? storage_encode_text(handle, dictionary, text, &description_len) : NULL;
+
+				feed_bind(update, 1, url, url_len, text_url);
+				sqlite3_bind_int(update, 2, id);
+				storage_step(update, NULL);
+				sqlite3_reset(update);
+				feed_bind(update_body, 1, description, description_len, text);
+				sqlite3_bind_int(update_body, 2, id);
+				storage_step(update_body, NULL);
+				sqlite3_reset(update_body);
+				free(url);
+				free(description);
+			}
+
+			storage_finalize(update_body);
+			storage_finalize(update);
+			storage_finalize(stmt);
+			sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+			rows += count;
+		} while (count == FEED_RETENTION_BATCH);
+	}
+
+	sql = sqlite3_mprintf("DELETE FROM dictionaries WHERE feed = %Q AND id != %d", feed->f_name, dictionary);
+	sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL);
+	sqlite3_free(sql);
+
+	xprintf("Źródło %s: przepisano %d wiadomości%s.\n", feed->f_name, rows,
+	    dictionary < 0 ? " bez kompresji" : (dictionary ? ", nowy słownik" : " bez słownika"));
+	feed_codec_report(&codec, storage_codec_stats());
+	array_free(partitions, TRUE, FALSE);
+	return rows;
+}
+
+static int feed_compare_id(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Oznacza jako przejrzane wyświetlone wiadomości źródła (shown: rosnące
+ * id, count elementów). Wszystko do feeds.seen jest przejrzane, a
+ * przejrzane ponad tą granicą (np. przy 'limit') zapisujemy w seen_posts.
+ * Granicę przesuwamy do pierwszej nieprzejrzanej wiadomości źródła, a
+ * gdy takiej nie ma - do ostatnio nadanego id.
+ */
+void feed_mark_seen(storage_handle_t *handle, const char *feed, const int *shown, int count)
+{
+	char *sql = sqlite3_mprintf(
+		"SELECT p.id FROM posts AS p WHERE p.feed = %Q AND p.id > (SELECT seen FROM feeds WHERE name = %Q) "
+		"AND NOT EXISTS (SELECT 1 FROM seen_posts AS s WHERE s.id = p.id) ORDER BY p.id",
+		feed, feed);
+	storage_stmt_t *stmt, *mark;
+	int id, first = 0, unseen = 0;
+
+	sqlite3_exec(handle->sh_db, "SAVEPOINT seen", NULL, NULL, NULL);
+	stmt = storage_query(handle, sql);
+	sqlite3_free(sql);
+	sql = sqlite3_mprintf("INSERT OR IGNORE INTO seen_posts (id, feed) VALUES (?, %Q)", feed);
+	mark = storage_query(handle, sql);
+	sqlite3_free(sql);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		id = sqlite3_column_int(stmt, 0);
+
+		if (bsearch(&id, shown, count, sizeof(int), feed_compare_id)) {
+			sqlite3_bind_int(mark, 1, id);
+			sqlite3_step(mark);
+			sqlite3_reset(mark);
+		} else if (!unseen++) {
+			first = id;
+		}
+	}
+
+	storage_finalize(mark);
+	storage_finalize(stmt);
+
+	sql = unseen
+	    ? sqlite3_mprintf(
+		"UPDATE feeds SET unseen = %d, seen = %d WHERE name = %Q;"
+		"DELETE FROM seen_posts WHERE feed = %Q AND id < %d",
+		unseen, first - 1, feed, feed, first)
+	    : sqlite3_mprintf(
+		"UPDATE feeds SET unseen = 0, seen = (SELECT id FROM posts_sequence) WHERE name = %Q;"
+		"DELETE FROM seen_posts WHERE feed = %Q",
+		feed, feed);
+
+	if (sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+		FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+		sqlite3_exec(handle->sh_db, "ROLLBACK TO seen", NULL, NULL, NULL);
+	}
+
+	sqlite3_exec(handle->sh_db, "RELEASE seen", NULL, NULL, NULL);
+	sqlite3_free(sql);
+}
+
+static char *feed_column(hash_t *row, const char *name)
+{
+	char *ret = hash_get(row, name);
+	return ret ? ret : "";
+}
+
+/*
+ * Zwraca wiadomości pasujące do zapytania; tablica, wiadomości i ich pola
+ * są przydzielane z podanej areny. Czytamy tylko partycje, które mogą
+ * zawierać wiadomości z żądanego przedziału czasu. Zapytanie z fq_match
+ * przeszukuje indeksy pełnotekstowe partycji, porządkuje wyniki wg BM25
+ * (trafienie w tytule waży więcej niż w opisie) i zamiast opisu zwraca
+ * fragment z trafieniami. Przy fq_brief nie czytamy opisów wcale (tabele
+ * %s_body). Przy błędnym wyrażeniu wyszukiwania zwraca NULL.
+ */
+array_t *feed_get_entries(storage_handle_t *handle, feed_query_t *query, arena_t *arena)
+{
+	array_t *ret, *partitions;
 	hash_t *row;
 	feed_entry_t *entry;
-	int any_where = FALSE;
-	char *sql = sqlite3_mprintf("SELECT * FROM posts");
-	char *saved_sql;
+	char *sql = NULL, *saved_sql, *where, *part, *partition, *snippet;
+	time_t from = 0, to = FEED_TIME_MAX;
 	storage_stmt_t *stmt;
+	int i, status, limit;
+
+	if ((ret = feed_recent_query(handle, query, arena)))
+		return ret;
+
+	where = sqlite3_mprintf("");
     
-	if (query->fq_mask & QUERY_HAS_SOURCE || 
-	    query->fq_mask & QUERY_HAS_FROM_TIME || 
-	    query->fq_mask & QUERY_HAS_TO_TIME) {
-		saved_sql = sql;
-		sql = sqlite3_mprintf("%s WHERE ", sql);
-		sqlite3_free(saved_sql);
-	}
-	
 	if (query->fq_mask & QUERY_HAS_SOURCE) {
-		saved_sql = sql;
-		sql = sqlite3_mprintf("%s feed = %Q", sql, query->fq_feed);
-		any_where = TRUE;
+		saved_sql = where;
+		where = sqlite3_mprintf("%s AND feed = %Q", where, query->fq_feed);
 		sqlite3_free(saved_sql);
 	}
 	
-	if (query->fq_mask & QUERY_HAS_FROM_TIME) {
-		saved_sql = sql;
-		sql = sqlite3_mprintf("%s %s pubdate >= %u", sql, any_where++ ? " AND " : "", sql, query->fq_from_time);
+	if (query->fq_mask & QUERY_HAS_FROM_TIME)
+		from = query->fq_from_time;
+
+	if (query->fq_mask & QUERY_HAS_TO_TIME)
+		to = query->fq_to_time;
+
+	if (!query->fq_mask && !query->fq_match)
+		from = time(NULL) - UNIX_DAY;
+
+	if (from) {
+		saved_sql = where;
+		where = sqlite3_mprintf("%s AND pubdate >= %lld", where, (long long)from);
 		sqlite3_free(saved_sql);
 	}
 	
-	if (query->fq_mask & QUERY_HAS_TO_TIME) {
-		saved_sql = sql;
-		sql = sqlite3_mprintf("%s %s pubdate <= %u", sql, any_where++ ? " AND " : "", query->fq_to_time);
+	if (to != FEED_TIME_MAX) {
+		saved_sql = where;
+		where = sqlite3_mprintf("%s AND pubdate <= %lld", where, (long long)to);
 		sqlite3_free(saved_sql);
 	}
-    
-	if (query->fq_mask & QUERY_HAS_LIMIT) {
+
+	limit = query->fq_mask & QUERY_HAS_LIMIT ? query->fq_limit : FEED_SEARCH_LIMIT;
+	ret = array_init_arena(arena, 0);
+	partitions = storage_partitions(handle, from, to, arena);
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		if (query->fq_match) {
+			/* Fragment opisu wymaga odczytania (i rozpakowania) opisów trafień. */
+			snippet = query->fq_brief ? sqlite3_mprintf("NULL") : sqlite3_mprintf(
+			    "snippet(%s_fts, 1, %Q, %Q, '…', %d)", partition,
+			    query->fq_highlight_start, query->fq_highlight_end, FEED_SNIPPET_TOKENS);
+
+			/* Każda partycja ma własny indeks; najlepsze wyniki łączymy niżej. */
+			part = sqlite3_mprintf(
+			    "SELECT * FROM (SELECT p.id, p.feed, p.pubdate, p.title, rss_inflate(p.url) AS url, p.guid, "
+			    "highlight(%s_fts, 0, %Q, %Q) AS title_highlight, "
+			    "%s AS snippet, bm25(%s_fts, %s) AS score "
+			    "FROM %s_fts JOIN %s AS p ON p.id = %s_fts.rowid WHERE %s_fts MATCH %Q%s "
+			    "ORDER BY score LIMIT %d)",
+			    partition, query->fq_highlight_start, query->fq_highlight_end,
+			    snippet, partition, FEED_SEARCH_WEIGHTS, partition, partition, partition,
+			    partition, query->fq_match, where, limit);
+			sqlite3_free(snippet);
+		} else if (query->fq_brief) {
+			part = sqlite3_mprintf(
+			    "SELECT id, feed, pubdate, title, rss_inflate(url) AS url, guid FROM %s WHERE 1%s",
+			    partition, where);
+		} else {
+			part = sqlite3_mprintf(
+			    "SELECT p.id, feed, pubdate, title, rss_inflate(url) AS url, "
+			    "rss_inflate(b.description) AS description, guid "
+			    "FROM %s AS p LEFT JOIN %s_body AS b ON b.id = p.id WHERE 1%s",
+			    partition, partition, where);
+		}
+
 		saved_sql = sql;
-		sql = sqlite3_mprintf("%s LIMIT %d", sql, query->fq_limit);
+		sql = sql ? sqlite3_mprintf("%s UNION ALL %s", sql, part) : sqlite3_mprintf("%s", part);
 		sqlite3_free(saved_sql);
+		sqlite3_free(part);
 	}
 
-	if (!query->fq_mask) {
+	sqlite3_free(where);
+
+	if (!sql)
+		return ret;
+
+	if (query->fq_match) {
+		saved_sql = sql;
+		sql = sqlite3_mprintf("SELECT * FROM (%s) ORDER BY score LIMIT %d", sql, limit);
+		sqlite3_free(saved_sql);
+	} else if (query->fq_mask & QUERY_HAS_LIMIT) {
 		saved_sql = sql;
-		sql = sqlite3_mprintf("%s WHERE pubdate >= %u", sql, time(NULL) - UNIX_DAY);
+		sql = sqlite3_mprintf("SELECT * FROM (%s) LIMIT %d", sql, limit);
 		sqlite3_free(saved_sql);
 	}
 
-	ret = array_init(0);
 	stmt = storage_query(handle, sql);
 	
-	while (storage_step(stmt, &row) == SQLITE_ROW) {
-		time_t *pubdate = (time_t *)hash_get(row, "pubdate");
-		entry = feed_entry_create();
-		entry->fe_pubdate = *pubdate;
-		entry->fe_feed = hash_get_string(row, "feed");
-		entry->fe_title = hash_get_string(row, "title");
-		entry->fe_url = hash_get_string(row, "url");
-		entry->fe_description = hash_get_string(row, "description");
-		free(hash_get(row, "id"));
-		free(hash_get(row, "pubdate"));
-		hash_free(row, FALSE, FALSE);
+	while ((status = storage_step_arena(stmt, arena, &row)) == SQLITE_ROW) {
+		entry = arena_calloc(arena, sizeof(feed_entry_t));
+		entry->fe_arena = arena;
+		entry->fe_id = hash_get_int(row, "id");
+		entry->fe_pubdate = hash_get_int64(row, "pubdate");
+		entry->fe_feed = feed_column(row, "feed");
+		entry->fe_title = feed_column(row, "title");
+		entry->fe_url = feed_column(row, "url");
+		entry->fe_description = feed_column(row, "description");
+		entry->fe_guid = hash_get(row, "guid");
+		entry->fe_snippet = hash_get(row, "snippet");
+
+		if (hash_get(row, "title_highlight"))
+			entry->fe_title = hash_get(row, "title_highlight");
 		array_append(ret, (void *)entry);
 	}
 
+	if (status != SQLITE_DONE) {
+		/* Szczegółowy komunikat (np. błąd składni FTS5) daje dopiero reset. */
+		sqlite3_reset(stmt);
+		FAIL("Błąd wyszukiwania: %s. Słowa zawierające znaki specjalne ujmij w cudzysłów.\n",
+		    sqlite3_errmsg(handle->sh_db));
+		ret = NULL;
+	}
+
 	storage_finalize(stmt);
 	sqlite3_free(sql);
 	return ret;
 }
+
+/*
+ * Zwraca pełną wiadomość (z opisem) o podanym id albo NULL; wiadomość
+ * i jej pola są przydzielane z areny.
+ */
+feed_entry_t *feed_get_entry(storage_handle_t *handle, int id, arena_t *arena)
+{
+	char *sql = sqlite3_mprintf("SELECT pubdate FROM posts WHERE id = %d", id);
+	char partition[STORAGE_PARTITION_NAME_MAX];
+	storage_stmt_t *stmt = storage_query(handle, sql);
+	feed_entry_t *entry = NULL;
+	hash_t *row;
+	int found = sqlite3_step(stmt) == SQLITE_ROW;
+
+	if (found)
+		storage_partition_name(sqlite3_column_int64(stmt, 0), partition);
+
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+
+	if (!found)
+		return NULL;
+
+	sql = sqlite3_mprintf(
+		"SELECT p.id, feed, pubdate, title, rss_inflate(url) AS url, rss_inflate(b.description) AS description, guid "
+		"FROM %s AS p LEFT JOIN %s_body AS b ON b.id = p.id WHERE p.id = %d", partition, partition, id);
+	stmt = storage_query(handle, sql);
+
+	if (storage_step_arena(stmt, arena, &row) == SQLITE_ROW) {
+		entry = arena_calloc(arena, sizeof(feed_entry_t));
+		entry->fe_arena = arena;
+		entry->fe_id = id;
+		entry->fe_pubdate = hash_get_int64(row, "pubdate");
+		entry->fe_feed = feed_column(row, "feed");
+		entry->fe_title = feed_column(row, "title");
+		entry->fe_url = feed_column(row, "url");
+		entry->fe_description = feed_column(row, "description");
+		entry->fe_guid = hash_get(row, "guid");
+	}
+
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+	return entry;
+}
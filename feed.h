@@ -22,6 +22,20 @@
 #define UNIX_HOUR		(UNIX_MINUTE * 60)
 #define UNIX_DAY		(UNIX_HOUR * 24)
 
+#define	FEED_RECENT_KEYS	200
+#define	FEED_DEFAULT_EARLY_EXIT	3
+#define	FEED_BLOOM_MIN_KEYS	1024
+#define	FEED_BLOOM_FP_RATE	0.01
+#define	FEED_ARENA_SIZE		(256 * 1024)
+#define	FEED_SEARCH_LIMIT	50
+#define	FEED_SEARCH_WEIGHTS	"10.0, 1.0"
+#define	FEED_SNIPPET_TOKENS	24
+#define	FEED_TIME_MAX		((time_t)INT64_MAX)
+#define	FEED_RETENTION_BATCH	500
+#define	FEED_RECENT_SIZE	4096
+#define	FEED_DICTIONARY_SAMPLES	200
+#define	FEED_DICTIONARY_MIN_SAMPLES	20
+
 struct feed
 {
 	MANAGED;
@@ -29,6 +43,11 @@ struct feed
 	char	*f_url;
 	char	*f_description;
 	time_t	f_last_update;
+	int	f_redirects;
+	int	f_total;
+	int	f_unseen;
+	time_t	f_newest;
+	time_t	f_oldest;
 };
 
 typedef struct feed feed_t;
@@ -36,11 +55,15 @@ typedef struct feed feed_t;
 struct feed_entry
 {
 	MANAGED;
+	int	fe_id;
 	char	*fe_feed;
 	char	*fe_title;
 	char	*fe_url;
 	char	*fe_description;
+	char	*fe_guid;
+	char	*fe_snippet;
 	time_t	fe_pubdate;  
+	arena_t	*fe_arena;
 };
 
 typedef struct feed_entry feed_entry_t;
@@ -54,6 +77,10 @@ struct feed_query
 	time_t	fq_to_time;
 	int	fq_limit;
 	int	fq_count;
+	int	fq_brief;
+	char	*fq_match;
+	char	*fq_highlight_start;
+	char	*fq_highlight_end;
 };
 
 typedef struct feed_query feed_query_t;
@@ -64,8 +91,15 @@ void	feed_entry_free(feed_entry_t *);
 void	feed_save(storage_handle_t *, feed_t *);
 void	feed_remove(storage_handle_t *, feed_t *);
 void	feed_download(storage_handle_t *, feed_t *);
-void	feed_flush(storage_handle_t *, time_t);
-array_t	*feed_get_entries(storage_handle_t *, feed_query_t *);
+int	feed_flush(storage_handle_t *, time_t);
+int	feed_retain(storage_handle_t *, feed_t *);
+int	feed_dictionary_train(storage_handle_t *, feed_t *);
+int	feed_dictionary(storage_handle_t *, feed_t *);
+int	feed_compress(storage_handle_t *, feed_t *);
+void	feed_codec_report(const storage_codec_stats_t *, const storage_codec_stats_t *);
+void	feed_mark_seen(storage_handle_t *, const char *, const int *, int);
+array_t	*feed_get_entries(storage_handle_t *, feed_query_t *, arena_t *);
+feed_entry_t *feed_get_entry(storage_handle_t *, int, arena_t *);
 
 #endif	/* __FEED_H */
 
@@ -12,7 +12,7 @@
 #define RSS_DB_FILENAME	".rss.db"
 #define PAGER "/usr/bin/less -e -r"
 
-char	*db_location;
+extern char	*db_location;
 
 #endif	/* __GLOBALS_H */
 
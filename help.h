@@ -17,7 +17,7 @@ struct usage_data
 static const struct usage_data usage_texts[] = {
 	{ 
 	        "add", "dodaje nowe źródło RSS", 
-	        "add <nazwa_źródła> <http://adres_źródła>", 
+	        "add <nazwa_źródła> <http[s]://adres_źródła>", 
 	        "Polecenie 'add' dodaje nowy kanał RSS do listy skonfigurowanych\n"
 	        "kanałów. Pierwszym argumentem jest unikalna nazwa-identyfikator\n"
 	        "źródła, a drugim URL do pliku *.rss lub *.xml, zawierającym dane\n"
@@ -34,7 +34,9 @@ static const struct usage_data usage_texts[] = {
 	        "list", "wypisuje skonfigurowane źródla RSS",
 	        "list",
 	        "Polecenie 'list' wypisuje listę skonfigurowanych źródeł RSS wraz\n"
-	        "z ich URL-em oraz ilością wiadomości z bazie danych.\n"
+	        "z ich URL-em oraz ilością wiadomości w bazie danych: wszystkich,\n"
+	        "nowych (jeszcze niewyświetlonych poleceniem 'view') oraz zakresem\n"
+	        "dat od najstarszej do najnowszej.\n"
 	},
 	{
 	        "update", "pobiera nowe wiadomości z wybranego lub wszystkich źródeł RSS",
@@ -55,16 +57,48 @@ static const struct usage_data usage_texts[] = {
 	        "\tolder <data/czas> -- wybiera wiadomości starsze niż...\n"
 	        "\tnewer <data/czas> -- wybiera wiadomości nowsze niż...\n"
 	        "\tall -- wybiera wszystkie wiadomości. Jednocześnie unieważnia wcześniej podane parametry.\n"
+	        "\tbrief -- wypisuje tylko numer, datę, źródło, tytuł i adres wiadomości, bez\n"
+	        "\todczytywania opisów; opis wybranej wiadomości wyświetla polecenie 'read'.\n"
 	        "\n"
 	        "\tParametr <data/czas> dla parameteru 'older' oraz 'newer' może być podany w formacie:\n"
 	        "\tliczba(h|m|d), np.: 12h, 2d lub 60m.\n"
 	},
+	{
+	        "search", "wyszukuje wiadomości zawierające podane słowa",
+	        "search <słowa> [parametry]",
+	        "Polecenie 'search' przeszukuje tytuły i opisy wszystkich zgromadzonych\n"
+	        "wiadomości i wyświetla najlepiej pasujące (trafienia w tytule liczą się\n"
+	        "bardziej), każdą z fragmentem opisu z zaznaczonymi trafieniami. Wielkość\n"
+	        "liter i znaki diakrytyczne nie mają znaczenia: 'gesla' znajdzie 'gęślą'.\n"
+	        "Słowa można łączyć operatorami AND, OR i NOT, frazę ująć w cudzysłów,\n"
+	        "a przedrostek zakończyć gwiazdką, np.: search \"nowy rok\" OR sylwest*\n"
+	        "Dostępne są też parametry polecenia 'view': feed, newer, older, brief\n"
+	        "oraz limit (domyślnie 50 wiadomości).\n"
+	},
+	{
+	        "read", "wyświetla pełną treść wiadomości o podanym numerze",
+	        "read <numer_wiadomości>",
+	        "Polecenie 'read' wyświetla wiadomość wraz z opisem. Numery wiadomości\n"
+	        "wypisują polecenia 'view brief' i 'search brief'.\n"
+	},
 	{
 	        "flush", "usuwa najstarsze wiadomości zgromadzone w bazie danych",
 	        "flush <data/czas>",
 	        "Polecenie 'flush' usuwa zgromadzone w bazie danych wiadomości ze źródeł RSS\n"
 	        "starsze niż podany okres czasu. Parametrem tej funkcji jest liczba minut, godzin\n"
 	        "lub dni w formacie: liczba(m|h|d), np: 12h, 2d lub 60m.\n"
+	        "Wiadomości są przechowywane w partycjach miesięcznych; miesiące starsze\n"
+	        "niż podany czas są usuwane w całości, bez kasowania pojedynczych wiadomości.\n"
+	},
+	{
+	        "compress", "przepisuje zapisane opisy i adresy zgodnie ze zmienną compress",
+	        "compress <nazwa_źródła>|all",
+	        "Polecenie 'compress' uczy nowy słownik na ostatnich opisach źródła\n"
+	        "i koduje nim opisy wszystkich jego wiadomości, a adresy zapisuje jako\n"
+	        "wspólny przedrostek i resztę adresu. Przy zmiennej compress ustawionej\n"
+	        "na off zapisuje je z powrotem bez kompresji. Wiadomości zapisane przez\n"
+	        "'update' są kodowane ostatnim słownikiem źródła na bieżąco; polecenie\n"
+	        "warto uruchomić po włączeniu kompresji dla istniejącego archiwum.\n"
 	},
 	{
 	        "set", "wyświetla lub ustawia zawartość wewnętrznej zmiennej",
@@ -75,6 +109,37 @@ static const struct usage_data usage_texts[] = {
 		"wartościami. W drugim przypadku, gdy podana jest nazwa zmiennej, wyświetli\n"
 		"tylko tę zmienną i jej wartość. Trzeci przypadek, w którym podajemy nazwę\n"
 		"zmiennej i jej wartość, ustawia wartość podanej zmiennej.\n"
+		"\n"
+		"\tWybrane zmienne:\n"
+		"\tuse_pager, use_colors -- (on|off) używanie pagera i kolorów w 'view'.\n"
+		"\tconnect_timeout -- limit czasu nawiązania połączenia, w sekundach.\n"
+		"\tfirst_byte_timeout -- limit czasu oczekiwania na pierwszy bajt odpowiedzi.\n"
+		"\ttransfer_timeout -- limit czasu całego pobierania (0 - bez limitu).\n"
+		"\tshow_timings -- (on|off) wypisywanie czasów pobierania w 'update'.\n"
+		"\ttls_verify -- (on|off) weryfikacja certyfikatów serwerów https.\n"
+		"\ttls_ca_file -- dodatkowy plik PEM z zaufanymi certyfikatami.\n"
+		"\tearly_exit -- po ilu kolejnych znanych wiadomościach przerwać przetwarzanie\n"
+		"\t\tkanału (0 - zawsze przetwarzać całość).\n"
+		"\tshow_stats -- (on|off) statystyki filtru znanych wiadomości i kompresji\n"
+		"\t\tw 'update' oraz liczba wczytanych stron i koszt rozpakowania\n"
+		"\t\topisów w 'view'.\n"
+		"\tcharset -- wymuszone kodowanie treści źródła (puste - rozpoznawane).\n"
+		"\tfallback_charset -- kodowanie przyjmowane dla treści, która nie jest\n"
+		"\t\tpoprawnym UTF-8 (domyślnie windows-1250).\n"
+		"\tmax_items, max_age -- najwięcej przechowywanych wiadomości źródła i ich\n"
+		"\t\tnajwiększy wiek w dniach (0 - bez limitu); starsze wiadomości są\n"
+		"\t\tusuwane po każdej aktualizacji źródła.\n"
+		"\tvacuum_pages -- ile zwolnionych stron pliku bazy oddawać systemowi\n"
+		"\t\tpo każdym poleceniu (0 - nie zmniejszać pliku).\n"
+		"\tcompress -- (on|off) kompresja opisów i adresów nowych wiadomości\n"
+		"\t\t(słownik uczony osobno dla każdego źródła, zob. 'help compress').\n"
+		"\toutput_format -- (human|ndjson|tsv) format wiadomości w 'view', 'search'\n"
+		"\t\ti 'read': tekst, jeden obiekt JSON w wierszu albo kolumny rozdzielone\n"
+		"\t\ttabulatorami (id, data ISO 8601 w UTC, źródło, tytuł, adres, opis).\n"
+		"\n"
+		"\tZmienną można ustawić osobno dla źródła, poprzedzając jej nazwę nazwą\n"
+		"\tźródła i kropką, np.: set wiadomosci.early_exit 0\n"
+		"\tlub set wiadomosci.max_items 1000\n"
 	},
 	{
 		"help", "wyświetla treść pomocy",
@@ -88,6 +153,14 @@ static const struct usage_data usage_texts[] = {
 		"Polecenie 'about' wyświetla nieco zdawkowych informacji na temat autora i\n"
 		"w skrócie wyjaśnia, z jakich pobudek on powstał.\n"
 	},
+	{
+		"mem", "wyświetla statystyki użycia pamięci",
+		"mem [liczba_miejsc]",
+		"Polecenie 'mem' wypisuje bieżące i szczytowe użycie pamięci w podziale\n"
+		"na podsystemy (http, feed, storage, cli, ...) oraz miejsca w kodzie,\n"
+		"które przydzieliły najwięcej wciąż zajętej pamięci (domyślnie 10).\n"
+		"Dostępne tylko w programie zbudowanym poleceniem \"make MEM=1\".\n"
+	},
 	{
 		"exit", "kończy pracę programu",
 		"exit",
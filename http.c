@@ -3,7 +3,11 @@
  * Author: Adrian Jamróz
  */    
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -13,45 +17,161 @@
 #include <regex.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
 #include "utils.h"
 #include "http.h"
 #include "feed.h"
+#include "progress.h"
+
+struct http_conn
+{
+	int		hc_fd;
+	long		hc_start;
+	long		hc_deadline;
+	long		hc_first_byte;
+	http_timing_t	*hc_timing;
+	SSL		*hc_ssl;
+	char		*hc_key;
+};
+
+typedef struct http_conn http_conn_t;
+
+static hash_t *http_redirect_cache = NULL;
+static hash_t *http_tls_sessions = NULL;
 
 int	http_parse_uri(http_request_t *, const char *);
-int	http_do_request(http_request_t *, http_response_t *);
-void	http_read_callback(int, int);
+int	http_default_port(const char *);
+int	http_follow_redirect(http_request_t *, http_response_t *, int);
+int	http_do_request(http_request_t *, http_response_t *, long);
+int	http_connect(http_request_t *, long, addrinfo_t **);
+int	http_wait(int, short, long);
+long	http_now();
+FILE	*http_conn_open(http_request_t *, int, long, long, long, http_timing_t *);
+SSL_CTX	*http_tls_context(http_request_t *);
+int	http_tls_handshake(http_conn_t *, http_request_t *, long);
+int	http_tls_retry(http_conn_t *, int, long);
+int	http_tls_new_session(SSL *, SSL_SESSION *);
+void	http_read_callback(void *, int, int);
+
+/*
+ * Zwraca kanoniczną postać adresu: schemat i nazwa hosta małymi literami,
+ * bez domyślnego portu i bez fragmentu (#...), z niepustą ścieżką. Adres
+ * względny (np. z nagłówka Location) jest rozwiązywany względem base.
+ */
+char *http_canonicalize_url(const char *url, const char *base)
+{
+	int port;
+	char *p, *ret, *absolute = NULL;
+	const char *path;
+	array_t *parts;
+
+	if (base && !strstr(url, "://")) {
+		if (!(parts = regexp_match(HTTP_URL_REGEXP, base, REG_EXTENDED)))
+			return NULL;
+
+		if (url[0] == '/' && url[1] == '/') {
+			asprintf(&absolute, "%s:%s", (char *)array_get(parts, 1), url);
+		} else if (url[0] == '/') {
+			asprintf(&absolute, "%s://%s%s%s", (char *)array_get(parts, 1),
+			    (char *)array_get(parts, 2), (char *)array_get(parts, 3), url);
+		} else {
+			char *dir = xstrdup(array_get(parts, 5));
+			if ((p = strchr(dir, '?'))) *p = '\0';
+			if ((p = strrchr(dir, '/'))) *(p + 1) = '\0';
+			asprintf(&absolute, "%s://%s%s%s%s", (char *)array_get(parts, 1),
+			    (char *)array_get(parts, 2), (char *)array_get(parts, 3),
+			    *dir == '/' ? dir : "/", url);
+			free(dir);
+		}
+
+		array_free(parts, TRUE, FALSE);
+		ret = http_canonicalize_url(absolute, NULL);
+		free(absolute);
+		return ret;
+	}
+
+	if (!(parts = regexp_match(HTTP_URL_REGEXP, url, REG_EXTENDED)))
+		return NULL;
+
+	for (p = array_get(parts, 1); *p; p++) *p = tolower(*p);
+	for (p = array_get(parts, 2); *p; p++) *p = tolower(*p);
+
+	port = atoi(array_get(parts, 4));
+	path = array_get(parts, 5);
+
+	if (!port || port == http_default_port(array_get(parts, 1)))
+		asprintf(&ret, "%s://%s%s", (char *)array_get(parts, 1),
+		    (char *)array_get(parts, 2), *path ? path : "/");
+	else
+		asprintf(&ret, "%s://%s:%d%s", (char *)array_get(parts, 1),
+		    (char *)array_get(parts, 2), port, *path ? path : "/");
+
+	array_free(parts, TRUE, FALSE);
+	return ret;
+}
+
+int http_default_port(const char *scheme)
+{
+	if (!strcmp(scheme, "http"))
+		return 80;
+
+	if (!strcmp(scheme, "https"))
+		return 443;
+
+	return 0;
+}
 
 int http_parse_uri(http_request_t *req, const char *uri)
 {
 	int status;
-	array_t *regexp = regexp_match("http://([^/]+)/(.*)", uri, REG_EXTENDED|REG_ICASE);
+	char *url, service[8];
+	array_t *regexp;
 
-	if (!regexp) {
-		if (errno != EINVAL)
-			FAIL("nie udało się dopasować wyrażenia regularnego na \"%s\"\n", uri);
-	
+	if (!(url = http_canonicalize_url(uri, req->hr_url))) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	regexp = regexp_match(HTTP_URL_REGEXP, url, REG_EXTENDED);
+
+	if (!http_default_port(array_get(regexp, 1))) {
+		FAIL("http: nieobsługiwany protokół: %s\n", (char *)array_get(regexp, 1));
+		array_free(regexp, TRUE, FALSE);
+		free(url);
+		errno = EPROTONOSUPPORT;
 		return 0;
 	}
 
 	addrinfo_t hints = {
-		.ai_family = AF_INET,
+		.ai_family = AF_UNSPEC,
 		.ai_socktype = SOCK_STREAM
 	};
 	
+	if (req->hr_url) free(req->hr_url);
 	if (req->hr_hostname) free(req->hr_hostname);
 	if (req->hr_path) free(req->hr_path);
 	if (req->hr_addrinfo) freeaddrinfo(req->hr_addrinfo);
     
-	req->hr_hostname = xstrdup(array_get(regexp, 1));
-	req->hr_port = htons(80);
-	req->hr_path = xstrdup(array_get(regexp, 2));
+	req->hr_url = url;
+	req->hr_tls = !strcmp(array_get(regexp, 1), "https");
+	req->hr_hostname = xstrdup(array_get(regexp, 2));
+	req->hr_port = htons(*(char *)array_get(regexp, 4)
+	    ? atoi(array_get(regexp, 4))
+	    : http_default_port(array_get(regexp, 1)));
+	req->hr_path = xstrdup((char *)array_get(regexp, 5) + 1);
+	req->hr_addrinfo = NULL;
+	array_free(regexp, TRUE, FALSE);
 	
-	if ((status = getaddrinfo(req->hr_hostname, "http", &hints, &req->hr_addrinfo))) {
+	snprintf(service, sizeof(service), "%d", ntohs(req->hr_port));
+
+	if ((status = getaddrinfo(req->hr_hostname, service, &hints, &req->hr_addrinfo))) {
 		FAIL("Nie udało się rozwiązać domeny %s: %s\n", req->hr_hostname, gai_strerror(status));
+		req->hr_addrinfo = NULL;
 		return 0;
 	}
 	
-	array_free(regexp, TRUE, FALSE);
 	return -1;
 }
 
@@ -59,9 +179,15 @@ http_request_t *http_new_request(const char *url, hash_t *headers)
 {
 	http_request_t *req = xcmalloc(sizeof(http_request_t));
 	req->hr_headers = headers;
+	req->hr_connect_timeout = HTTP_DEFAULT_CONNECT_TIMEOUT;
+	req->hr_first_byte_timeout = HTTP_DEFAULT_FIRST_BYTE_TIMEOUT;
+	req->hr_transfer_timeout = HTTP_DEFAULT_TRANSFER_TIMEOUT;
+	req->hr_tls_verify = TRUE;
 	
-	if (!http_parse_uri(req, url))
+	if (!http_parse_uri(req, url)) {
+		http_free_request(req);
 		return NULL;
+	}
 	
 	return req;
 }
@@ -71,6 +197,8 @@ void http_free_request(http_request_t *req)
 	if (req->hr_response) {
 		http_response_t *resp = req->hr_response;
 		hash_free(resp->hs_headers, TRUE, FALSE);
+		array_free(resp->hs_chain, TRUE, FALSE);
+		free(resp->hs_location);
 		free(resp->hs_body);
 		free(resp);
 	}
@@ -79,125 +207,624 @@ void http_free_request(http_request_t *req)
 		freeaddrinfo(req->hr_addrinfo);	
 	
 	hash_free(req->hr_headers, TRUE, FALSE);
+	free(req->hr_url);
+	free(req->hr_name);
+	free(req->hr_tls_ca_file);
 	free(req->hr_hostname);
 	free(req->hr_path);
 	free(req);
 }
 
+/*
+ * Nazwy nagłówków HTTP nie rozróżniają wielkości liter (RFC 7230).
+ */
+const char *http_get_header(http_response_t *resp, const char *name)
+{
+	int i;
+	const char *key;
+	void *value;
+
+	FOREACH_HASH(resp->hs_headers, i, key, value) {
+		if (!strcasecmp(key, name))
+			return value;
+	}
+
+	return NULL;
+}
+
 http_response_t *http_send_request(http_request_t *req)
 {
+	int hops = 0;
+	char *target;
 	http_response_t *resp = xcmalloc(sizeof(http_response_t));
 	resp->hs_headers = hash_init();
+	resp->hs_chain = array_init(0);
 	req->hr_response = resp;
-	http_do_request(req, resp);
+
+	if (!http_redirect_cache)
+		http_redirect_cache = hash_init();
+
+	/*
+	 * Przekierowania tymczasowe (302, 303, 307) zapamiętujemy do końca sesji,
+	 * więc kolejne pobrania tego samego adresu pomijają zbędne zapytanie.
+	 */
+	while ((target = hash_get(http_redirect_cache, req->hr_url)) && hops++ < HTTP_MAX_REDIRECTS) {
+		array_append(resp->hs_chain, xstrdup(req->hr_url));
+		if (!http_parse_uri(req, target))
+			return resp;
+	}
+
+	array_append(resp->hs_chain, xstrdup(req->hr_url));
+	resp->hs_status = http_do_request(req, resp, http_now());
 	return resp;
 }
 
-int http_do_request(http_request_t *req, http_response_t *resp)
+/*
+ * Obsługuje odpowiedź 3xx: sprawdza limit i pętle przekierowań, zapamiętuje
+ * adres docelowy (stały w hs_location, tymczasowy w pamięci podręcznej
+ * sesji) i przestawia żądanie na nowy adres.
+ */
+int http_follow_redirect(http_request_t *req, http_response_t *resp, int status)
 {
-	int i, sock, status;
-	FILE *fsock;
-	addrinfo_t *ptr;
-	const char *key;
-	void *value;
-    
-	for (ptr = req->hr_addrinfo; ptr; ptr = ptr->ai_next) {
-		
-		struct sockaddr_in *sin = (struct sockaddr_in *)ptr->ai_addr;
-		xprintf("Łączę się z %s:%d... ", inet_ntoa(sin->sin_addr), ntohs(sin->sin_port));
-		
-		if (!(sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP))) {
-			FAIL("nie udało się otworzyć gniazda: %s\n", strerror(errno));
+	int i;
+	const char *location = http_get_header(resp, "Location");
+	char *target;
+	void *data;
+
+	if (!location) {
+		FAIL("http: odpowiedź %d bez nagłówka Location.\n", status);
+		return FALSE;
+	}
+
+	if (++resp->hs_redirects > HTTP_MAX_REDIRECTS) {
+		FAIL("http: zbyt wiele przekierowań (więcej niż %d).\n", HTTP_MAX_REDIRECTS);
+		return FALSE;
+	}
+
+	if (!(target = http_canonicalize_url(location, req->hr_url))) {
+		FAIL("http: nieprawidłowy adres przekierowania: %s\n", location);
+		return FALSE;
+	}
+
+	FOREACH_ARRAY(resp->hs_chain, i, data) {
+		if (!strcmp((char *)data, target)) {
+			FAIL("http: wykryto pętlę przekierowań na %s\n", target);
+			free(target);
 			return FALSE;
 		}
-		
-		if (connect(sock, ptr->ai_addr, ptr->ai_addrlen)) {
-			FAIL("nie udało się połączyć z serwerem: %s\n", strerror(errno));
-			continue;
-		};
+	}
+
+	if (HTTP_IS_PERMANENT(status)) {
+		/* Stały adres liczymy tylko dla nieprzerwanego ciągu stałych przekierowań. */
+		if (resp->hs_redirects == ++resp->hs_permanent) {
+			free(resp->hs_location);
+			resp->hs_location = xstrdup(target);
+		}
+	} else {
+		hash_set(http_redirect_cache, xstrdup(req->hr_url), xstrdup(target), TRUE);
+	}
+
+	array_append(resp->hs_chain, xstrdup(target));
+	xprintf("przekierowanie: %s\n", target);
+
+	i = http_parse_uri(req, target);
+	free(target);
+	return i;
+}
 
-		fsock = fdopen(sock, "a+");
-		fprintf(fsock, "GET /%s HTTP/1.1\r\n", req->hr_path);
+long http_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int http_wait(int fd, short events, long deadline)
+{
+	int ret, timeout = -1;
+	struct pollfd pfd = { .fd = fd, .events = events };
 
-		FOREACH_HASH(req->hr_headers, i, key, value) {
-			fprintf(fsock, "%s: %s\r\n", key, (char *)value);
+	do {
+		if (deadline) {
+			timeout = deadline - http_now();
+			if (timeout <= 0) {
+				errno = ETIMEDOUT;
+				return 0;
+			}
 		}
+	} while ((ret = poll(&pfd, 1, timeout)) < 0 && errno == EINTR);
 
-		fprintf(fsock, "Host: %s\r\n\r\n", req->hr_hostname);
+	if (!ret)
+		errno = ETIMEDOUT;
 
-		if (fscanf(fsock, "HTTP/1.%*1d %3d %*[^\r\n]\r\n", &status) < 1) {
-			FAIL("http: niepoprawna odpowiedź serwera.\n");
-			errno = EINVAL;
-			free(resp);
-			return FALSE;
+	return ret;
+}
+
+/*
+ * Po nieudanej operacji SSL_read()/SSL_write()/SSL_connect() czeka, aż
+ * gniazdo będzie gotowe do jej powtórzenia. Zwraca 1, jeśli należy
+ * spróbować ponownie, 0 przy zamknięciu połączenia i -1 przy błędzie.
+ */
+int http_tls_retry(http_conn_t *conn, int ret, long deadline)
+{
+	switch (SSL_get_error(conn->hc_ssl, ret)) {
+		case SSL_ERROR_ZERO_RETURN:
+			return 0;
+
+		case SSL_ERROR_WANT_READ:
+			return http_wait(conn->hc_fd, POLLIN, deadline) < 1 ? -1 : 1;
+
+		case SSL_ERROR_WANT_WRITE:
+			return http_wait(conn->hc_fd, POLLOUT, deadline) < 1 ? -1 : 1;
+
+		case SSL_ERROR_SYSCALL:
+			if (errno == EINTR)
+				return 1;
+			/* przechodzimy dalej */
+
+		default:
+			errno = EIO;
+			return -1;
+	}
+}
+
+/*
+ * Strumień FILE nad gniazdem nieblokującym (opcjonalnie z TLS). Każdy
+ * odczyt i zapis czeka najwyżej do upływu terminu pierwszego bajtu
+ * (dopóki żaden nie dotarł) lub terminu całego transferu - po jego
+ * przekroczeniu fread()/fscanf() kończą się błędem z errno == ETIMEDOUT.
+ */
+ssize_t http_conn_read(void *cookie, char *buf, size_t size)
+{
+	http_conn_t *conn = (http_conn_t *)cookie;
+	long deadline = conn->hc_deadline;
+	ssize_t ret;
+
+	if (conn->hc_first_byte && (!deadline || conn->hc_first_byte < deadline))
+		deadline = conn->hc_first_byte;
+
+	if (conn->hc_ssl) {
+		while ((ret = SSL_read(conn->hc_ssl, buf, size)) <= 0) {
+			int status = http_tls_retry(conn, ret, deadline);
+
+			if (status < 1)
+				return status;
 		}
+	} else {
+		while ((ret = recv(conn->hc_fd, buf, size, 0)) < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				return -1;
+
+			if (http_wait(conn->hc_fd, POLLIN, deadline) < 1)
+				return -1;
+		}
+	}
+
+	if (conn->hc_first_byte) {
+		conn->hc_first_byte = 0;
+		conn->hc_timing->ht_first_byte = http_now() - conn->hc_start;
+	}
+
+	return ret;
+}
+
+ssize_t http_conn_write(void *cookie, const char *buf, size_t size)
+{
+	http_conn_t *conn = (http_conn_t *)cookie;
+	ssize_t ret;
+
+	if (conn->hc_ssl) {
+		while ((ret = SSL_write(conn->hc_ssl, buf, size)) <= 0) {
+			if (http_tls_retry(conn, ret, conn->hc_deadline) < 1)
+				return -1;
+		}
+
+		return ret;
+	}
+
+	while ((ret = send(conn->hc_fd, buf, size, MSG_NOSIGNAL)) < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return -1;
 
-		while (1) {
-			char *line = xfgetln(fsock);
-			char name[LINEMAX], value[LINEMAX];
+		if (http_wait(conn->hc_fd, POLLOUT, conn->hc_deadline) < 1)
+			return -1;
+	}
+
+	return ret;
+}
+
+int http_conn_close(void *cookie)
+{
+	http_conn_t *conn = (http_conn_t *)cookie;
+	int ret;
+
+	if (conn->hc_ssl) {
+		SSL_shutdown(conn->hc_ssl);
+		SSL_free(conn->hc_ssl);
+	}
 
-			if (line[0] == '\n') {
-				free(line);
+	ret = close(conn->hc_fd);
+	free(conn->hc_key);
+	free(conn);
+	return ret;
+}
+
+/*
+ * Nowa sesja TLS (bilet lub identyfikator sesji) od serwera; zapamiętujemy
+ * ją pod kluczem "host:port", by następne połączenie mogło ją wznowić.
+ * W TLS 1.3 bilety przychodzą już po zakończeniu negocjacji.
+ */
+int http_tls_new_session(SSL *ssl, SSL_SESSION *session)
+{
+	const char *key = SSL_get_app_data(ssl);
+	SSL_SESSION *old;
+
+	if (!key)
+		return 0;
+
+	if ((old = hash_get(http_tls_sessions, key))) {
+		SSL_SESSION_free(old);
+		hash_unset(http_tls_sessions, key, FALSE);
+	}
+
+	hash_set(http_tls_sessions, xstrdup(key), session, FALSE);
+	return 1;
+}
+
+SSL_CTX *http_tls_context(http_request_t *req)
+{
+	static SSL_CTX *ctx = NULL;
+	static char *ca_file = NULL;
+
+	if (!ctx) {
+		if (!(ctx = SSL_CTX_new(TLS_client_method()))) {
+			FAIL("tls: nie udało się utworzyć kontekstu: %s\n", ERR_error_string(ERR_get_error(), NULL));
+			return NULL;
+		}
+
+		SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+		SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+		SSL_CTX_set_default_verify_paths(ctx);
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, http_tls_new_session);
+		http_tls_sessions = hash_init();
+	}
+
+	if (req->hr_tls_ca_file && *req->hr_tls_ca_file && (!ca_file || strcmp(ca_file, req->hr_tls_ca_file))) {
+		if (!SSL_CTX_load_verify_locations(ctx, req->hr_tls_ca_file, NULL))
+			FAIL("tls: nie udało się wczytać certyfikatów z %s\n", req->hr_tls_ca_file);
+
+		free(ca_file);
+		ca_file = xstrdup(req->hr_tls_ca_file);
+	}
+
+	return ctx;
+}
+
+/*
+ * Negocjacja TLS na już połączonym gnieździe, z limitem czasu połączenia.
+ * Jeśli mamy zapamiętaną sesję dla tego hosta, próbujemy ją wznowić.
+ */
+int http_tls_handshake(http_conn_t *conn, http_request_t *req, long deadline)
+{
+	int ret, status;
+	long started = http_now();
+	SSL_CTX *ctx = http_tls_context(req);
+	SSL_SESSION *session;
+
+	if (!ctx || !(conn->hc_ssl = SSL_new(ctx)))
+		return FALSE;
+
+	asprintf(&conn->hc_key, "%s:%d", req->hr_hostname, ntohs(req->hr_port));
+	SSL_set_app_data(conn->hc_ssl, conn->hc_key);
+	SSL_set_fd(conn->hc_ssl, conn->hc_fd);
+	SSL_set_tlsext_host_name(conn->hc_ssl, req->hr_hostname);
+
+	if (req->hr_tls_verify) {
+		SSL_set_verify(conn->hc_ssl, SSL_VERIFY_PEER, NULL);
+		SSL_set1_host(conn->hc_ssl, req->hr_hostname);
+	} else {
+		SSL_set_verify(conn->hc_ssl, SSL_VERIFY_NONE, NULL);
+	}
+
+	if ((session = hash_get(http_tls_sessions, conn->hc_key)))
+		SSL_set_session(conn->hc_ssl, session);
+
+	while ((ret = SSL_connect(conn->hc_ssl)) != 1) {
+		if ((status = http_tls_retry(conn, ret, deadline)) == 1)
+			continue;
+
+		if (errno == ETIMEDOUT)
+			FAIL("tls: przekroczono limit czasu negocjacji.\n");
+		else if (SSL_get_verify_result(conn->hc_ssl) != X509_V_OK)
+			FAIL("tls: niepoprawny certyfikat serwera %s: %s\n", req->hr_hostname,
+			    X509_verify_cert_error_string(SSL_get_verify_result(conn->hc_ssl)));
+		else
+			FAIL("tls: negocjacja nie powiodła się: %s\n", ERR_error_string(ERR_get_error(), NULL));
+
+		ERR_clear_error();
+		return FALSE;
+	}
+
+	conn->hc_timing->ht_tls = http_now() - started;
+	conn->hc_timing->ht_resumed = SSL_session_reused(conn->hc_ssl);
+	return TRUE;
+}
+
+FILE *http_conn_open(http_request_t *req, int sock, long start, long connect_deadline, long deadline, http_timing_t *timing)
+{
+	FILE *ret;
+	cookie_io_functions_t funcs = {
+		.read = http_conn_read,
+		.write = http_conn_write,
+		.seek = NULL,
+		.close = http_conn_close
+	};
+	http_conn_t *conn = xcmalloc(sizeof(http_conn_t));
+
+	conn->hc_fd = sock;
+	conn->hc_start = start;
+	conn->hc_deadline = deadline;
+	conn->hc_timing = timing;
+
+	if (req->hr_tls && !http_tls_handshake(conn, req, connect_deadline)) {
+		http_conn_close(conn);
+		return NULL;
+	}
+
+	conn->hc_first_byte = req->hr_first_byte_timeout ? http_now() + req->hr_first_byte_timeout : 0;
+
+	if (!(ret = fopencookie(conn, "r+", funcs))) {
+		FAIL("nie udało się otworzyć gniazda: %s\n", strerror(errno));
+		http_conn_close(conn);
+	}
+
+	return ret;
+}
+
+/*
+ * Nawiązuje połączenie z jednym z adresów serwera, wg RFC 8305 ("Happy
+ * Eyeballs v2"): adresy są ustawiane naprzemiennie rodzinami (zaczynając
+ * od preferowanej przez getaddrinfo()), a kolejna próba startuje co
+ * HTTP_ATTEMPT_DELAY ms lub natychmiast po porażce poprzedniej, nie
+ * czekając na zakończenie wcześniejszych. Wygrywa pierwsze gniazdo, które
+ * się połączy; pozostałe są zamykane. Zwraca deskryptor (nieblokujący)
+ * lub -1.
+ */
+int http_connect(http_request_t *req, long deadline, addrinfo_t **winner)
+{
+	int i, n, started = 0, pending = 0, sock = -1, error = ECONNREFUSED;
+	long next, now;
+	struct pollfd *fds;
+	addrinfo_t *ptr;
+	array_t *primary = array_init(0), *secondary = array_init(0), *order = array_init(0);
+
+	for (ptr = req->hr_addrinfo; ptr; ptr = ptr->ai_next)
+		array_append(ptr->ai_family == req->hr_addrinfo->ai_family ? primary : secondary, ptr);
+
+	for (i = 0; i < array_count(primary) || i < array_count(secondary); i++) {
+		if (i < array_count(primary)) array_append(order, array_get(primary, i));
+		if (i < array_count(secondary)) array_append(order, array_get(secondary, i));
+	}
+
+	n = array_count(order);
+	fds = xcmalloc(sizeof(struct pollfd) * (n + 1));
+	next = http_now();
+
+	while (sock < 0) {
+		int timeout = -1;
+		now = http_now();
+
+		if (started < n && now >= next) {
+			ptr = array_get(order, started);
+			fds[started].events = POLLOUT;
+			fds[started].fd = socket(ptr->ai_family, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+
+			if (fds[started].fd < 0) {
+				error = errno;
+			} else if (!connect(fds[started].fd, ptr->ai_addr, ptr->ai_addrlen)) {
+				sock = fds[started].fd;
+				*winner = ptr;
+			} else if (errno == EINPROGRESS) {
+				pending++;
+			} else {
+				error = errno;
+				close(fds[started].fd);
+				fds[started].fd = -1;
+			}
+
+			started++;
+			next = (fds[started - 1].fd < 0) ? now : now + HTTP_ATTEMPT_DELAY;
+			continue;
+		}
+
+		if (started == n && !pending)
+			break;
+
+		if (started < n)
+			timeout = next - now;
+
+		if (deadline) {
+			if (now >= deadline) {
+				error = ETIMEDOUT;
 				break;
 			}
 
-			if (sscanf(line, "%[^:\n]: %[^\r\n]\r\n", name, value) < 2) {
-				free(line);
+			if (timeout < 0 || deadline - now < timeout)
+				timeout = deadline - now;
+		}
+
+		if (poll(fds, started, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			error = errno;
+			break;
+		}
+
+		for (i = 0; i < started && sock < 0; i++) {
+			int status = 0;
+			socklen_t len = sizeof(status);
+
+			if (fds[i].fd < 0 || !fds[i].revents)
+				continue;
+
+			getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &status, &len);
+
+			if (!status) {
+				sock = fds[i].fd;
+				*winner = array_get(order, i);
 				break;
 			}
 
-			hash_set(resp->hs_headers, xstrdup(name), (void *)xstrdup(value), TRUE);	
-			free(line);
+			error = status;
+			close(fds[i].fd);
+			fds[i].fd = -1;
+			pending--;
+			next = http_now();
 		}
-		
-		if (status == 301 || status == 302) {
-			if (!http_parse_uri(req, hash_get_string(resp->hs_headers, "Location")))
-				return FALSE;
-			
-			xprintf("przekierowanie: %s\n", hash_get_string(resp->hs_headers, "Location"));
-			
-			fclose(fsock);
-			shutdown(sock, SHUT_RDWR);
-			return http_do_request(req, resp);
+	}
+
+	for (i = 0; i < started; i++) {
+		if (fds[i].fd >= 0 && fds[i].fd != sock)
+			close(fds[i].fd);
+	}
+
+	free(fds);
+	array_free(primary, FALSE, FALSE);
+	array_free(secondary, FALSE, FALSE);
+	array_free(order, FALSE, FALSE);
+
+	if (sock < 0) {
+		if (error == ETIMEDOUT)
+			FAIL("nie udało się połączyć z serwerem: przekroczono limit czasu.\n");
+		else
+			FAIL("nie udało się połączyć z serwerem: %s\n", strerror(error));
+	}
+
+	return sock;
+}
+
+int http_do_request(http_request_t *req, http_response_t *resp, long start)
+{
+	int i, sock, status, progress;
+	long deadline = 0;
+	char address[INET6_ADDRSTRLEN];
+	FILE *fsock;
+	addrinfo_t *ptr;
+	const char *key, *encoding;
+	void *value;
+
+	if (req->hr_transfer_timeout)
+		deadline = start + req->hr_transfer_timeout;
+
+	if (req->hr_connect_timeout && (!deadline || http_now() + req->hr_connect_timeout < deadline))
+		deadline = http_now() + req->hr_connect_timeout;
+
+	if ((sock = http_connect(req, deadline, &ptr)) < 0)
+		return FALSE;
+
+	resp->hs_timing.ht_connect = http_now() - start;
+
+	if (ptr->ai_family == AF_INET6) {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ptr->ai_addr;
+		inet_ntop(AF_INET6, &sin6->sin6_addr, address, sizeof(address));
+		xprintf("Łączę się z [%s]:%d...\n", address, ntohs(sin6->sin6_port));
+	} else {
+		struct sockaddr_in *sin = (struct sockaddr_in *)ptr->ai_addr;
+		inet_ntop(AF_INET, &sin->sin_addr, address, sizeof(address));
+		xprintf("Łączę się z %s:%d...\n", address, ntohs(sin->sin_port));
+	}
+
+	if (!(fsock = http_conn_open(req, sock, start, deadline,
+	    req->hr_transfer_timeout ? start + req->hr_transfer_timeout : 0, &resp->hs_timing)))
+		return FALSE;
+
+	fprintf(fsock, "GET /%s HTTP/1.1\r\n", req->hr_path);
+
+	FOREACH_HASH(req->hr_headers, i, key, value) {
+		fprintf(fsock, "%s: %s\r\n", key, (char *)value);
+	}
+
+	fprintf(fsock, "Host: %s\r\n\r\n", req->hr_hostname);
+	fflush(fsock);
+
+	if (fscanf(fsock, "HTTP/1.%*1d %3d %*[^\r\n]\r\n", &status) < 1) {
+		if (ferror(fsock) && errno == ETIMEDOUT)
+			FAIL("http: przekroczono limit czasu oczekiwania na odpowiedź serwera.\n");
+		else
+			FAIL("http: niepoprawna odpowiedź serwera.\n");
+
+		errno = EINVAL;
+		fclose(fsock);
+		return FALSE;
+	}
+
+	/* Nagłówki poprzedniego ogniwa przekierowań nie dotyczą tej odpowiedzi. */
+	hash_free(resp->hs_headers, TRUE, FALSE);
+	resp->hs_headers = hash_init();
+
+	while (1) {
+		char *line = xfgetln(fsock);
+		char name[LINEMAX], value[LINEMAX];
+
+		if (line[0] == '\n') {
+			free(line);
+			break;
 		}
-		
-		xprintf("pobieram:     ");
-
-		if (!strcmp(hash_get_string(resp->hs_headers, "Transfer-Encoding"), "chunked")) {
-			/* 
-			 * Odpowiedź jest zakodowana jako "chunki", zgodnie ze specyfikacją
-			 * HTTP/1.1 - RFC2616.
-			 */
-			xread_chunked(fsock, &(resp->hs_body), http_read_callback);
-		} else {
-			/*
-			 * Odpowiedź odczytujemy tak jak w HTTP/1.0, oczekując końca strumienia
-			 * (zamknięcia połączenia przez drugą stronę).
-			 */
-			int nbytes = hash_key_exists(resp->hs_headers, "Content-Length")
-				? atoi(hash_get_string(resp->hs_headers, "Content-Length"))
-				: -1;
-			
-			xread(fsock, &(resp->hs_body), (nbytes ? nbytes : -1), http_read_callback);
+
+		if (sscanf(line, "%[^:\n]: %[^\r\n]\r\n", name, value) < 2) {
+			free(line);
+			break;
 		}
-		
-		xprintf("\n");
+
+		hash_set(resp->hs_headers, xstrdup(name), (void *)xstrdup(value), TRUE);	
+		free(line);
+	}
+	
+	if (HTTP_IS_REDIRECT(status)) {
 		fclose(fsock);
-		return status;
+
+		if (!http_follow_redirect(req, resp, status))
+			return FALSE;
+
+		return http_do_request(req, resp, start);
 	}
 	
-	FAIL("nie udało się znaleźć odpowiedniego serwera.\n");
-	return FALSE;
+	if ((encoding = http_get_header(resp, "Transfer-Encoding")) && !strcasecmp(encoding, "chunked")) {
+		/* 
+		 * Odpowiedź jest zakodowana jako "chunki", zgodnie ze specyfikacją
+		 * HTTP/1.1 - RFC2616.
+		 */
+		progress = progress_start(req->hr_name ? req->hr_name : req->hr_hostname, -1);
+		xread_chunked(fsock, &(resp->hs_body), http_read_callback, &progress);
+	} else {
+		/*
+		 * Odpowiedź odczytujemy tak jak w HTTP/1.0, oczekując końca strumienia
+		 * (zamknięcia połączenia przez drugą stronę).
+		 */
+		const char *length = http_get_header(resp, "Content-Length");
+		int nbytes = length ? atoi(length) : -1;
+
+		progress = progress_start(req->hr_name ? req->hr_name : req->hr_hostname, nbytes);
+		xread(fsock, &(resp->hs_body), (nbytes ? nbytes : -1), http_read_callback, &progress);
+	}
+
+	progress_finish(progress);
+
+	if (ferror(fsock) && errno == ETIMEDOUT)
+		FAIL("http: przekroczono limit czasu transferu, odpowiedź jest niekompletna.\n");
+
+	fclose(fsock);
+	resp->hs_timing.ht_total = http_now() - start;
+	return status;
 }
 
-void http_read_callback(int nbytes, int count)
+/*
+ * Postęp odczytu treści odpowiedzi; arg wskazuje numer pobrania
+ * (zob. progress_start()).
+ */
+void http_read_callback(void *arg, int nbytes, int count)
 {
-	if (count != -1) {
-		int x = (double)nbytes / (double)count * 100.0;
-		printf("\b\b\b\b%3d%%", x);
-		fflush(stdout);
-	} else {
-		printf("\b\b\b\b%2dKB", nbytes / 1024);
-		fflush(stdout);
-	}
+	progress_update(*(int *)arg, nbytes);
 }
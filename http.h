@@ -10,14 +10,26 @@
 #include <stdint.h>
 #include "utils.h"
 
+#define	HTTP_URL_REGEXP			"^([a-zA-Z][a-zA-Z0-9+.-]*)://([^/?#:]+)(:([0-9]*))?([^#]*)"
+#define	HTTP_MAX_REDIRECTS		5
+#define	HTTP_IS_REDIRECT(status)	((status) == 301 || (status) == 302 || (status) == 303 || \
+					 (status) == 307 || (status) == 308)
+#define	HTTP_IS_PERMANENT(status)	((status) == 301 || (status) == 308)
+#define	HTTP_ATTEMPT_DELAY		250	/* ms, RFC 8305 "Connection Attempt Delay" */
+#define	HTTP_DEFAULT_CONNECT_TIMEOUT	10000
+#define	HTTP_DEFAULT_FIRST_BYTE_TIMEOUT	15000
+#define	HTTP_DEFAULT_TRANSFER_TIMEOUT	60000
+
 struct http_uri;
 struct http_request;
 struct http_response;
+struct http_timing;
 
 typedef struct addrinfo addrinfo_t;
 typedef struct http_uri http_uri_t;
 typedef struct http_request http_request_t;
 typedef struct http_response http_response_t;
+typedef struct http_timing http_timing_t;
 
 struct http_uri
 {
@@ -27,14 +39,36 @@ struct http_uri
         u_int16_t		hu_port;
 };
 
+/*
+ * Czasy poszczególnych etapów pobierania, w milisekundach od wysłania
+ * żądania (ht_connect, ht_first_byte) lub łącznie (ht_total). ht_tls to
+ * czas samej negocjacji TLS, ht_resumed - czy wznowiono zapamiętaną sesję.
+ */
+struct http_timing
+{
+	long			ht_connect;
+	long			ht_tls;
+	long			ht_first_byte;
+	long			ht_total;
+	int			ht_resumed;
+};
+
 struct http_request
 {
+	char			*hr_url;
+	char			*hr_name;	/* nazwa w postępie pobierania */
 	char			*hr_hostname;
 	char			*hr_path;
 	u_int16_t		hr_port;
 	hash_t			*hr_headers;
 	addrinfo_t		*hr_addrinfo;
 	http_response_t	*hr_response;
+	int			hr_connect_timeout;
+	int			hr_first_byte_timeout;
+	int			hr_transfer_timeout;
+	int			hr_tls;
+	int			hr_tls_verify;
+	char			*hr_tls_ca_file;
 };
 
 struct http_response
@@ -43,10 +77,17 @@ struct http_response
 	char			*hs_body;
 	hash_t			*hs_headers;
         http_request_t	*hs_request;
+	http_timing_t		hs_timing;
+	array_t			*hs_chain;	/* odwiedzone adresy */
+	int			hs_redirects;
+	int			hs_permanent;
+	char			*hs_location;	/* nowy stały adres (301/308) */
 };
 
 http_request_t *http_new_request(const char *, hash_t *);
 http_response_t *http_send_request(http_request_t *);
+char *http_canonicalize_url(const char *, const char *);
+const char *http_get_header(http_response_t *, const char *);
 void http_free_request(http_request_t *);
 
 #endif	/* __HTTP_H */
@@ -20,16 +20,28 @@
 #include "storage.h"
 #include "utils.h"
 #include "cli.h"
+#include "server.h"
+#include "progress.h"
+
+char *db_location;
 
 void usage();
 void version();
 
 void usage()
 {
-        fprintf(stderr, "Użycie: rss [-h] [-v] [-d <plik>]\n");
+        fprintf(stderr, "Użycie: rss [-h] [-v] [-s] [-t] [-d <plik>] [-c <polecenia> | -f <plik> | polecenie [argumenty]]\n");
 	fprintf(stderr, "\t-h - wyświetla ten komunikat.\n");
 	fprintf(stderr, "\t-v - wyświetla informacje o wersji.\n");
 	fprintf(stderr, "\t-d <ścieżka do pliku> - używa alternatywnego pliku z bazą danych (domyślnie ~/.rss.db).\n");
+	fprintf(stderr, "\t-s - uruchamia serwer zapytań na gniazdku <plik bazy>.sock.\n");
+	fprintf(stderr, "\t-c <polecenia> - wykonuje polecenia rozdzielone średnikami i kończy pracę.\n");
+	fprintf(stderr, "\t-f <plik> - wykonuje polecenia z pliku (po jednym w wierszu; '-' to\n");
+	fprintf(stderr, "\t\tstandardowe wejście, wiersze od '#' są pomijane) i kończy pracę.\n");
+	fprintf(stderr, "\t-t - po wykonaniu poleceń wypisuje czasy uruchomienia i wykonania.\n");
+	fprintf(stderr, "\tpolecenie - wykonuje jedno polecenie i kończy pracę.\n");
+	fprintf(stderr, "\tW trybie wsadowym polecenia view, list, search i update wykonuje\n");
+	fprintf(stderr, "\tserwer, jeśli działa.\n");
 	exit(EXIT_SUCCESS);
 }
 
@@ -39,26 +51,117 @@ void version()
 	xprintf("(c) 2008 Adrian Jamróz.\n");
 }
 
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Wykonuje jedno polecenie: obsługiwane przez serwer - przez działający
+ * serwer, pozostałe (i wszystkie, gdy serwer nie działa) samodzielnie.
+ * Zwraca FALSE, jeśli polecenie się nie powiodło.
+ */
+int execute(const char *line)
+{
+	int status;
+
+	line += strspn(line, " \t");
+
+	if (server_serves(line) && (status = server_request(line)) >= 0)
+		return status == EXIT_SUCCESS;
+
+	return cli_execute(line);
+}
+
+/*
+ * Wykonuje polecenia rozdzielone średnikami (wszystkie, także po błędzie).
+ */
+int execute_list(char *commands)
+{
+	char *command;
+	int ret = TRUE;
+
+	while ((command = strsep(&commands, ";"))) {
+		if (!execute(command))
+			ret = FALSE;
+	}
+
+	return ret;
+}
+
+int execute_file(const char *path)
+{
+	FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	char *line = NULL;
+	size_t size = 0;
+	int ret = TRUE;
+
+	if (!f) {
+		FAIL("Nie można otworzyć pliku %s: %s\n", path, strerror(errno));
+		return FALSE;
+	}
+
+	while (getline(&line, &size, f) >= 0) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (line[strspn(line, " \t")] == '#')
+			continue;
+
+		if (!execute_list(line))
+			ret = FALSE;
+	}
+
+	free(line);
+
+	if (f != stdin)
+		fclose(f);
+
+	return ret;
+}
+
 int main(int argc, char** argv) 
 {
-	int ch;
+	int ch, i, serve = FALSE, timings = FALSE, ret;
+	size_t len = 1;
+	char *line = NULL, *commands = NULL, *script = NULL;
 	struct passwd *pwd;
-	struct stat dbstat;
+	struct timespec start, ready, end;
 	db_location = NULL;
 	
-        while ((ch = getopt(argc, argv, "hd:v")) != -1) {
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+        while ((ch = getopt(argc, argv, "+c:f:hd:stv")) != -1) {
 		switch (ch) { 
 			case 'h':
 				usage();
 				break;
             
+			case 'c':
+				commands = optarg;
+				break;
+
+			case 'f':
+				script = optarg;
+				break;
+
 			case 'd':
 				db_location = xstrdup(optarg);
 				break;
 			
+			case 's':
+				serve = TRUE;
+				break;
+
+			case 't':
+				timings = TRUE;
+				break;
+
 			case 'v':
 				version();
 				exit(EXIT_SUCCESS);
+
+			default:
+				usage();
 		}
 	}
 	
@@ -67,12 +170,66 @@ int main(int argc, char** argv)
 		asprintf(&db_location, "%s/%s", pwd->pw_dir, RSS_DB_FILENAME);
 	}
 	
-	if (stat(db_location, &dbstat) < 0) {
-		if (errno == ENOENT) 
-			storage_initialize(storage_get());
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			len += strlen(argv[i]) + 1;
+
+		line = xmalloc(len);
+		*line = '\0';
+
+		for (i = optind; i < argc; i++) {
+			if (i > optind)
+				strcat(line, " ");
+			strcat(line, argv[i]);
+		}
 	}
-	
-	version();
-	cli_mainloop();
-	return EXIT_SUCCESS;
+
+	if (!!commands + !!script + !!line > 1) {
+		FAIL("Można podać tylko jedno z: -c, -f, polecenie.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Serwer otwiera bazę od razu; pozostałe tryby przy pierwszym użyciu. */
+	if (serve) {
+		progress_disable();
+		cli_batch();
+		storage_get();
+		server_run();
+	}
+
+	if (!commands && !script && !line) {
+		version();
+		cli_mainloop();
+		return EXIT_SUCCESS;
+	}
+
+	/* W trybie wsadowym nie pokazujemy postępu pobierania ani nie pytamy. */
+	progress_disable();
+	cli_batch();
+
+	clock_gettime(CLOCK_MONOTONIC, &ready);
+
+	if (commands)
+		ret = execute_list(commands);
+	else if (script)
+		ret = execute_file(script);
+	else
+		ret = execute(line);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (timings) {
+		fprintf(stderr, "Czasy: uruchomienie %.2f ms, polecenia %.2f ms",
+		    elapsed(&start, &ready) * 1000, elapsed(&ready, &end) * 1000);
+
+		if (storage_opened())
+			fprintf(stderr, " (w tym otwarcie bazy %.2f ms)", storage_get()->sh_open_time * 1000);
+
+		fprintf(stderr, ".\n");
+	}
+
+	if (storage_opened())
+		storage_close(storage_get());
+
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,294 @@
+/*
+ * File:   mem.c
+ * Author: Adrian Jamróz
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+
+#ifdef MEM_ACCOUNTING
+
+/*
+ * Tutaj zawsze potrzebujemy prawdziwego free(), nie mem_free().
+ */
+#undef free
+
+/*
+ * Rozliczanie pamięci przydzielanej przez xmalloc() i pokrewne (budowa
+ * z -DMEM_ACCOUNTING, "make MEM=1"). Każdy żywy blok ma wpis w tablicy
+ * wskaźników (adresowanie otwarte), wskazujący miejsce przydziału
+ * (plik:wiersz). Podsystem to nazwa pliku bez rozszerzenia. Wskaźniki
+ * spoza tablicy (libxml2, sqlite3, readline) mem_free() po prostu zwalnia.
+ */
+#define	MEM_PTR_MIN_SLOTS	4096
+#define	MEM_SITE_SLOTS		1024
+#define	MEM_TAGS_MAX		32
+#define	MEM_TOMBSTONE		((void *)1)
+
+struct mem_site
+{
+	const char	*ms_file;
+	int		ms_line;
+	int		ms_tag;
+	size_t		ms_live;
+	size_t		ms_blocks;
+	unsigned long	ms_allocs;
+};
+
+struct mem_tag
+{
+	char		mt_name[16];
+	size_t		mt_live;
+	size_t		mt_peak;
+	size_t		mt_blocks;
+	unsigned long	mt_allocs;
+};
+
+struct mem_ptr
+{
+	void		*mp_ptr;
+	size_t		mp_size;
+	struct mem_site	*mp_site;
+};
+
+static struct mem_ptr	*mem_ptrs;
+static size_t		mem_ptr_slots, mem_ptr_used;
+static struct mem_site	mem_sites[MEM_SITE_SLOTS];
+static struct mem_tag	mem_tags[MEM_TAGS_MAX];
+static int		mem_tag_count;
+static size_t		mem_live, mem_peak, mem_blocks;
+static unsigned long	mem_allocs, mem_frees;
+
+static size_t mem_ptr_hash(const void *ptr)
+{
+	return (size_t)(((uintptr_t)ptr >> 4) * 11400714819323198485ULL);
+}
+
+static int mem_tag_id(const char *file)
+{
+	const char *base = strrchr(file, '/'), *dot;
+	int i, len;
+
+	base = base ? base + 1 : file;
+	dot = strchr(base, '.');
+	len = dot ? dot - base : strlen(base);
+
+	if (len > sizeof(mem_tags[0].mt_name) - 1)
+		len = sizeof(mem_tags[0].mt_name) - 1;
+
+	for (i = 0; i < mem_tag_count; i++) {
+		if (!strncmp(mem_tags[i].mt_name, base, len) && !mem_tags[i].mt_name[len])
+			return i;
+	}
+
+	if (mem_tag_count == MEM_TAGS_MAX)
+		return MEM_TAGS_MAX - 1;
+
+	memcpy(mem_tags[mem_tag_count].mt_name, base, len);
+	return mem_tag_count++;
+}
+
+static struct mem_site *mem_site(const char *file, int line)
+{
+	size_t i = (mem_ptr_hash(file) + line * 31) % MEM_SITE_SLOTS, n;
+
+	for (n = 0; n < MEM_SITE_SLOTS; n++, i = (i + 1) % MEM_SITE_SLOTS) {
+		if (!mem_sites[i].ms_file) {
+			mem_sites[i].ms_file = file;
+			mem_sites[i].ms_line = line;
+			mem_sites[i].ms_tag = mem_tag_id(file);
+			return &mem_sites[i];
+		}
+
+		if (mem_sites[i].ms_file == file && mem_sites[i].ms_line == line)
+			return &mem_sites[i];
+	}
+
+	/* Tablica miejsc pełna: reszta trafia do ostatniego wpisu. */
+	return &mem_sites[MEM_SITE_SLOTS - 1];
+}
+
+static struct mem_ptr *mem_ptr_find(const void *ptr)
+{
+	size_t i, mask = mem_ptr_slots - 1;
+
+	if (!mem_ptrs)
+		return NULL;
+
+	for (i = mem_ptr_hash(ptr) & mask; mem_ptrs[i].mp_ptr; i = (i + 1) & mask) {
+		if (mem_ptrs[i].mp_ptr == ptr)
+			return &mem_ptrs[i];
+	}
+
+	return NULL;
+}
+
+static void mem_ptr_insert(void *ptr, size_t size, struct mem_site *site)
+{
+	size_t i, mask;
+
+	if (mem_ptr_used * 2 >= mem_ptr_slots) {
+		struct mem_ptr *old = mem_ptrs;
+		size_t j, old_slots = mem_ptr_slots;
+
+		/* Przy wielu usuniętych wpisach wystarczy przebudowa bez powiększania. */
+		mem_ptr_slots = !old_slots ? MEM_PTR_MIN_SLOTS : (mem_blocks * 4 < old_slots ? old_slots : old_slots * 2);
+		mem_ptrs = calloc(mem_ptr_slots, sizeof(struct mem_ptr));
+		XASSERT(mem_ptrs);
+		mem_ptr_used = 0;
+
+		for (j = 0; j < old_slots; j++) {
+			if (old[j].mp_ptr && old[j].mp_ptr != MEM_TOMBSTONE)
+				mem_ptr_insert(old[j].mp_ptr, old[j].mp_size, old[j].mp_site);
+		}
+
+		free(old);
+	}
+
+	mask = mem_ptr_slots - 1;
+	for (i = mem_ptr_hash(ptr) & mask; mem_ptrs[i].mp_ptr && mem_ptrs[i].mp_ptr != MEM_TOMBSTONE; i = (i + 1) & mask)
+		;
+
+	if (!mem_ptrs[i].mp_ptr)
+		mem_ptr_used++;
+
+	mem_ptrs[i].mp_ptr = ptr;
+	mem_ptrs[i].mp_size = size;
+	mem_ptrs[i].mp_site = site;
+}
+
+static void mem_account(void *ptr, size_t size, const char *file, int line)
+{
+	struct mem_site *site = mem_site(file, line);
+	struct mem_tag *tag = &mem_tags[site->ms_tag];
+
+	mem_ptr_insert(ptr, size, site);
+	site->ms_live += size;
+	site->ms_blocks++;
+	site->ms_allocs++;
+	tag->mt_live += size;
+	tag->mt_blocks++;
+	tag->mt_allocs++;
+	mem_live += size;
+	mem_blocks++;
+	mem_allocs++;
+
+	if (tag->mt_live > tag->mt_peak)
+		tag->mt_peak = tag->mt_live;
+
+	if (mem_live > mem_peak)
+		mem_peak = mem_live;
+}
+
+/*
+ * Usuwa wpis bloku; zwraca FALSE dla wskaźnika spoza tablicy.
+ */
+static int mem_forget(void *ptr)
+{
+	struct mem_ptr *entry = mem_ptr_find(ptr);
+	struct mem_tag *tag;
+
+	if (!entry)
+		return FALSE;
+
+	tag = &mem_tags[entry->mp_site->ms_tag];
+	entry->mp_site->ms_live -= entry->mp_size;
+	entry->mp_site->ms_blocks--;
+	tag->mt_live -= entry->mp_size;
+	tag->mt_blocks--;
+	mem_live -= entry->mp_size;
+	mem_blocks--;
+	mem_frees++;
+	entry->mp_ptr = MEM_TOMBSTONE;
+	return TRUE;
+}
+
+void *mem_malloc(size_t nbytes, const char *file, int line)
+{
+	void *ptr = malloc(nbytes);
+	XASSERT(ptr);
+	mem_account(ptr, nbytes, file, line);
+	return ptr;
+}
+
+void *mem_calloc(size_t nbytes, const char *file, int line)
+{
+	void *ptr = calloc(1, nbytes);
+	XASSERT(ptr);
+	mem_account(ptr, nbytes, file, line);
+	return ptr;
+}
+
+void *mem_realloc(void *ptr, size_t nbytes, const char *file, int line)
+{
+	if (ptr)
+		mem_forget(ptr);
+
+	ptr = realloc(ptr, nbytes);
+	XASSERT(ptr);
+	mem_account(ptr, nbytes, file, line);
+	return ptr;
+}
+
+char *mem_strdup(const char *str, const char *file, int line)
+{
+	size_t len = strlen(str) + 1;
+	return memcpy(mem_malloc(len, file, line), str, len);
+}
+
+void mem_free(void *ptr)
+{
+	if (ptr)
+		mem_forget(ptr);
+
+	free(ptr);
+}
+
+static int mem_site_compare(const void *a, const void *b)
+{
+	const struct mem_site *x = *(const struct mem_site **)a, *y = *(const struct mem_site **)b;
+
+	if (x->ms_live != y->ms_live)
+		return x->ms_live < y->ms_live ? 1 : -1;
+
+	return x->ms_allocs < y->ms_allocs ? 1 : (x->ms_allocs > y->ms_allocs ? -1 : 0);
+}
+
+void mem_report(FILE *f, int top)
+{
+	struct mem_site *sites[MEM_SITE_SLOTS];
+	int i, count = 0;
+
+	fprintf(f, "Pamięć: bieżąco %zu B w %zu blokach, szczyt %zu B; przydziałów %lu, zwolnień %lu.\n",
+	    mem_live, mem_blocks, mem_peak, mem_allocs, mem_frees);
+	fprintf(f, "\npodsystem     bieżąco [B]   szczyt [B]    bloki   przydziały\n");
+
+	for (i = 0; i < mem_tag_count; i++)
+		fprintf(f, "%-12s %12zu %12zu %8zu %12lu\n", mem_tags[i].mt_name, mem_tags[i].mt_live,
+		    mem_tags[i].mt_peak, mem_tags[i].mt_blocks, mem_tags[i].mt_allocs);
+
+	for (i = 0; i < MEM_SITE_SLOTS; i++) {
+		if (mem_sites[i].ms_file)
+			sites[count++] = &mem_sites[i];
+	}
+
+	qsort(sites, count, sizeof(sites[0]), mem_site_compare);
+	fprintf(f, "\nNajwiększe miejsca przydziału (wg pamięci bieżącej):\n");
+
+	for (i = 0; i < count && i < top; i++)
+		fprintf(f, "  %s:%-*d %12zu B %8zu bloków %10lu przydziałów\n", sites[i]->ms_file,
+		    (int)(20 - strlen(sites[i]->ms_file)), sites[i]->ms_line,
+		    sites[i]->ms_live, sites[i]->ms_blocks, sites[i]->ms_allocs);
+}
+
+#else
+
+void mem_report(FILE *f, int top)
+{
+	fprintf(f, "Program zbudowano bez rozliczania pamięci; aby je włączyć, użyj \"make MEM=1\".\n");
+}
+
+#endif	/* MEM_ACCOUNTING */
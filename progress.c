@@ -0,0 +1,209 @@
+/*
+ * File:   progress.c
+ * Author: Adrian Jamróz
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "utils.h"
+#include "progress.h"
+
+/*
+ * Postęp pobierania. Stan wszystkich trwających pobrań zbieramy w
+ * tablicy, a wiersz z podsumowaniem (bajty, procent, szybkość, pozostały
+ * czas) rysujemy co najwyżej raz na PROGRESS_FRAME ms, zamiast przy
+ * każdym odczycie. Wiersz pojawia się tylko na terminalu i dopiero, gdy
+ * pobieranie trwa dłużej niż jedną klatkę; po zakończeniu ostatniego
+ * pobrania jest czyszczony. W trybie wsadowym postęp jest wyłączony.
+ */
+static struct progress_transfer	progress_transfers[PROGRESS_SLOTS];
+static int			progress_disabled, progress_drawn;
+static long			progress_last;
+
+static long progress_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void progress_size(char *buf, size_t size, long bytes)
+{
+	if (bytes < 1024)
+		snprintf(buf, size, "%ld B", bytes);
+	else if (bytes < 1024 * 1024)
+		snprintf(buf, size, "%.1f KB", bytes / 1024.0);
+	else
+		snprintf(buf, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+}
+
+/*
+ * Obcina wiersz (UTF-8) do szerokości terminala.
+ */
+static void progress_fit(char *line)
+{
+	struct winsize ws;
+	int columns = 80, n = 0;
+	char *p;
+
+	if (!ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) && ws.ws_col)
+		columns = ws.ws_col;
+
+	for (p = line; *p; p++) {
+		if ((*p & 0xc0) != 0x80 && ++n == columns) {
+			*p = '\0';
+			break;
+		}
+	}
+}
+
+static void progress_draw(long now)
+{
+	struct progress_transfer *pt;
+	char line[1024], done[16], total[16], rate[16];
+	long sum_done = 0, sum_total = 0, eta;
+	double speed = 0;
+	int i, count = 0, len;
+
+	for (i = 0; i < PROGRESS_SLOTS; i++) {
+		pt = &progress_transfers[i];
+
+		if (!pt->pt_active)
+			continue;
+
+		count++;
+		sum_done += pt->pt_done;
+		sum_total = sum_total < 0 || pt->pt_total < 0 ? -1 : sum_total + pt->pt_total;
+
+		if (now > pt->pt_start)
+			speed += pt->pt_done * 1000.0 / (now - pt->pt_start);
+	}
+
+	for (i = 0; count == 1 && !progress_transfers[i].pt_active; i++)
+		;
+
+	progress_size(done, sizeof(done), sum_done);
+	progress_size(rate, sizeof(rate), speed);
+
+	if (count == 1)
+		len = snprintf(line, sizeof(line), "pobieram %s: ", progress_transfers[i].pt_name);
+	else
+		len = snprintf(line, sizeof(line), "pobieram (%d): ", count);
+
+	if (sum_total > 0) {
+		progress_size(total, sizeof(total), sum_total);
+		len += snprintf(line + len, sizeof(line) - len, "%3d%%, %s z %s, %s/s",
+		    (int)(sum_done * 100 / sum_total), done, total, rate);
+
+		if (speed > 0 && sum_total > sum_done) {
+			eta = (sum_total - sum_done) / speed + 1;
+
+			if (eta < 60)
+				len += snprintf(line + len, sizeof(line) - len, ", jeszcze %ld s", eta);
+			else
+				len += snprintf(line + len, sizeof(line) - len, ", jeszcze %ld min %02ld s", eta / 60, eta % 60);
+		}
+	} else {
+		len += snprintf(line + len, sizeof(line) - len, "%s, %s/s", done, rate);
+	}
+
+	/* Przy kilku pobraniach dopisujemy stan każdego z nich. */
+	for (i = 0; count > 1 && i < PROGRESS_SLOTS && len < sizeof(line); i++) {
+		pt = &progress_transfers[i];
+
+		if (!pt->pt_active)
+			continue;
+
+		if (pt->pt_total > 0) {
+			len += snprintf(line + len, sizeof(line) - len, " | %s %d%%", pt->pt_name,
+			    (int)(pt->pt_done * 100 / pt->pt_total));
+		} else {
+			progress_size(done, sizeof(done), pt->pt_done);
+			len += snprintf(line + len, sizeof(line) - len, " | %s %s", pt->pt_name, done);
+		}
+	}
+
+	progress_fit(line);
+	printf("\r%s\033[K", line);
+	fflush(stdout);
+	progress_drawn = TRUE;
+	progress_last = now;
+}
+
+/*
+ * Wyłącza wyświetlanie postępu (tryb wsadowy, serwer).
+ */
+void progress_disable()
+{
+	progress_disabled = TRUE;
+}
+
+/*
+ * Rejestruje pobranie o podanej nazwie i rozmiarze (total < 0, gdy
+ * nieznany). Zwraca numer pobrania albo -1, gdy postępu nie wyświetlamy.
+ */
+int progress_start(const char *name, long total)
+{
+	struct progress_transfer *pt;
+	int i;
+
+	if (progress_disabled || !isatty(STDOUT_FILENO))
+		return -1;
+
+	for (i = 0; i < PROGRESS_SLOTS; i++) {
+		pt = &progress_transfers[i];
+
+		if (pt->pt_active)
+			continue;
+
+		pt->pt_active = TRUE;
+		pt->pt_done = 0;
+		pt->pt_total = total;
+		pt->pt_start = progress_now();
+		snprintf(pt->pt_name, sizeof(pt->pt_name), "%s", name);
+		return i;
+	}
+
+	return -1;
+}
+
+void progress_update(int id, long done)
+{
+	long now;
+
+	if (id < 0)
+		return;
+
+	progress_transfers[id].pt_done = done;
+	now = progress_now();
+
+	if (now - progress_last >= PROGRESS_FRAME && now - progress_transfers[id].pt_start >= PROGRESS_FRAME)
+		progress_draw(now);
+}
+
+void progress_finish(int id)
+{
+	int i;
+
+	if (id < 0)
+		return;
+
+	progress_transfers[id].pt_active = FALSE;
+
+	if (!progress_drawn)
+		return;
+
+	for (i = 0; i < PROGRESS_SLOTS; i++) {
+		if (progress_transfers[i].pt_active) {
+			progress_draw(progress_now());
+			return;
+		}
+	}
+
+	printf("\r\033[K");
+	fflush(stdout);
+	progress_drawn = FALSE;
+}
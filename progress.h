@@ -0,0 +1,30 @@
+/*
+ * File:   progress.h
+ * Author: Adrian Jamróz
+ */
+
+#ifndef __PROGRESS_H
+#define	__PROGRESS_H
+
+#define	PROGRESS_SLOTS		16	/* jednocześnie śledzonych pobrań */
+#define	PROGRESS_FRAME		100	/* ms między kolejnymi klatkami */
+#define	PROGRESS_NAME_MAX	32
+
+/*
+ * Stan jednego pobrania; pt_total < 0, gdy rozmiar nie jest znany.
+ */
+struct progress_transfer
+{
+	int	pt_active;
+	char	pt_name[PROGRESS_NAME_MAX];
+	long	pt_done;
+	long	pt_total;
+	long	pt_start;
+};
+
+void	progress_disable();
+int	progress_start(const char *, long);
+void	progress_update(int, long);
+void	progress_finish(int);
+
+#endif	/* __PROGRESS_H */
@@ -0,0 +1,325 @@
+/*
+ * File:   render.c
+ * Author: Adrian Jamróz
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "utils.h"
+#include "feed.h"
+#include "render.h"
+
+/*
+ * Wypisywanie wiadomości. Tekst składamy we wspólnym buforze, który
+ * trafia do pliku (stdout albo pager) dużymi blokami, zamiast kilku
+ * wywołań fprintf() na wiadomość. Daty formatujemy raz na dobę (zob.
+ * render_date()).
+ */
+static char	render_buffer[RENDER_BUFFER_SIZE];
+static size_t	render_used;
+
+#define	render_literal(r, s)	render_append(r, s, sizeof(s) - 1)
+
+static const char *render_formats[] = { "human", "ndjson", "tsv" };
+
+/*
+ * Numer formatu o podanej nazwie (zmienna output_format); -1 dla
+ * nieznanej nazwy.
+ */
+int render_format(const char *name)
+{
+	int i;
+
+	for (i = 0; i < N(render_formats); i++) {
+		if (!strcmp(render_formats[i], name))
+			return i;
+	}
+
+	return -1;
+}
+
+static void render_flush(render_t *r)
+{
+	if (render_used)
+		fwrite(render_buffer, 1, render_used, r->r_file);
+
+	render_used = 0;
+}
+
+static void render_append(render_t *r, const char *data, size_t len)
+{
+	if (len > RENDER_BUFFER_SIZE - render_used) {
+		render_flush(r);
+
+		if (len > RENDER_BUFFER_SIZE) {
+			fwrite(data, 1, len, r->r_file);
+			return;
+		}
+	}
+
+	memcpy(render_buffer + render_used, data, len);
+	render_used += len;
+}
+
+static void render_string(render_t *r, const char *s)
+{
+	if (s)
+		render_append(r, s, strlen(s));
+}
+
+/*
+ * Liczba dziesiętnie, wyrównana do prawej do szerokości width.
+ */
+static void render_int(render_t *r, long long value, int width)
+{
+	char buf[32], *p = buf + sizeof(buf);
+	unsigned long long v = value < 0 ? -(unsigned long long)value : value;
+
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	if (value < 0)
+		*--p = '-';
+
+	while (buf + sizeof(buf) - p < width && p > buf)
+		*--p = ' ';
+
+	render_append(r, p, buf + sizeof(buf) - p);
+}
+
+static void render_two_digits(render_t *r, int value)
+{
+	char buf[2] = { '0' + value / 10, '0' + value % 10 };
+
+	render_append(r, buf, 2);
+}
+
+/*
+ * Dopisuje datę: przedrostek doby (format strftime()) i godzinę HH:MM
+ * lub HH:MM:SS. Przedrostek liczymy raz na dobę, a godzinę z odległości
+ * od jej początku. Doby ze zmianą czasu (różne przesunięcie względem UTC
+ * na początku i końcu) formatujemy w całości dla każdej daty.
+ */
+static void render_date(render_t *r, struct render_day *day, time_t t, int utc, const char *format, int seconds)
+{
+	struct tm tm, first, last;
+	time_t end;
+	char full[160], buf[256];
+	long since;
+
+	if (!day->rd_length || t < day->rd_start || t >= day->rd_start + UNIX_DAY) {
+		utc ? gmtime_r(&t, &tm) : localtime_r(&t, &tm);
+		day->rd_start = t - (tm.tm_hour * UNIX_HOUR + tm.tm_min * 60 + tm.tm_sec);
+		day->rd_length = strftime(day->rd_prefix, sizeof(day->rd_prefix), format, &tm);
+		day->rd_cacheable = TRUE;
+
+		if (!utc) {
+			end = day->rd_start + UNIX_DAY - 1;
+			localtime_r(&day->rd_start, &first);
+			localtime_r(&end, &last);
+			day->rd_cacheable = first.tm_gmtoff == tm.tm_gmtoff && last.tm_gmtoff == tm.tm_gmtoff;
+		}
+	}
+
+	if (!day->rd_cacheable) {
+		localtime_r(&t, &tm);
+		snprintf(full, sizeof(full), "%s%s", format, seconds ? "%H:%M:%S" : "%H:%M");
+		render_append(r, buf, strftime(buf, sizeof(buf), full, &tm));
+		return;
+	}
+
+	since = t - day->rd_start;
+	render_append(r, day->rd_prefix, day->rd_length);
+	render_two_digits(r, since / UNIX_HOUR);
+	render_literal(r, ":");
+	render_two_digits(r, since / 60 % 60);
+
+	if (seconds) {
+		render_literal(r, ":");
+		render_two_digits(r, since % 60);
+	}
+}
+
+static void render_json_string(render_t *r, const char *s)
+{
+	const char *p, *run;
+	char escape[8];
+
+	render_literal(r, "\"");
+
+	for (run = p = s ? s : ""; *p; p++) {
+		unsigned char c = *p;
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		render_append(r, run, p - run);
+		run = p + 1;
+
+		switch (c) {
+			case '"': render_literal(r, "\\\""); break;
+			case '\\': render_literal(r, "\\\\"); break;
+			case '\n': render_literal(r, "\\n"); break;
+			case '\r': render_literal(r, "\\r"); break;
+			case '\t': render_literal(r, "\\t"); break;
+			default:
+				snprintf(escape, sizeof(escape), "\\u%04x", c);
+				render_append(r, escape, 6);
+		}
+	}
+
+	render_append(r, run, p - run);
+	render_literal(r, "\"");
+}
+
+/*
+ * Pole TSV: tabulator, znaki końca wiersza i ukośnik odwrotny zapisujemy
+ * jako \t, \n, \r i \\.
+ */
+static void render_tsv_field(render_t *r, const char *s)
+{
+	const char *p, *run;
+
+	for (run = p = s ? s : ""; *p; p++) {
+		if (*p != '\t' && *p != '\n' && *p != '\r' && *p != '\\')
+			continue;
+
+		render_append(r, run, p - run);
+		run = p + 1;
+
+		switch (*p) {
+			case '\t': render_literal(r, "\\t"); break;
+			case '\n': render_literal(r, "\\n"); break;
+			case '\r': render_literal(r, "\\r"); break;
+			default: render_literal(r, "\\\\");
+		}
+	}
+
+	render_append(r, run, p - run);
+}
+
+static void render_human(render_t *r, const feed_entry_t *fe)
+{
+	if (r->r_brief) {
+		if (r->r_colors)
+			render_literal(r, "\033[1m");
+
+		render_int(r, fe->fe_id, 8);
+		render_string(r, r->r_colors ? "\033[0m " : " ");
+		render_date(r, &r->r_local_brief, fe->fe_pubdate, FALSE, "%Y-%m-%d ", FALSE);
+		render_literal(r, " ");
+		render_string(r, fe->fe_feed);
+		render_string(r, r->r_colors ? ": \033[1;31m" : ": ");
+		render_string(r, fe->fe_title);
+		render_string(r, r->r_colors ? "\033[0m\n         " : "\n         ");
+		render_string(r, fe->fe_url);
+		render_literal(r, "\n");
+		return;
+	}
+
+	if (r->r_colors) {
+		render_literal(r, "\033[1mŹródło: ");
+		render_string(r, fe->fe_feed);
+		render_literal(r, "\033[0m\n\033[1mData: ");
+		render_date(r, &r->r_local, fe->fe_pubdate, FALSE, "%A, %d %B %Y, ", TRUE);
+		render_literal(r, " \033[0m\n\033[1mURL: ");
+		render_string(r, fe->fe_url);
+		render_literal(r, "\033[0m\n\033[1;31m");
+		render_string(r, fe->fe_title);
+		render_literal(r, "\033[0m\n");
+	} else {
+		render_literal(r, "Źródło: ");
+		render_string(r, fe->fe_feed);
+		render_literal(r, "\nData: ");
+		render_date(r, &r->r_local, fe->fe_pubdate, FALSE, "%A, %d %B %Y, ", TRUE);
+		render_literal(r, "\nURL: ");
+		render_string(r, fe->fe_url);
+		render_literal(r, "\nTytuł: ");
+		render_string(r, fe->fe_title);
+		render_literal(r, "\n");
+	}
+
+	render_string(r, fe->fe_snippet ? fe->fe_snippet : fe->fe_description);
+	render_literal(r, "\n\n");
+}
+
+static void render_ndjson(render_t *r, const feed_entry_t *fe)
+{
+	render_literal(r, "{\"id\":");
+	render_int(r, fe->fe_id, 0);
+	render_literal(r, ",\"feed\":");
+	render_json_string(r, fe->fe_feed);
+	render_literal(r, ",\"pubdate\":");
+	render_int(r, fe->fe_pubdate, 0);
+	render_literal(r, ",\"date\":\"");
+	render_date(r, &r->r_utc, fe->fe_pubdate, TRUE, "%Y-%m-%dT", TRUE);
+	render_literal(r, "Z\",\"title\":");
+	render_json_string(r, fe->fe_title);
+	render_literal(r, ",\"url\":");
+	render_json_string(r, fe->fe_url);
+
+	if (fe->fe_snippet) {
+		render_literal(r, ",\"snippet\":");
+		render_json_string(r, fe->fe_snippet);
+	} else if (!r->r_brief) {
+		render_literal(r, ",\"description\":");
+		render_json_string(r, fe->fe_description);
+	}
+
+	render_literal(r, "}\n");
+}
+
+/*
+ * Kolumny: id, data (ISO 8601, UTC), źródło, tytuł, adres, opis (przy
+ * wyszukiwaniu fragment z trafieniami, przy brief pusty).
+ */
+static void render_tsv(render_t *r, const feed_entry_t *fe)
+{
+	render_int(r, fe->fe_id, 0);
+	render_literal(r, "\t");
+	render_date(r, &r->r_utc, fe->fe_pubdate, TRUE, "%Y-%m-%dT", TRUE);
+	render_literal(r, "Z\t");
+	render_tsv_field(r, fe->fe_feed);
+	render_literal(r, "\t");
+	render_tsv_field(r, fe->fe_title);
+	render_literal(r, "\t");
+	render_tsv_field(r, fe->fe_url);
+	render_literal(r, "\t");
+	render_tsv_field(r, fe->fe_snippet ? fe->fe_snippet : (r->r_brief ? NULL : fe->fe_description));
+	render_literal(r, "\n");
+}
+
+void render_begin(render_t *r, FILE *file, int format, int colors, int brief)
+{
+	memset(r, 0, sizeof(*r));
+	r->r_file = file;
+	r->r_format = format;
+	r->r_colors = colors;
+	r->r_brief = brief;
+}
+
+void render_entry(render_t *r, const feed_entry_t *fe)
+{
+	switch (r->r_format) {
+		case RENDER_NDJSON:
+			render_ndjson(r, fe);
+			break;
+
+		case RENDER_TSV:
+			render_tsv(r, fe);
+			break;
+
+		default:
+			render_human(r, fe);
+	}
+}
+
+void render_end(render_t *r)
+{
+	render_flush(r);
+	fflush(r->r_file);
+}
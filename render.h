@@ -0,0 +1,49 @@
+/*
+ * File:   render.h
+ * Author: Adrian Jamróz
+ */
+
+#ifndef __RENDER_H
+#define	__RENDER_H
+
+#include <stdio.h>
+#include <time.h>
+#include "feed.h"
+
+#define	RENDER_HUMAN		0	/* tekst dla człowieka (kolory, pager) */
+#define	RENDER_NDJSON		1	/* jeden obiekt JSON w wierszu */
+#define	RENDER_TSV		2	/* pola rozdzielone tabulatorami */
+
+#define	RENDER_BUFFER_SIZE	(256 * 1024)
+
+/*
+ * Zapamiętany początek doby: wiadomości z tej samej doby dostają gotowy
+ * przedrostek daty, a godzinę liczymy z przesunięcia w sekundach.
+ */
+struct render_day
+{
+	time_t	rd_start;
+	int	rd_cacheable;
+	size_t	rd_length;
+	char	rd_prefix[128];
+};
+
+struct render
+{
+	FILE			*r_file;
+	int			r_format;
+	int			r_colors;
+	int			r_brief;
+	struct render_day	r_local;	/* data w 'view' */
+	struct render_day	r_local_brief;	/* data w 'view brief' */
+	struct render_day	r_utc;		/* data ISO 8601 w NDJSON i TSV */
+};
+
+typedef struct render render_t;
+
+int	render_format(const char *);
+void	render_begin(render_t *, FILE *, int, int, int);
+void	render_entry(render_t *, const feed_entry_t *);
+void	render_end(render_t *);
+
+#endif	/* __RENDER_H */
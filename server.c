@@ -0,0 +1,370 @@
+/*
+ * File:   server.c
+ * Author: Adrian Jamróz
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "globals.h"
+#include "utils.h"
+#include "cli.h"
+#include "server.h"
+
+/*
+ * Serwer zapytań ("rss -s"): trzyma otwartą bazę (z wczytanym schematem)
+ * i pamięci podręczne źródeł, zmiennych i ostatnich wiadomości, a
+ * polecenia od klientów wykonuje na gniazdku uniksowym <baza>.sock.
+ * Klientem jest "rss <polecenie>": jeśli serwer działa, wysyła mu
+ * polecenie i wypisuje odpowiedź, a bez serwera wykonuje je sam.
+ * Polecenia obsługujemy po kolei, jedno na raz; klient, który w ciągu
+ * SERVER_TIMEOUT s nie przyśle całej ramki albo nie odbiera odpowiedzi,
+ * jest rozłączany, by nie blokował pozostałych.
+ */
+static const char *server_commands[] = { "view", "list", "search", "update" };
+
+static char	*server_path;
+static FILE	*server_out, *server_err;
+static int	server_stdout = -1, server_stderr = -1;
+
+/*
+ * Czy serwer wykonuje polecenie (pierwsze słowo wiersza).
+ */
+int server_serves(const char *line)
+{
+	size_t len = strcspn(line, " ");
+	int i;
+
+	for (i = 0; i < N(server_commands); i++) {
+		if (strlen(server_commands[i]) == len && !strncmp(server_commands[i], line, len))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static char *server_socket_path()
+{
+	struct sockaddr_un addr;
+
+	if (!server_path) {
+		server_path = xmalloc(strlen(db_location) + strlen(SERVER_SOCKET_SUFFIX) + 1);
+		sprintf(server_path, "%s%s", db_location, SERVER_SOCKET_SUFFIX);
+	}
+
+	return strlen(server_path) < sizeof(addr.sun_path) ? server_path : NULL;
+}
+
+static int server_address(struct sockaddr_un *addr)
+{
+	const char *path = server_socket_path();
+
+	if (!path)
+		return FALSE;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return TRUE;
+}
+
+static int server_connect()
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (!server_address(&addr) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int server_write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (len) {
+		if ((n = send(fd, p, len, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return FALSE;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+static long server_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Czyta len bajtów; deadline (ms, server_now()) ogranicza czas czekania,
+ * 0 - bez ograniczenia.
+ */
+static int server_read_all(int fd, void *data, size_t len, long deadline)
+{
+	struct pollfd pfd = { fd, POLLIN };
+	char *p = data;
+	ssize_t n;
+	long left;
+
+	while (len) {
+		if (deadline) {
+			if ((left = deadline - server_now()) <= 0)
+				return FALSE;
+
+			if ((n = poll(&pfd, 1, left)) <= 0) {
+				if (n < 0 && errno == EINTR)
+					continue;
+
+				return FALSE;
+			}
+		}
+
+		if ((n = read(fd, p, len)) <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+
+			return FALSE;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+static int server_write_frame(int fd, char type, const void *data, size_t len)
+{
+	unsigned char header[5];
+
+	header[0] = type;
+	header[1] = len >> 24;
+	header[2] = len >> 16;
+	header[3] = len >> 8;
+	header[4] = len;
+
+	return server_write_all(fd, header, sizeof(header)) && server_write_all(fd, data, len);
+}
+
+/*
+ * Wczytuje ramkę; treść (zakończona zerem) do zwolnienia przez
+ * wywołującego. NULL przy końcu połączenia, błędnej ramce lub gdy cała
+ * ramka nie nadeszła w ciągu timeout s (0 - czekamy bez końca).
+ */
+static char *server_read_frame(int fd, char *type, size_t *len, int timeout)
+{
+	long deadline = timeout ? server_now() + timeout * 1000L : 0;
+	unsigned char header[5];
+	char *data;
+
+	if (!server_read_all(fd, header, sizeof(header), deadline))
+		return NULL;
+
+	*type = header[0];
+	*len = (size_t)header[1] << 24 | header[2] << 16 | header[3] << 8 | header[4];
+
+	if (*len > SERVER_FRAME_MAX)
+		return NULL;
+
+	data = xmalloc(*len + 1);
+	data[*len] = '\0';
+
+	if (!server_read_all(fd, data, *len, deadline)) {
+		free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/*
+ * Wysyła polecenie do działającego serwera i wypisuje odpowiedź.
+ * Zwraca status polecenia albo -1, gdy serwer nie działa.
+ */
+int server_request(const char *line)
+{
+	int fd = server_connect(), status = -1;
+	size_t len;
+	char type, *data;
+
+	if (fd < 0)
+		return -1;
+
+	if (!server_write_frame(fd, SERVER_FRAME_COMMAND, line, strlen(line))) {
+		close(fd);
+		return -1;
+	}
+
+	while ((data = server_read_frame(fd, &type, &len, 0))) {
+		if (type == SERVER_FRAME_STDOUT)
+			fwrite(data, 1, len, stdout);
+
+		if (type == SERVER_FRAME_STDERR)
+			fwrite(data, 1, len, stderr);
+
+		if (type == SERVER_FRAME_STATUS)
+			status = len ? data[0] : 0;
+
+		free(data);
+
+		if (type == SERVER_FRAME_STATUS)
+			break;
+	}
+
+	if (status < 0) {
+		FAIL("Serwer zakończył połączenie przed końcem odpowiedzi.\n");
+		status = EXIT_FAILURE;
+	}
+
+	close(fd);
+	return status;
+}
+
+/*
+ * Przesyła klientowi przechwycone wyjście i opróżnia plik. Zwraca FALSE,
+ * gdy klient przestał odbierać.
+ */
+static int server_send_output(int client, FILE *file, char type)
+{
+	char buf[SERVER_FRAME_MAX];
+	int fd = fileno(file), ret = TRUE;
+	ssize_t n;
+
+	lseek(fd, 0, SEEK_SET);
+
+	while (ret && (n = read(fd, buf, sizeof(buf))) > 0)
+		ret = server_write_frame(client, type, buf, n);
+
+	if (ftruncate(fd, 0) < 0)
+		FAIL("Nie udało się opróżnić pliku z wyjściem polecenia: %s\n", strerror(errno));
+
+	lseek(fd, 0, SEEK_SET);
+	return ret;
+}
+
+/*
+ * Wykonuje polecenie klienta; standardowe wyjście i wyjście błędów
+ * trafiają na ten czas do plików tymczasowych.
+ */
+static void server_execute(int client, const char *line)
+{
+	char status = EXIT_SUCCESS;
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(fileno(server_out), STDOUT_FILENO);
+	dup2(fileno(server_err), STDERR_FILENO);
+
+	if (!server_serves(line)) {
+		fprintf(stderr, "Serwer nie wykonuje polecenia '%.*s'.\n", (int)strcspn(line, " "), line);
+		status = EXIT_FAILURE;
+	} else if (!cli_execute(line)) {
+		status = EXIT_FAILURE;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(server_stdout, STDOUT_FILENO);
+	dup2(server_stderr, STDERR_FILENO);
+
+	if (server_send_output(client, server_out, SERVER_FRAME_STDOUT) &&
+	    server_send_output(client, server_err, SERVER_FRAME_STDERR))
+		server_write_frame(client, SERVER_FRAME_STATUS, &status, 1);
+}
+
+static void server_stop(int signo)
+{
+	unlink(server_path);
+	_exit(EXIT_SUCCESS);
+}
+
+void server_run()
+{
+	struct timeval timeout = { SERVER_TIMEOUT, 0 };
+	struct sockaddr_un addr;
+	int fd, client;
+	mode_t mask;
+	size_t len;
+	char type, *line;
+
+	if (!server_address(&addr)) {
+		FAIL("Ścieżka gniazdka serwera jest za długa: %s\n", server_path);
+		exit(EXIT_FAILURE);
+	}
+
+	if ((fd = server_connect()) >= 0) {
+		close(fd);
+		FAIL("Serwer dla tej bazy już działa (%s).\n", server_path);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Gniazdko po serwerze, który nie zdążył po sobie posprzątać. */
+	unlink(server_path);
+
+	mask = umask(077);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+		FAIL("Nie udało się utworzyć gniazdka %s: %s\n", server_path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	umask(mask);
+	server_out = tmpfile();
+	server_err = tmpfile();
+	server_stdout = dup(STDOUT_FILENO);
+	server_stderr = dup(STDERR_FILENO);
+
+	if (!server_out || !server_err) {
+		FAIL("Nie udało się utworzyć plików tymczasowych: %s\n", strerror(errno));
+		server_stop(0);
+	}
+
+	signal(SIGINT, server_stop);
+	signal(SIGTERM, server_stop);
+	signal(SIGPIPE, SIG_IGN);
+	fprintf(stderr, "Serwer nasłuchuje na %s.\n", server_path);
+
+	while (1) {
+		if ((client = accept(fd, NULL, NULL)) < 0)
+			continue;
+
+		/* Zapis odpowiedzi do klienta, który jej nie odbiera, też ograniczamy. */
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		while ((line = server_read_frame(client, &type, &len, SERVER_TIMEOUT))) {
+			if (type == SERVER_FRAME_COMMAND)
+				server_execute(client, line);
+
+			free(line);
+		}
+
+		close(client);
+	}
+}
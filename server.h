@@ -0,0 +1,27 @@
+/*
+ * File:   server.h
+ * Author: Adrian Jamróz
+ */
+
+#ifndef __SERVER_H
+#define	__SERVER_H
+
+/*
+ * Ramka protokołu: typ (1 bajt), długość treści (4 bajty, big endian)
+ * i treść. Klient wysyła polecenia (SERVER_FRAME_COMMAND), serwer
+ * odpowiada wyjściem polecenia i kończy odpowiedź ramką statusu.
+ */
+#define	SERVER_FRAME_COMMAND	'C'	/* wiersz polecenia */
+#define	SERVER_FRAME_STDOUT	'O'	/* fragment standardowego wyjścia */
+#define	SERVER_FRAME_STDERR	'E'	/* fragment wyjścia błędów */
+#define	SERVER_FRAME_STATUS	'S'	/* koniec odpowiedzi; 1 bajt statusu */
+
+#define	SERVER_FRAME_MAX	(64 * 1024)
+#define	SERVER_TIMEOUT		5	/* s na ramkę od klienta */
+#define	SERVER_SOCKET_SUFFIX	".sock"
+
+int	server_serves(const char *);
+int	server_request(const char *);
+void	server_run();
+
+#endif	/* __SERVER_H */
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <sqlite3.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -14,19 +16,217 @@
 #include "storage.h"
 #include "globals.h"
 
+static storage_codec_stats_t storage_stats;
+
+/*
+ * Słowniki i przedrostki adresów wczytane z bazy, w tablicach indeksowanych
+ * ich id (klucze główne są gęste). Zapisanych wpisów nigdy nie zmieniamy,
+ * więc mogą zostać w pamięci do końca pracy programu.
+ */
+struct storage_blob
+{
+	void	*sb_data;
+	int	sb_size;
+};
+
+struct storage_cache
+{
+	struct storage_blob	*sc_data;
+	size_t			sc_slots;
+	const char		*sc_query;
+};
+
+static struct storage_cache storage_dictionaries = { NULL, 0, "SELECT data FROM dictionaries WHERE id = %d" };
+static struct storage_cache storage_prefixes = { NULL, 0, "SELECT prefix FROM url_prefixes WHERE id = %d" };
+
+/*
+ * Id pochodzi z zakodowanej wartości kolumny, więc w uszkodzonej bazie może
+ * być dowolne; słowników i przedrostków jest najwyżej kilka tysięcy.
+ */
+static struct storage_blob *storage_cached(storage_handle_t *handle, struct storage_cache *cache, uint32_t id)
+{
+	storage_stmt_t *stmt;
+	char *sql;
+	size_t slots;
+
+	if (id >= STORAGE_CACHE_MAX_ID)
+		return NULL;
+
+	if (id >= cache->sc_slots) {
+		for (slots = cache->sc_slots ? cache->sc_slots : 64; slots <= id; slots *= 2)
+			;
+
+		cache->sc_data = xrealloc(cache->sc_data, slots * sizeof(struct storage_blob));
+		memset(cache->sc_data + cache->sc_slots, 0, (slots - cache->sc_slots) * sizeof(struct storage_blob));
+		cache->sc_slots = slots;
+	}
+
+	if (cache->sc_data[id].sb_data)
+		return &cache->sc_data[id];
+
+	sql = sqlite3_mprintf(cache->sc_query, id);
+	stmt = storage_query(handle, sql);
+	sqlite3_free(sql);
+
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		cache->sc_data[id].sb_size = sqlite3_column_bytes(stmt, 0);
+		cache->sc_data[id].sb_data = xmalloc(cache->sc_data[id].sb_size + 1);
+		memcpy(cache->sc_data[id].sb_data, sqlite3_column_blob(stmt, 0), cache->sc_data[id].sb_size);
+	}
+
+	storage_finalize(stmt);
+	return cache->sc_data[id].sb_data ? &cache->sc_data[id] : NULL;
+}
+
+static uint32_t storage_get32(const uint8_t *data)
+{
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static void storage_put32(uint8_t *data, uint32_t value)
+{
+	data[0] = value;
+	data[1] = value >> 8;
+	data[2] = value >> 16;
+	data[3] = value >> 24;
+}
+
+/*
+ * Funkcja SQL rss_url_prefix(x): id przedrostka zakodowanego adresu, dla
+ * pozostałych wartości 0 (takiego id nie ma).
+ */
+static void storage_sql_url_prefix(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+	int type = sqlite3_value_type(argv[0]);
+	const uint8_t *data = type == SQLITE_BLOB ? sqlite3_value_blob(argv[0]) : NULL;
+
+	if (data && sqlite3_value_bytes(argv[0]) >= STORAGE_CODEC_PREFIX_HEADER && data[0] == STORAGE_CODEC_PREFIX)
+		sqlite3_result_int64(ctx, storage_get32(data + 1));
+	else
+		sqlite3_result_int(ctx, 0);
+}
+
+/*
+ * Funkcja SQL rss_inflate(x): zwraca tekst zakodowanej wartości kolumny
+ * (opisu albo adresu); wartości niezakodowane zwraca bez zmian.
+ */
+static void storage_sql_inflate(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+	storage_handle_t *handle = sqlite3_user_data(ctx);
+	struct storage_blob *blob = NULL;
+	struct timespec start, end;
+	const uint8_t *data;
+	uint32_t size;
+	char *out;
+	int len;
+
+	if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+		sqlite3_result_value(ctx, argv[0]);
+		return;
+	}
+
+	data = sqlite3_value_blob(argv[0]);
+	len = sqlite3_value_bytes(argv[0]);
+
+	if (len >= STORAGE_CODEC_PREFIX_HEADER && data[0] == STORAGE_CODEC_PREFIX) {
+		if (!(blob = storage_cached(handle, &storage_prefixes, storage_get32(data + 1)))) {
+			sqlite3_result_error(ctx, "rss_inflate: nieznany przedrostek adresu", -1);
+			return;
+		}
+
+		len -= STORAGE_CODEC_PREFIX_HEADER;
+		out = sqlite3_malloc(blob->sb_size + len + 1);
+		memcpy(out, blob->sb_data, blob->sb_size);
+		memcpy(out + blob->sb_size, data + STORAGE_CODEC_PREFIX_HEADER, len);
+		sqlite3_result_text(ctx, out, blob->sb_size + len, sqlite3_free);
+		return;
+	}
+
+	if (len < STORAGE_CODEC_DEFLATE_HEADER || data[0] != STORAGE_CODEC_DEFLATE) {
+		sqlite3_result_value(ctx, argv[0]);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (storage_get32(data + 1) && !(blob = storage_cached(handle, &storage_dictionaries, storage_get32(data + 1)))) {
+		sqlite3_result_error(ctx, "rss_inflate: nieznany słownik", -1);
+		return;
+	}
+
+	/* Długość też pochodzi z bazy; sqlite3_malloc() przyjmuje int. */
+	if ((size = storage_get32(data + 5)) > STORAGE_CODEC_MAX_TEXT) {
+		sqlite3_result_error(ctx, "rss_inflate: uszkodzony opis", -1);
+		return;
+	}
+
+	if (!(out = sqlite3_malloc(size + 1))) {
+		sqlite3_result_error_nomem(ctx);
+		return;
+	}
+
+	if (!zlib_decompress(data + STORAGE_CODEC_DEFLATE_HEADER, len - STORAGE_CODEC_DEFLATE_HEADER,
+	    blob ? blob->sb_data : NULL, blob ? blob->sb_size : 0, out, size)) {
+		sqlite3_free(out);
+		sqlite3_result_error(ctx, "rss_inflate: uszkodzony opis", -1);
+		return;
+	}
+
+	sqlite3_result_text(ctx, out, size, sqlite3_free);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	storage_stats.cs_decoded++;
+	storage_stats.cs_decoded_bytes += size;
+	storage_stats.cs_decode_time += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * Globalny wskaźnik do otwartej bazy danych sqlite3.
+ */
+static storage_handle_t *storage_current = NULL;
+
+/*
+ * Zwraca bazę danych, przy pierwszym użyciu otwierając ją (nową tworzy,
+ * starszą aktualizuje). Polecenia, które bazy nie potrzebują, jej nie
+ * otwierają.
+ */
 storage_handle_t *storage_get()
 {
-        /*
-	 * Globalny wskaźnik do otwartej bazy danych sqlite3.
-	*/
-	static storage_handle_t *handle = NULL;
+	struct timespec start, end;
+	int exists;
+
+	if (!storage_current) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		exists = !access(db_location, F_OK);
+		storage_current = xmalloc(sizeof(storage_handle_t));
+		storage_current->sh_data_version = NULL;
+		sqlite3_open(db_location, &(storage_current->sh_db));
 
-	if (!handle) {
-		handle = xmalloc(sizeof(storage_handle_t));
-		sqlite3_open(db_location, &(handle->sh_db));
+		/*
+		 * INSERT OR REPLACE usuwa kolidujący wiersz; bez tej opcji nie
+		 * uruchomiłby wyzwalaczy liczników (posts_counters_delete).
+		 */
+		sqlite3_exec(storage_current->sh_db, "PRAGMA recursive_triggers = ON", NULL, NULL, NULL);
+
+		/* Używana w wyzwalaczach i widokach partycji (storage.h). */
+		sqlite3_create_function(storage_current->sh_db, "rss_inflate", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+		    storage_current, storage_sql_inflate, NULL, NULL);
+		sqlite3_create_function(storage_current->sh_db, "rss_url_prefix", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+		    NULL, storage_sql_url_prefix, NULL, NULL);
+
+		if (!exists)
+			storage_initialize(storage_current);
+
+		storage_upgrade(storage_current);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		storage_current->sh_open_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 	}
 	
-	return handle;
+	return storage_current;
+}
+
+int storage_opened()
+{
+	return storage_current != NULL;
 }
 
 storage_stmt_t *storage_query(storage_handle_t *handle, const char *query)
@@ -46,7 +246,11 @@ storage_stmt_t *storage_query(storage_handle_t *handle, const char *query)
 	return (storage_stmt_t *)stmt;
 }
 
-int storage_step(storage_stmt_t *stmt, hash_t **row)
+/*
+ * Jak storage_step(), ale wiersz (słownik, nazwy i wartości kolumn) jest
+ * przydzielany z podanej areny i znika razem z nią.
+ */
+int storage_step_arena(storage_stmt_t *stmt, arena_t *arena, hash_t **row)
 {
 	int i, ret, ncols = sqlite3_column_count(stmt);
 	void *data;
@@ -60,21 +264,29 @@ int storage_step(storage_stmt_t *stmt, hash_t **row)
 	if (!row || ret == SQLITE_DONE)
 		return ret;
 	
-	*row = hash_init();
+	*row = hash_init_arena(arena);
 	
 	for (i = 0; i < ncols; i++) {	
 		switch (sqlite3_column_type(stmt, i)) {
 			case SQLITE_INTEGER:
-				data = xintdup(sqlite3_column_int(stmt, i));
+				if (arena) {
+					data = arena_alloc(arena, sizeof(int64_t));
+					*(int64_t *)data = sqlite3_column_int64(stmt, i);
+				} else {
+					data = xint64dup(sqlite3_column_int64(stmt, i));
+				}
 				break;
 				
 			case SQLITE_NULL:
 				data = NULL;
 				break;
 
+			case SQLITE_FLOAT:
 			case SQLITE_BLOB:
 			case SQLITE_TEXT:
-				data = xstrdup((char *)sqlite3_column_text(stmt, i));
+				data = arena
+				    ? arena_strdup(arena, (char *)sqlite3_column_text(stmt, i))
+				    : xstrdup((char *)sqlite3_column_text(stmt, i));
 				break;
 				
 			default:
@@ -82,12 +294,19 @@ int storage_step(storage_stmt_t *stmt, hash_t **row)
 				exit(EXIT_FAILURE);
 		}
 		
-		hash_set(*row, xstrdup(sqlite3_column_name(stmt, i)), data, TRUE);
+		hash_set(*row, arena
+		    ? arena_strdup(arena, sqlite3_column_name(stmt, i))
+		    : xstrdup(sqlite3_column_name(stmt, i)), data, TRUE);
 	}
 		
 	return ret;
 }
 
+int storage_step(storage_stmt_t *stmt, hash_t **row)
+{
+	return storage_step_arena(stmt, NULL, row);
+}
+
 void storage_finalize(storage_stmt_t *stmt)
 {
 	sqlite3_finalize(stmt);
@@ -99,6 +318,9 @@ void storage_initialize(storage_handle_t *handle)
 	char *sql;
 	char *error;
 	
+	/* Musi poprzedzać utworzenie pierwszej tabeli. */
+	sqlite3_exec(handle->sh_db, "PRAGMA auto_vacuum = INCREMENTAL", NULL, NULL, NULL);
+
 	if (sqlite3_exec(handle->sh_db, STORAGE_CREATE_CONFIG_SQL, NULL, NULL, &error) != SQLITE_OK)
 	    goto fail;
 	
@@ -126,8 +348,669 @@ fail:
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Nazwa partycji obejmującej podany czas: posts_RRRRMM (miesiące w UTC).
+ */
+void storage_partition_name(time_t when, char *name)
+{
+	struct tm tm;
+
+	gmtime_r(&when, &tm);
+	snprintf(name, STORAGE_PARTITION_NAME_MAX, "posts_%04d%02d", tm.tm_year + 1900, tm.tm_mon + 1);
+}
+
+static void storage_partition_range(time_t when, time_t *start, time_t *end)
+{
+	struct tm tm;
+
+	gmtime_r(&when, &tm);
+	*start = days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, 1) * 86400L;
+	*end = (tm.tm_mon == 11
+	    ? days_from_civil(tm.tm_year + 1901, 1, 1)
+	    : days_from_civil(tm.tm_year + 1900, tm.tm_mon + 2, 1)) * 86400L;
+}
+
+/*
+ * Odtwarza widok posts jako sumę (UNION ALL) wszystkich partycji; opisów
+ * (tabele %s_body) widok nie obejmuje.
+ */
+static int storage_partitions_view(storage_handle_t *handle)
+{
+	char *sql = sqlite3_mprintf("DROP VIEW IF EXISTS posts; CREATE VIEW posts AS "), *saved_sql;
+	storage_stmt_t *stmt = storage_query(handle, "SELECT name FROM partitions ORDER BY start_time");
+	int ret, count = 0;
+
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		saved_sql = sql;
+		sql = sqlite3_mprintf("%s%sSELECT * FROM %s", sql, count++ ? " UNION ALL " : "",
+		    (const char *)sqlite3_column_text(stmt, 0));
+		sqlite3_free(saved_sql);
+	}
+
+	storage_finalize(stmt);
+
+	if (!count) {
+		sqlite3_free(sql);
+		sql = sqlite3_mprintf("DROP VIEW IF EXISTS posts; %s", STORAGE_CREATE_POSTS_EMPTY_BRIEF_VIEW_SQL);
+	}
+
+	ret = sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) == SQLITE_OK;
+	sqlite3_free(sql);
+	return ret;
+}
+
+/*
+ * Wykonuje polecenia z szablonów dla podanej partycji; każde polecenie
+ * używa nazwy partycji najwyżej siedem razy.
+ */
+static int storage_partition_exec(storage_handle_t *handle, const char *name, const char * const *templates, int count)
+{
+	char *sql;
+	int i, ret = TRUE;
+
+	for (i = 0; i < count && ret; i++) {
+		sql = sqlite3_mprintf(templates[i], name, name, name, name, name, name, name);
+		ret = sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) == SQLITE_OK;
+		sqlite3_free(sql);
+	}
+
+	return ret;
+}
+
+/*
+ * Zwraca nazwę partycji, do której należy wiadomość z podanego czasu,
+ * w razie potrzeby tworząc ją (tabela, indeksy, wyzwalacze, indeks FTS5).
+ * Nazwa leży w buforze statycznym; NULL oznacza błąd.
+ */
+const char *storage_partition(storage_handle_t *handle, time_t when)
+{
+	static char name[STORAGE_PARTITION_NAME_MAX];
+	time_t start, end;
+	storage_stmt_t *stmt;
+	char *sql;
+	int exists;
+
+	storage_partition_name(when, name);
+	sql = sqlite3_mprintf("SELECT 1 FROM partitions WHERE name = %Q", name);
+	stmt = storage_query(handle, sql);
+	exists = sqlite3_step(stmt) == SQLITE_ROW;
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+
+	if (exists)
+		return name;
+
+	storage_partition_range(when, &start, &end);
+	sqlite3_exec(handle->sh_db, "SAVEPOINT partition", NULL, NULL, NULL);
+
+	sql = NULL;
+
+	if (!storage_partition_exec(handle, name, storage_partition_sql, N(storage_partition_sql))
+	    || !storage_partition_exec(handle, name, storage_partition_fts_sql, N(storage_partition_fts_sql))
+	    || !storage_partition_exec(handle, name, storage_partition_trigger_sql, N(storage_partition_trigger_sql)))
+		goto fail;
+
+	sql = sqlite3_mprintf("INSERT INTO partitions VALUES (%Q, %lld, %lld)", name, (long long)start, (long long)end);
+
+	if (sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) != SQLITE_OK || !storage_partitions_view(handle))
+		goto fail;
+
+	sqlite3_free(sql);
+	sqlite3_exec(handle->sh_db, "RELEASE partition", NULL, NULL, NULL);
+	return name;
+
+fail:
+	FAIL("błąd sqlite3: nie udało się utworzyć partycji %s: %s\n", name, sqlite3_errmsg(handle->sh_db));
+	sqlite3_free(sql);
+	sqlite3_exec(handle->sh_db, "ROLLBACK TO partition; RELEASE partition", NULL, NULL, NULL);
+	return NULL;
+}
+
+/*
+ * Nazwy partycji, które mogą zawierać wiadomości z przedziału [from, to],
+ * w kolejności chronologicznej. Bez areny nazwy przydziela xstrdup().
+ */
+array_t *storage_partitions(storage_handle_t *handle, time_t from, time_t to, arena_t *arena)
+{
+	array_t *ret = array_init_arena(arena, 0);
+	char *sql = sqlite3_mprintf(
+		"SELECT name FROM partitions WHERE end_time > %lld AND start_time <= %lld ORDER BY start_time",
+		(long long)from, (long long)to);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 0);
+		array_append(ret, arena ? arena_strdup(arena, name) : xstrdup(name));
+	}
+
+	storage_finalize(stmt);
+	sqlite3_free(sql);
+	return ret;
+}
+
+/*
+ * Usuwa całą partycję razem z jej opisami i indeksem pełnotekstowym. Wyzwalacze
+ * liczników nie są przy tym wykonywane; liczniki poprawia wywołujący.
+ */
+int storage_partition_drop(storage_handle_t *handle, const char *name)
+{
+	char *sql = sqlite3_mprintf(
+		"SAVEPOINT partition;"
+		"DROP TABLE %s_fts;"
+		"DROP VIEW %s_text;"
+		"DROP TABLE %s;"
+		"DROP TABLE %s_body;"
+		"DELETE FROM partitions WHERE name = %Q;",
+		name, name, name, name, name);
+	int ret = sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) == SQLITE_OK && storage_partitions_view(handle);
+
+	if (!ret) {
+		FAIL("błąd sqlite3: nie udało się usunąć partycji %s: %s\n", name, sqlite3_errmsg(handle->sh_db));
+		sqlite3_exec(handle->sh_db, "ROLLBACK TO partition", NULL, NULL, NULL);
+	}
+
+	sqlite3_exec(handle->sh_db, "RELEASE partition", NULL, NULL, NULL);
+	sqlite3_free(sql);
+	return ret;
+}
+
+/*
+ * Nadaje identyfikator nowej wiadomości; identyfikatory rosną w całym
+ * archiwum i nie są używane ponownie (jak przy AUTOINCREMENT).
+ */
+int storage_next_id(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle, "UPDATE posts_sequence SET id = id + 1 RETURNING id");
+	int ret = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+
+	storage_finalize(stmt);
+	return ret;
+}
+
+/*
+ * Usuwa wyzwalacze partycji, jej widok %s_text i indeks FTS5; FALSE przy błędzie.
+ */
+static int storage_partition_drop_objects(storage_handle_t *handle, const char *partition)
+{
+	char *sql = sqlite3_mprintf(
+	    "SELECT 'DROP ' || type || ' ' || name FROM sqlite_master WHERE type = 'trigger' AND tbl_name IN (%Q, %Q || '_body')"
+	    " UNION ALL SELECT 'DROP TABLE IF EXISTS %s_fts'"
+	    " UNION ALL SELECT 'DROP VIEW IF EXISTS %s_text'", partition, partition, partition, partition);
+	storage_stmt_t *stmt = storage_query(handle, sql);
+	array_t *drops = array_init(0);
+	const char *drop;
+	int i, ret = TRUE;
+
+	sqlite3_free(sql);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		array_append(drops, xstrdup((const char *)sqlite3_column_text(stmt, 0)));
+
+	storage_finalize(stmt);
+
+	FOREACH_ARRAY(drops, i, drop) {
+		if (ret && sqlite3_exec(handle->sh_db, drop, NULL, NULL, NULL) != SQLITE_OK)
+			ret = FALSE;
+	}
+
+	array_free(drops, TRUE, FALSE);
+	return ret;
+}
+
+/*
+ * Czy któraś partycja ma jeszcze opisy w tabeli głównej (sprzed kroku 9).
+ */
+static int storage_partitions_outdated(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle,
+	    "SELECT 1 FROM partitions, pragma_table_info(partitions.name) AS c WHERE c.name = 'description' LIMIT 1");
+	int ret = sqlite3_step(stmt) == SQLITE_ROW;
+
+	storage_finalize(stmt);
+	return ret;
+}
+
+/*
+ * Przebudowuje wszystkie istniejące partycje wg bieżących szablonów:
+ * przenosi opisy do tabel %s_body, odtwarza wyzwalacze oraz (od nowa
+ * wypełniane) indeksy pełnotekstowe. ALTER TABLE sprawdza cały schemat,
+ * więc najpierw usuwamy wyzwalacze i widoki wszystkich partycji.
+ */
+static void storage_partition_rebuild(storage_handle_t *handle)
+{
+	array_t *partitions = storage_partitions(handle, 0, (time_t)INT64_MAX, NULL);
+	storage_stmt_t *stmt;
+	char *sql, *partition;
+	int i, split, ret = sqlite3_exec(handle->sh_db, "BEGIN; DROP VIEW posts;", NULL, NULL, NULL) == SQLITE_OK;
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		if (ret)
+			ret = storage_partition_drop_objects(handle, partition);
+	}
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		sql = sqlite3_mprintf("SELECT 1 FROM pragma_table_info(%Q) WHERE name = 'description'", partition);
+		stmt = storage_query(handle, sql);
+		split = sqlite3_step(stmt) == SQLITE_ROW;
+		storage_finalize(stmt);
+		sqlite3_free(sql);
+
+		if (ret && split)
+			ret = storage_partition_exec(handle, partition, storage_partition_split_sql, N(storage_partition_split_sql));
+	}
+
+	ret = ret && storage_partitions_view(handle);
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		if (!ret || !storage_partition_exec(handle, partition, storage_partition_fts_sql, N(storage_partition_fts_sql))
+		    || !storage_partition_exec(handle, partition, storage_partition_trigger_sql, N(storage_partition_trigger_sql))) {
+			FAIL("błąd sqlite3: nie udało się przebudować partycji %s: %s\n",
+			    partition, sqlite3_errmsg(handle->sh_db));
+			sqlite3_exec(handle->sh_db, "ROLLBACK", NULL, NULL, NULL);
+			exit(EXIT_FAILURE);
+		}
+
+		sql = sqlite3_mprintf("INSERT INTO %s_fts (%s_fts) VALUES ('rebuild')", partition, partition);
+		sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL);
+		sqlite3_free(sql);
+	}
+
+	sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+	array_free(partitions, TRUE, FALSE);
+}
+
+/*
+ * Odtwarza wyzwalacze liczników partycji utworzonych przed krokiem 10,
+ * które nie pomijają wiadomości z seen_posts.
+ */
+static void storage_partition_seen_upgrade(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle,
+	    "SELECT tbl_name FROM sqlite_master WHERE type = 'trigger' "
+	    "AND name = tbl_name || '_counters_delete' AND sql NOT LIKE '%seen_posts%'");
+	array_t *partitions = array_init(0);
+	char *partition;
+	int i, ret;
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		array_append(partitions, xstrdup((char *)sqlite3_column_text(stmt, 0)));
+
+	storage_finalize(stmt);
+	ret = !array_count(partitions) || sqlite3_exec(handle->sh_db, "BEGIN", NULL, NULL, NULL) == SQLITE_OK;
+
+	FOREACH_ARRAY(partitions, i, partition) {
+		if (ret)
+			ret = storage_partition_exec(handle, partition, storage_partition_seen_sql, N(storage_partition_seen_sql));
+	}
+
+	if (!ret) {
+		FAIL("błąd sqlite3: nie udało się odtworzyć wyzwalaczy partycji: %s\n", sqlite3_errmsg(handle->sh_db));
+		sqlite3_exec(handle->sh_db, "ROLLBACK", NULL, NULL, NULL);
+		exit(EXIT_FAILURE);
+	}
+
+	if (array_count(partitions))
+		sqlite3_exec(handle->sh_db, "COMMIT", NULL, NULL, NULL);
+
+	array_free(partitions, TRUE, FALSE);
+}
+
+/*
+ * Rozdziela wiadomości z tabeli posts sprzed podziału na partycje
+ * (krok 6 schematu) i odtwarza liczniki źródeł.
+ */
+static void storage_import_legacy(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle,
+	    "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'posts_legacy'");
+	array_t *months;
+	const char *name;
+	char *sql;
+	time_t start, end;
+	int i, *month, exists = sqlite3_step(stmt) == SQLITE_ROW;
+
+	storage_finalize(stmt);
+
+	if (!exists)
+		return;
+
+	sqlite3_exec(handle->sh_db,
+	    "BEGIN;"
+	    "CREATE INDEX posts_legacy_pubdate ON posts_legacy (pubdate);", NULL, NULL, NULL);
+
+	months = array_init(0);
+	stmt = storage_query(handle,
+	    "SELECT DISTINCT CAST(strftime('%Y%m', COALESCE(pubdate, 0), 'unixepoch') AS INTEGER) FROM posts_legacy");
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		array_append(months, xintdup(sqlite3_column_int(stmt, 0)));
+
+	storage_finalize(stmt);
+
+	FOREACH_ARRAY(months, i, month) {
+		start = days_from_civil(*month / 100, *month % 100, 1) * 86400L;
+
+		if (!(name = storage_partition(handle, start)))
+			goto fail;
+
+		storage_partition_range(start, &start, &end);
+		sql = sqlite3_mprintf(
+			"INSERT INTO %s_body (id, description) SELECT id, description FROM posts_legacy "
+			"WHERE COALESCE(pubdate, 0) >= %lld AND COALESCE(pubdate, 0) < %lld;"
+			"INSERT INTO %s (id, feed, pubdate, title, url, guid) "
+			"SELECT id, feed, pubdate, title, url, guid FROM posts_legacy "
+			"WHERE COALESCE(pubdate, 0) >= %lld AND COALESCE(pubdate, 0) < %lld",
+			name, (long long)start, (long long)end, name, (long long)start, (long long)end);
+
+		if (sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+			sqlite3_free(sql);
+			goto fail;
+		}
+
+		sqlite3_free(sql);
+	}
+
+	array_free(months, TRUE, FALSE);
+
+	/* Wyzwalacze partycji zliczyły wszystko jako nowe; liczymy od nowa. */
+	if (sqlite3_exec(handle->sh_db,
+	    "DROP TABLE posts_legacy;"
+	    "UPDATE feeds SET "
+	    "	total = (SELECT COUNT(*) FROM posts WHERE feed = feeds.name),"
+	    "	unseen = (SELECT COUNT(*) FROM posts WHERE feed = feeds.name AND id > feeds.seen),"
+	    "	newest = (SELECT MAX(pubdate) FROM posts WHERE feed = feeds.name),"
+	    "	oldest = (SELECT MIN(pubdate) FROM posts WHERE feed = feeds.name);"
+	    "COMMIT;", NULL, NULL, NULL) == SQLITE_OK)
+		return;
+
+	months = NULL;
+
+fail:
+	FAIL("błąd sqlite3: nie udało się podzielić wiadomości na partycje: %s\n", sqlite3_errmsg(handle->sh_db));
+	array_free(months, TRUE, FALSE);
+	sqlite3_exec(handle->sh_db, "ROLLBACK", NULL, NULL, NULL);
+	exit(EXIT_FAILURE);
+}
+
+void storage_upgrade(storage_handle_t *handle)
+{
+	int i, vacuum, version = 0;
+	char *sql, *error = NULL;
+	hash_t *row = NULL;
+	storage_stmt_t *stmt = storage_query(handle, "PRAGMA user_version");
+
+	if (storage_step(stmt, &row) == SQLITE_ROW) {
+		version = hash_get_int(row, "user_version");
+		hash_free(row, TRUE, FALSE);
+	}
+
+	storage_finalize(stmt);
+
+	for (i = version; i < N(storage_migrations); i++) {
+		sql = sqlite3_mprintf("BEGIN; %s PRAGMA user_version = %d; COMMIT;", storage_migrations[i], i + 1);
+
+		if (sqlite3_exec(handle->sh_db, sql, NULL, NULL, &error) != SQLITE_OK) {
+			FAIL("błąd sqlite3: nie udało się zaktualizować schematu bazy danych do wersji %d: %s\n", i + 1, error);
+			sqlite3_exec(handle->sh_db, "ROLLBACK", NULL, NULL, NULL);
+			exit(EXIT_FAILURE);
+		}
+
+		sqlite3_free(sql);
+	}
+
+	storage_import_legacy(handle);
+
+	/*
+	 * Partycje utworzone przed krokiem 9 mają opisy, wyzwalacze i indeksy
+	 * FTS5 w starej postaci. Sprawdzamy sam schemat, nie jego wersję, żeby
+	 * przerwana przebudowa została powtórzona przy następnym uruchomieniu.
+	 */
+	if (storage_partitions_outdated(handle)) {
+		xprintf("Przebudowa partycji i indeksów pełnotekstowych, to może chwilę potrwać...\n");
+		storage_partition_rebuild(handle);
+	}
+
+	storage_partition_seen_upgrade(handle);
+
+	/*
+	 * Starsze bazy trzeba raz przebudować, żeby zwolnione strony można było
+	 * oddawać stopniowo (storage_compact()).
+	 */
+	stmt = storage_query(handle, "PRAGMA auto_vacuum");
+	vacuum = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+	storage_finalize(stmt);
+
+	if (vacuum != STORAGE_AUTO_VACUUM_INCREMENTAL) {
+		xprintf("Przebudowa pliku bazy danych, to może chwilę potrwać...\n");
+
+		if (sqlite3_exec(handle->sh_db, "PRAGMA auto_vacuum = INCREMENTAL; VACUUM;", NULL, NULL, &error) != SQLITE_OK) {
+			FAIL("błąd sqlite3: nie udało się przebudować bazy danych: %s\n", error);
+			sqlite3_free(error);
+		}
+	}
+
+	/* Zmienne dodane w nowszych wersjach programu dostają wartości domyślne. */
+	for (i = 0; i < N(storage_variables); i++) {
+		sql = sqlite3_mprintf(
+		    "INSERT OR IGNORE INTO config VALUES (%Q, %Q)",
+		    storage_variables[i].name,
+		    storage_variables[i].value);
+		sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL);
+		sqlite3_free(sql);
+	}
+}
+
+/*
+ * Jeden ograniczony krok porządkowania pliku: oddaje systemowi najwyżej
+ * pages wolnych stron, przenosząc strony z końca pliku w wolne miejsca.
+ * Zwraca liczbę wolnych stron, które jeszcze zostały.
+ */
+int storage_compact(storage_handle_t *handle, int pages)
+{
+	storage_stmt_t *stmt = storage_query(handle, "PRAGMA freelist_count");
+	int ret = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+	char *sql;
+
+	storage_finalize(stmt);
+
+	if (!ret || pages <= 0)
+		return ret;
+
+	sql = sqlite3_mprintf("PRAGMA incremental_vacuum(%d)", pages < ret ? pages : ret);
+	sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL);
+	sqlite3_free(sql);
+	return pages < ret ? ret - pages : 0;
+}
+
+storage_codec_stats_t *storage_codec_stats()
+{
+	return &storage_stats;
+}
+
+/*
+ * Liczba stron bazy wczytanych z dysku (spoza pamięci podręcznej) od
+ * poprzedniego wywołania.
+ */
+int storage_cache_misses(storage_handle_t *handle)
+{
+	int current = 0, highwater;
+
+	sqlite3_db_status(handle->sh_db, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, TRUE);
+	return current;
+}
+
+/*
+ * Licznik zmian bazy zatwierdzonych przez inne połączenia (PRAGMA
+ * data_version); własnych zmian nie liczy.
+ */
+int storage_data_version(storage_handle_t *handle)
+{
+	int ret;
+
+	/* Sprawdzane przed każdym odczytem z pamięci podręcznych; bez ponownej kompilacji. */
+	if (!handle->sh_data_version)
+		handle->sh_data_version = storage_query(handle, "PRAGMA data_version");
+
+	ret = sqlite3_step(handle->sh_data_version) == SQLITE_ROW ? sqlite3_column_int(handle->sh_data_version, 0) : 0;
+	sqlite3_reset(handle->sh_data_version);
+	return ret;
+}
+
+static long storage_size(storage_handle_t *handle)
+{
+	storage_stmt_t *stmt = storage_query(handle,
+	    "SELECT page_count * page_size FROM pragma_page_count, pragma_page_size");
+	long ret = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+
+	storage_finalize(stmt);
+	return ret;
+}
+
+/*
+ * Przebudowuje cały plik bazy. Po przepisaniu wielu wierszy na krótsze
+ * (polecenie 'compress') strony tabel zostają w większości puste i samo
+ * oddawanie wolnych stron (storage_compact()) ich nie odzyska.
+ */
+int storage_vacuum(storage_handle_t *handle)
+{
+	long before = storage_size(handle);
+	char *error;
+
+	xprintf("Przebudowa pliku bazy danych, to może chwilę potrwać...\n");
+
+	if (sqlite3_exec(handle->sh_db, "VACUUM", NULL, NULL, &error) != SQLITE_OK) {
+		FAIL("błąd sqlite3: nie udało się przebudować bazy danych: %s\n", error);
+		sqlite3_free(error);
+		return FALSE;
+	}
+
+	xprintf("Rozmiar bazy danych: %ld KiB -> %ld KiB.\n", before / 1024, storage_size(handle) / 1024);
+	return TRUE;
+}
+
+/*
+ * Koduje opis słownikiem o podanym id (0 - bez słownika). Zwraca wartość
+ * do zapisania jako BLOB (zwalnia wywołujący) albo NULL, gdy kompresja
+ * się nie opłaca i tekst należy zapisać bez zmian.
+ */
+void *storage_encode_text(storage_handle_t *handle, int dictionary, const char *text, int *len)
+{
+	struct storage_blob *blob = dictionary ? storage_cached(handle, &storage_dictionaries, dictionary) : NULL;
+	size_t size = strlen(text), packed = 0;
+	uint8_t *data = NULL, *ret;
+
+	storage_stats.cs_text_bytes += size;
+
+	if (size >= STORAGE_CODEC_MIN_TEXT)
+		data = zlib_compress(text, size, blob ? blob->sb_data : NULL, blob ? blob->sb_size : 0, &packed);
+
+	if (!data || packed + STORAGE_CODEC_DEFLATE_HEADER >= size) {
+		free(data);
+		storage_stats.cs_encoded_bytes += size;
+		return NULL;
+	}
+
+	ret = xmalloc(packed + STORAGE_CODEC_DEFLATE_HEADER);
+	ret[0] = STORAGE_CODEC_DEFLATE;
+	storage_put32(ret + 1, blob ? dictionary : 0);
+	storage_put32(ret + 5, size);
+	memcpy(ret + STORAGE_CODEC_DEFLATE_HEADER, data, packed);
+	free(data);
+
+	*len = packed + STORAGE_CODEC_DEFLATE_HEADER;
+	storage_stats.cs_encoded++;
+	storage_stats.cs_encoded_bytes += *len;
+	return ret;
+}
+
+/*
+ * Koduje adres jako id przedrostka (do ostatniego '/' przed '?' i '#',
+ * bez ostatniego członu ścieżki, choćby kończył się '/') i resztę adresu.
+ * Zwraca NULL, gdy przedrostek jest zbyt krótki albo nie da się go zapisać
+ * z id poniżej STORAGE_CACHE_MAX_ID; adres zostaje wtedy tekstem.
+ */
+void *storage_encode_url(storage_handle_t *handle, const char *url, int *len)
+{
+	size_t size = strlen(url), prefix = strcspn(url, "?#");
+	const char *scheme = strstr(url, "://");
+	storage_stmt_t *stmt;
+	sqlite3_int64 id = 0;
+	uint8_t *ret;
+	char *sql;
+
+	/* Inaczej każdy adres zakończony '/' dodawałby własny przedrostek. */
+	if (prefix == size && prefix)
+		prefix--;
+
+	while (prefix && url[prefix - 1] != '/')
+		prefix--;
+
+	storage_stats.cs_url_bytes += size;
+
+	if (!scheme || prefix < STORAGE_CODEC_MIN_PREFIX || url + prefix <= scheme + 3)
+		goto plain;
+
+	sql = sqlite3_mprintf("SELECT id FROM url_prefixes WHERE prefix = %.*Q", (int)prefix, url);
+	stmt = storage_query(handle, sql);
+	sqlite3_free(sql);
+
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		id = sqlite3_column_int64(stmt, 0);
+
+	storage_finalize(stmt);
+
+	/* Po nieudanym INSERT last_insert_rowid wskazywałby cudzy przedrostek. */
+	if (!id) {
+		sql = sqlite3_mprintf("INSERT INTO url_prefixes (prefix) VALUES (%.*Q)", (int)prefix, url);
+
+		if (sqlite3_exec(handle->sh_db, sql, NULL, NULL, NULL) == SQLITE_OK)
+			id = sqlite3_last_insert_rowid(handle->sh_db);
+
+		sqlite3_free(sql);
+	}
+
+	/* Przedrostka spoza zakresu storage_cached() nie dałoby się odczytać. */
+	if (!id || id >= STORAGE_CACHE_MAX_ID)
+		goto plain;
+
+	*len = STORAGE_CODEC_PREFIX_HEADER + size - prefix;
+	ret = xmalloc(*len);
+	ret[0] = STORAGE_CODEC_PREFIX;
+	storage_put32(ret + 1, id);
+	memcpy(ret + STORAGE_CODEC_PREFIX_HEADER, url + prefix, size - prefix);
+	storage_stats.cs_url_encoded_bytes += *len;
+	return ret;
+
+plain:
+	storage_stats.cs_url_encoded_bytes += size;
+	return NULL;
+}
+
+/*
+ * Usuwa przedrostki adresów, których nie używa już żadna wiadomość (po
+ * flush, usunięciu źródła, limitach źródeł i 'compress'). Przegląda adresy
+ * całego archiwum, więc wołamy ją raz na polecenie, nie na źródło.
+ */
+int storage_prune_prefixes(storage_handle_t *handle)
+{
+	if (sqlite3_exec(handle->sh_db,
+	    "DELETE FROM url_prefixes WHERE id NOT IN "
+	    "(SELECT rss_url_prefix(url) FROM posts WHERE typeof(url) = 'blob')",
+	    NULL, NULL, NULL) != SQLITE_OK) {
+		FAIL("błąd sqlite3: %s\n", sqlite3_errmsg(handle->sh_db));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 void storage_close(storage_handle_t *handle)
 {
+	sqlite3_finalize(handle->sh_data_version);
 	sqlite3_close(handle->sh_db);
+
+	if (handle == storage_current)
+		storage_current = NULL;
+
 	free(handle);
 }
@@ -34,6 +34,314 @@
 	"	description LONGVARCHAR"					\
 	");"
 
+/*
+ * Widok posts bez żadnej partycji: w kroku 6 schematu jeszcze z opisami,
+ * od kroku 9 (STORAGE_CREATE_POSTS_EMPTY_BRIEF_VIEW_SQL) już bez nich.
+ */
+#define STORAGE_CREATE_POSTS_EMPTY_VIEW_SQL					\
+	"CREATE VIEW posts (id, feed, pubdate, title, url, description, guid) AS "	\
+	"SELECT NULL, NULL, NULL, NULL, NULL, NULL, NULL WHERE 0;"
+
+#define STORAGE_CREATE_POSTS_EMPTY_BRIEF_VIEW_SQL				\
+	"CREATE VIEW posts (id, feed, pubdate, title, url, guid) AS "		\
+	"SELECT NULL, NULL, NULL, NULL, NULL, NULL WHERE 0;"
+
+/*
+ * Kolejne zmiany schematu bazy danych. Wersja schematu jest przechowywana
+ * w PRAGMA user_version i równa liczbie wykonanych kroków; nowe kroki
+ * dopisujemy wyłącznie na końcu tablicy.
+ */
+static const char * const storage_migrations[] = {
+	/* 1: liczba przekierowań przy pobieraniu źródła */
+	"ALTER TABLE feeds ADD COLUMN redirects INTEGER NOT NULL DEFAULT 0;",
+
+	/* 2: klucz wiadomości (guid/id z kanału) */
+	"ALTER TABLE posts ADD COLUMN guid VARCHAR(255);"
+	"UPDATE posts SET guid = url;"
+	"CREATE INDEX posts_feed_guid ON posts (feed, guid);",
+
+	/* 3: filtr Blooma kluczy zapisanych wiadomości źródła */
+	"ALTER TABLE feeds ADD COLUMN bloom BLOB;",
+
+	/*
+	 * 4: liczniki wiadomości źródła utrzymywane przez wyzwalacze; "seen" to
+	 * największe id wiadomości w chwili ostatniego przeglądania źródła.
+	 */
+	"ALTER TABLE feeds ADD COLUMN total INTEGER NOT NULL DEFAULT 0;"
+	"ALTER TABLE feeds ADD COLUMN unseen INTEGER NOT NULL DEFAULT 0;"
+	"ALTER TABLE feeds ADD COLUMN seen INTEGER NOT NULL DEFAULT 0;"
+	"ALTER TABLE feeds ADD COLUMN newest INTEGER;"
+	"ALTER TABLE feeds ADD COLUMN oldest INTEGER;"
+	"CREATE INDEX posts_feed_pubdate ON posts (feed, pubdate);"
+	"UPDATE feeds SET "
+	"	total = (SELECT COUNT(*) FROM posts WHERE feed = feeds.name),"
+	"	seen = COALESCE((SELECT MAX(id) FROM posts WHERE feed = feeds.name), 0),"
+	"	newest = (SELECT MAX(pubdate) FROM posts WHERE feed = feeds.name),"
+	"	oldest = (SELECT MIN(pubdate) FROM posts WHERE feed = feeds.name);"
+	"CREATE TRIGGER posts_counters_insert AFTER INSERT ON posts BEGIN"
+	"	UPDATE feeds SET total = total + 1, unseen = unseen + 1,"
+	"		newest = MAX(COALESCE(newest, NEW.pubdate), NEW.pubdate),"
+	"		oldest = MIN(COALESCE(oldest, NEW.pubdate), NEW.pubdate)"
+	"	WHERE name = NEW.feed;"
+	"END;"
+	"CREATE TRIGGER posts_counters_delete AFTER DELETE ON posts BEGIN"
+	"	UPDATE feeds SET total = total - 1, unseen = unseen - (OLD.id > seen),"
+	"		newest = CASE WHEN OLD.pubdate < newest THEN newest"
+	"			ELSE (SELECT MAX(pubdate) FROM posts WHERE feed = OLD.feed) END,"
+	"		oldest = CASE WHEN OLD.pubdate > oldest THEN oldest"
+	"			ELSE (SELECT MIN(pubdate) FROM posts WHERE feed = OLD.feed) END"
+	"	WHERE name = OLD.feed;"
+	"END;",
+
+	/*
+	 * 5: indeks pełnotekstowy tytułów i opisów (FTS5, treść w posts);
+	 * remove_diacritics pozwala szukać "gesla" i znaleźć "gęślą".
+	 */
+	"CREATE VIRTUAL TABLE posts_fts USING fts5(title, description,"
+	"	content = 'posts', content_rowid = 'id',"
+	"	tokenize = 'unicode61 remove_diacritics 2');"
+	"INSERT INTO posts_fts (posts_fts) VALUES ('rebuild');"
+	"CREATE TRIGGER posts_fts_insert AFTER INSERT ON posts BEGIN"
+	"	INSERT INTO posts_fts (rowid, title, description) VALUES (NEW.id, NEW.title, NEW.description);"
+	"END;"
+	"CREATE TRIGGER posts_fts_delete AFTER DELETE ON posts BEGIN"
+	"	INSERT INTO posts_fts (posts_fts, rowid, title, description)"
+	"		VALUES ('delete', OLD.id, OLD.title, OLD.description);"
+	"END;"
+	"CREATE TRIGGER posts_fts_update AFTER UPDATE OF title, description ON posts BEGIN"
+	"	INSERT INTO posts_fts (posts_fts, rowid, title, description)"
+	"		VALUES ('delete', OLD.id, OLD.title, OLD.description);"
+	"	INSERT INTO posts_fts (rowid, title, description) VALUES (NEW.id, NEW.title, NEW.description);"
+	"END;",
+
+	/*
+	 * 6: wiadomości w miesięcznych partycjach posts_RRRRMM (katalog
+	 * partitions, widok posts); wyzwalacze i indeksy FTS5 ma każda
+	 * partycja. Identyfikatory nadaje posts_sequence. Dotychczasowe
+	 * wiadomości rozdziela na partycje storage_upgrade().
+	 */
+	"DROP TRIGGER posts_counters_insert;"
+	"DROP TRIGGER posts_counters_delete;"
+	"DROP TRIGGER posts_fts_insert;"
+	"DROP TRIGGER posts_fts_delete;"
+	"DROP TRIGGER posts_fts_update;"
+	"DROP TABLE posts_fts;"
+	"CREATE TABLE partitions ("
+	"	name VARCHAR(32) NOT NULL PRIMARY KEY,"
+	"	start_time INTEGER NOT NULL,"
+	"	end_time INTEGER NOT NULL"
+	");"
+	"CREATE TABLE posts_sequence (id INTEGER NOT NULL);"
+	"INSERT INTO posts_sequence VALUES (COALESCE("
+	"	(SELECT seq FROM sqlite_sequence WHERE name = 'posts'), (SELECT MAX(id) FROM posts), 0));"
+	"ALTER TABLE posts RENAME TO posts_legacy;"
+	STORAGE_CREATE_POSTS_EMPTY_VIEW_SQL,
+
+	/*
+	 * 7: nowe wyzwalacze liczników w partycjach (storage_partition_trigger_sql);
+	 * w istniejących partycjach odtwarza je storage_upgrade().
+	 */
+	"",
+
+	/*
+	 * 8: kompresja opisów (słowniki źródeł) i wspólne przedrostki adresów;
+	 * indeksy FTS5 partycji czytają treść przez widok rozpakowujący opisy
+	 * i odbudowuje je storage_upgrade().
+	 */
+	"CREATE TABLE dictionaries ("
+	"	id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"	feed VARCHAR(255) NOT NULL,"
+	"	created TIMESTAMP NOT NULL,"
+	"	data BLOB NOT NULL"
+	");"
+	"CREATE INDEX dictionaries_feed ON dictionaries (feed);"
+	"CREATE TABLE url_prefixes ("
+	"	id INTEGER NOT NULL PRIMARY KEY,"
+	"	prefix VARCHAR(255) NOT NULL UNIQUE"
+	");",
+
+	/*
+	 * 9: opisy w osobnych tabelach partycji (%s_body), żeby przeglądanie
+	 * samych tytułów nie czytało stron z opisami; istniejące partycje
+	 * przebudowuje storage_upgrade() (odtwarza też widok posts).
+	 */
+	"DROP VIEW posts;"
+	STORAGE_CREATE_POSTS_EMPTY_BRIEF_VIEW_SQL,
+
+	/*
+	 * 10: wiadomości przejrzane ponad granicą feeds.seen (np. 'view ...
+	 * limit N'); nie liczą się do unseen. Wyzwalacze liczników istniejących
+	 * partycji odtwarza storage_upgrade().
+	 */
+	"CREATE TABLE seen_posts ("
+	"	id INTEGER NOT NULL PRIMARY KEY,"
+	"	feed VARCHAR(255) NOT NULL"
+	");"
+	"CREATE INDEX seen_posts_feed ON seen_posts (feed);",
+
+	/*
+	 * 11: nieużywane przedrostki adresów usuwa storage_prune_prefixes();
+	 * AUTOINCREMENT nie pozwala nadać ich id nowym przedrostkom, bo stare
+	 * zostają w pamięci podręcznej procesów (storage_cached()).
+	 */
+	"CREATE TABLE url_prefixes_new ("
+	"	id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"	prefix VARCHAR(255) NOT NULL UNIQUE"
+	");"
+	"INSERT INTO url_prefixes_new (id, prefix) SELECT id, prefix FROM url_prefixes;"
+	"DROP TABLE url_prefixes;"
+	"ALTER TABLE url_prefixes_new RENAME TO url_prefixes;"
+};
+
+/*
+ * Polecenia tworzące partycję; każde "%s" to nazwa partycji (posts_RRRRMM).
+ * Opisy leżą w osobnej tabeli %s_body (wiersz dla każdej wiadomości, także
+ * bez opisu), zapisywanej przed wierszem partycji.
+ */
+#define	STORAGE_PARTITION_NAME_MAX	32
+
+#define	STORAGE_CREATE_PARTITION_BODY_SQL			\
+	"CREATE TABLE %s_body ("				\
+	"	id INTEGER NOT NULL PRIMARY KEY,"		\
+	"	description LONGVARCHAR"			\
+	");"
+
+static const char * const storage_partition_sql[] = {
+	"CREATE TABLE %s ("
+	"	id INTEGER NOT NULL PRIMARY KEY,"
+	"	feed VARCHAR(255) NOT NULL,"
+	"	pubdate TIMESTAMP,"
+	"	title VARCHAR(255) NOT NULL UNIQUE,"
+	"	url VARCHAR(255) NOT NULL,"
+	"	guid VARCHAR(255)"
+	");",
+	STORAGE_CREATE_PARTITION_BODY_SQL,
+	"CREATE INDEX %s_feed_guid ON %s (feed, guid);",
+	"CREATE INDEX %s_feed_pubdate ON %s (feed, pubdate);"
+};
+
+/*
+ * Przeniesienie opisów partycji sprzed kroku 9 do tabeli %s_body.
+ */
+static const char * const storage_partition_split_sql[] = {
+	STORAGE_CREATE_PARTITION_BODY_SQL,
+	"INSERT INTO %s_body (id, description) SELECT id, description FROM %s;",
+	"ALTER TABLE %s DROP COLUMN description;"
+};
+
+/*
+ * Indeks pełnotekstowy partycji; snippet() i highlight() czytają treść
+ * przez widok %s_text, który dołącza i rozpakowuje opisy.
+ *
+ * Widok i wyzwalacze niżej wołają rss_inflate(), rejestrowaną w
+ * storage_get(); inny klient SQLite dostanie przy wstawianiu i usuwaniu
+ * wiadomości albo odczycie widoku błąd "no such function: rss_inflate"
+ * (zob. README, "Pułapki"). Indeksu nie da się utrzymywać bez niej:
+ * usunięcie z tabeli fts5 z zewnętrzną treścią wymaga pierwotnego tekstu.
+ */
+static const char * const storage_partition_fts_sql[] = {
+	"CREATE VIEW %s_text AS SELECT p.id, p.title, rss_inflate(b.description) AS description"
+	"	FROM %s AS p LEFT JOIN %s_body AS b ON b.id = p.id;",
+	"CREATE VIRTUAL TABLE %s_fts USING fts5(title, description,"
+	"	content = '%s_text', content_rowid = 'id',"
+	"	tokenize = 'unicode61 remove_diacritics 2');"
+};
+
+/*
+ * Wyzwalacze partycji. Usunięta wiadomość była najstarszą (najnowszą)
+ * wiadomością źródła, więc starszych (nowszych) partycji nie trzeba
+ * przeglądać; widok posts (wszystkie wiadomości źródła) czytamy dopiero,
+ * gdy w tej partycji nie zostało już nic. Wiadomość z seen_posts była już
+ * przejrzana, więc unseen jej nie obejmuje.
+ */
+#define	STORAGE_CREATE_PARTITION_COUNTERS_DELETE_SQL					\
+	"CREATE TRIGGER %s_counters_delete AFTER DELETE ON %s BEGIN"			\
+	"	UPDATE feeds SET total = total - 1,"					\
+	"		unseen = unseen - (OLD.id > seen AND"				\
+	"			NOT EXISTS (SELECT 1 FROM seen_posts WHERE id = OLD.id)),"	\
+	"		newest = CASE WHEN OLD.pubdate < newest THEN newest"		\
+	"			ELSE COALESCE((SELECT MAX(pubdate) FROM %s WHERE feed = OLD.feed),"	\
+	"				(SELECT MAX(pubdate) FROM posts WHERE feed = OLD.feed)) END,"	\
+	"		oldest = CASE WHEN OLD.pubdate > oldest THEN oldest"		\
+	"			ELSE COALESCE((SELECT MIN(pubdate) FROM %s WHERE feed = OLD.feed),"	\
+	"				(SELECT MIN(pubdate) FROM posts WHERE feed = OLD.feed)) END"	\
+	"	WHERE name = OLD.feed;"							\
+	"	DELETE FROM seen_posts WHERE id = OLD.id;"				\
+	"END;"
+
+static const char * const storage_partition_trigger_sql[] = {
+	"CREATE TRIGGER %s_counters_insert AFTER INSERT ON %s BEGIN"
+	"	UPDATE feeds SET total = total + 1, unseen = unseen + 1,"
+	"		newest = MAX(COALESCE(newest, NEW.pubdate), NEW.pubdate),"
+	"		oldest = MIN(COALESCE(oldest, NEW.pubdate), NEW.pubdate)"
+	"	WHERE name = NEW.feed;"
+	"END;",
+	STORAGE_CREATE_PARTITION_COUNTERS_DELETE_SQL,
+	"CREATE TRIGGER %s_fts_insert AFTER INSERT ON %s BEGIN"
+	"	INSERT INTO %s_fts (rowid, title, description) VALUES (NEW.id, NEW.title,"
+	"		(SELECT rss_inflate(description) FROM %s_body WHERE id = NEW.id));"
+	"END;",
+	"CREATE TRIGGER %s_fts_delete AFTER DELETE ON %s BEGIN"
+	"	INSERT INTO %s_fts (%s_fts, rowid, title, description) VALUES ('delete', OLD.id, OLD.title,"
+	"		(SELECT rss_inflate(description) FROM %s_body WHERE id = OLD.id));"
+	"	DELETE FROM %s_body WHERE id = OLD.id;"
+	"END;",
+	"CREATE TRIGGER %s_fts_update AFTER UPDATE OF title ON %s WHEN OLD.title IS NOT NEW.title BEGIN"
+	"	INSERT INTO %s_fts (%s_fts, rowid, title, description)"
+	"		SELECT 'delete', OLD.id, OLD.title, description FROM %s_text WHERE id = OLD.id;"
+	"	INSERT INTO %s_fts (rowid, title, description)"
+	"		SELECT NEW.id, NEW.title, description FROM %s_text WHERE id = NEW.id;"
+	"END;",
+	/* Samo przepakowanie opisu (polecenie 'compress') nie zmienia indeksu. */
+	"CREATE TRIGGER %s_body_update AFTER UPDATE OF description ON %s_body"
+	"	WHEN rss_inflate(OLD.description) IS NOT rss_inflate(NEW.description) BEGIN"
+	"	INSERT INTO %s_fts (%s_fts, rowid, title, description)"
+	"		SELECT 'delete', id, title, rss_inflate(OLD.description) FROM %s WHERE id = OLD.id;"
+	"	INSERT INTO %s_fts (rowid, title, description)"
+	"		SELECT id, title, rss_inflate(NEW.description) FROM %s WHERE id = NEW.id;"
+	"END;"
+};
+
+/*
+ * Odtworzenie wyzwalacza liczników partycji sprzed kroku 10.
+ */
+static const char * const storage_partition_seen_sql[] = {
+	"DROP TRIGGER %s_counters_delete;",
+	STORAGE_CREATE_PARTITION_COUNTERS_DELETE_SQL
+};
+
+/*
+ * Zakodowane wartości kolumn (BLOB; tekst jest przechowywany bez zmian):
+ * opis to bajt STORAGE_CODEC_DEFLATE, id słownika (0 - bez słownika)
+ * i długość tekstu (po 4 bajty, little endian) oraz strumień deflate;
+ * adres to bajt STORAGE_CODEC_PREFIX, id przedrostka (4 bajty) i reszta
+ * adresu. Rozpakowuje je funkcja SQL rss_inflate().
+ */
+#define	STORAGE_CODEC_DEFLATE		0x01
+#define	STORAGE_CODEC_PREFIX		0x02
+#define	STORAGE_CODEC_DEFLATE_HEADER	9
+#define	STORAGE_CODEC_PREFIX_HEADER	5
+#define	STORAGE_CODEC_MIN_TEXT		64
+#define	STORAGE_CODEC_MIN_PREFIX	8
+#define	STORAGE_DICTIONARY_MAX		(32 * 1024)
+#define	STORAGE_CODEC_MAX_TEXT		(256 * 1024 * 1024)
+/* Id słownika lub przedrostka; adresów z wyższym id nie kodujemy. */
+#define	STORAGE_CACHE_MAX_ID		(1 << 20)
+
+struct storage_codec_stats
+{
+	unsigned long	cs_encoded;
+	size_t		cs_text_bytes;
+	size_t		cs_encoded_bytes;
+	size_t		cs_url_bytes;
+	size_t		cs_url_encoded_bytes;
+	unsigned long	cs_decoded;
+	size_t		cs_decoded_bytes;
+	double		cs_decode_time;
+};
+
+typedef struct storage_codec_stats storage_codec_stats_t;
+
 #define	QUERY_HAS_SOURCE	0x1
 #define	QUERY_HAS_LIMIT		0x2
 #define QUERY_HAS_FROM_TIME	0x4
@@ -44,23 +352,58 @@ static const struct {
 	const char *value;
 } storage_variables[] = {
 	{ "use_pager", "on" },
-	{ "use_colors", "on" }
+	{ "use_colors", "on" },
+	{ "connect_timeout", "10" },
+	{ "first_byte_timeout", "15" },
+	{ "transfer_timeout", "60" },
+	{ "show_timings", "off" },
+	{ "tls_verify", "on" },
+	{ "tls_ca_file", "" },
+	{ "early_exit", "3" },
+	{ "show_stats", "off" },
+	{ "charset", "" },
+	{ "fallback_charset", "windows-1250" },
+	{ "max_items", "0" },
+	{ "max_age", "0" },
+	{ "vacuum_pages", "256" },
+	{ "compress", "off" },
+	{ "output_format", "human" }
 };
 
+#define	STORAGE_AUTO_VACUUM_INCREMENTAL	2
+
 struct storage_handle
 {
 	sqlite3		*sh_db;
+	sqlite3_stmt	*sh_data_version;	/* przygotowane PRAGMA data_version */
+	double		sh_open_time;		/* otwarcie i aktualizacja schematu [s] */
 };
 
 typedef struct storage_handle storage_handle_t;
 typedef sqlite3_stmt storage_stmt_t;
 
 storage_handle_t *storage_get();
+int		storage_opened();
 storage_stmt_t	*storage_query(storage_handle_t *, const char *);
 int		storage_step(storage_stmt_t *, hash_t **);
+int		storage_step_arena(storage_stmt_t *, arena_t *, hash_t **);
 void		storage_finalize(storage_stmt_t *);
 void		storage_initialize(storage_handle_t *);
+void		storage_upgrade(storage_handle_t *);
 void		storage_close(storage_handle_t *);
+const char	*storage_partition(storage_handle_t *, time_t);
+void		storage_partition_name(time_t, char *);
+array_t		*storage_partitions(storage_handle_t *, time_t, time_t, arena_t *);
+int		storage_partition_drop(storage_handle_t *, const char *);
+int		storage_next_id(storage_handle_t *);
+int		storage_compact(storage_handle_t *, int);
+void		*storage_encode_text(storage_handle_t *, int, const char *, int *);
+void		*storage_encode_url(storage_handle_t *, const char *, int *);
+int		storage_prune_prefixes(storage_handle_t *);
+storage_codec_stats_t *storage_codec_stats();
+int		storage_vacuum(storage_handle_t *);
+int		storage_cache_misses(storage_handle_t *);
+int		storage_data_version(storage_handle_t *);
 
 #endif	/* __STORAGE_H */
 
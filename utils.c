@@ -13,16 +13,137 @@
 #include <netdb.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <zlib.h>
 #include "globals.h"
 #include "utils.h"
+#include "entities.h"
 
-array_t *array_init(int size)
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Obszar (arena) to lista bloków, z których przydzielamy pamięć przez
+ * przesunięcie wskaźnika. Niczego nie zwalniamy pojedynczo: arena_reset()
+ * oddaje wszystko naraz, zachowując największy (ostatni) blok do ponownego
+ * użycia, o ile nie przekracza ARENA_RETAIN_BLOCKS bloków początkowych.
+ * Każdy kolejny blok jest dwa razy większy od poprzedniego.
+ */
+#define	ARENA_ALIGN	16
+
+arena_t *arena_init(size_t size)
 {
-	array_t *array = xcmalloc(sizeof(array_t));
-	array->a_data = xmalloc(sizeof(void *) * size);
+	arena_t *arena = xcmalloc(sizeof(arena_t));
+	arena->ar_block_size = size ? size : ARENA_DEFAULT_SIZE;
+	return arena;
+}
+
+void *arena_alloc(arena_t *arena, size_t nbytes)
+{
+	arena_block_t *block = arena->ar_head;
+	void *ret;
+
+	nbytes = (nbytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!block || block->ab_used + nbytes > block->ab_size) {
+		size_t size = block ? block->ab_size * 2 : arena->ar_block_size;
+
+		while (size < nbytes)
+			size *= 2;
+
+		block = xmalloc(sizeof(arena_block_t) + size);
+		block->ab_size = size;
+		block->ab_used = 0;
+		block->ab_next = arena->ar_head;
+		arena->ar_head = block;
+	}
+
+	ret = block->ab_data + block->ab_used;
+	block->ab_used += nbytes;
+	arena->ar_allocated += nbytes;
+	return ret;
+}
+
+void *arena_calloc(arena_t *arena, size_t nbytes)
+{
+	return memset(arena_alloc(arena, nbytes), 0, nbytes);
+}
+
+char *arena_strdup(arena_t *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	return memcpy(arena_alloc(arena, len), str, len);
+}
+
+void arena_reset(arena_t *arena)
+{
+	arena_block_t *block, *next;
+
+	if (!arena->ar_head)
+		return;
+
+	for (block = arena->ar_head->ab_next; block; block = next) {
+		next = block->ab_next;
+		free(block);
+	}
+
+	arena->ar_head->ab_next = NULL;
+	arena->ar_head->ab_used = 0;
+	arena->ar_allocated = 0;
+
+	/* Blok urosły po jednorazowo dużym zużyciu oddajemy systemowi. */
+	if (arena->ar_head->ab_size > arena->ar_block_size * ARENA_RETAIN_BLOCKS) {
+		free(arena->ar_head);
+		arena->ar_head = NULL;
+	}
+}
+
+void arena_free(arena_t *arena)
+{
+	if (!arena)
+		return;
+
+	arena_reset(arena);
+	free(arena->ar_head);
+	free(arena);
+}
+
+/*
+ * Tablice i słowniki mogą korzystać z areny (a_arena, h_arena); wtedy
+ * array_free() i hash_free() nie zwalniają niczego, a pamięć odzyskuje
+ * arena_reset(). Pojemność w obu przypadkach rośnie geometrycznie.
+ */
+static void *arena_or_heap_grow(arena_t *arena, void *data, size_t used, size_t nbytes)
+{
+	void *ret;
+
+	if (!arena)
+		return xrealloc(data, nbytes);
+
+	ret = arena_alloc(arena, nbytes);
+
+	if (used)
+		memcpy(ret, data, used);
+
+	return ret;
+}
+
+array_t *array_init_arena(arena_t *arena, int size)
+{
+	array_t *array = arena ? arena_calloc(arena, sizeof(array_t)) : xcmalloc(sizeof(array_t));
+	array->a_arena = arena;
+	array->a_size = size > 4 ? size : 4;
+	array->a_data = arena ? arena_alloc(arena, sizeof(void *) * array->a_size) : xmalloc(sizeof(void *) * array->a_size);
 	array->a_count = size;
 	return array;
 }
+
+array_t *array_init(int size)
+{
+	return array_init_arena(NULL, size);
+}
  
 array_t *array_init_with(const void *data[], size_t count)
 {
@@ -31,23 +152,26 @@ array_t *array_init_with(const void *data[], size_t count)
 	return array;
 }
 
-array_t *array_init_split_string(char *string, const char *delims)
+/*
+ * Dzieli napis (modyfikując go) na niepuste słowa; słowa są kopiowane do
+ * podanej areny albo, gdy arena == NULL, na stertę.
+ */
+array_t *array_init_split_string(arena_t *arena, char *string, const char *delims)
 {
-	array_t *ret = array_init(0);
+	array_t *ret = array_init_arena(arena, 0);
 	char *token;
 	
 	while ((token = strsep(&string, delims))) {
 		if (strlen(token))
-			array_append(ret, (void *)xstrdup(token));
+			array_append(ret, (void *)(arena ? arena_strdup(arena, token) : xstrdup(token)));
 	}
 	
-	free(string);
 	return ret;
 }
 
 void array_free(array_t *array, int deep, int managed)
 {
-	if (!array)
+	if (!array || array->a_arena)
 		return;
 
 	if (deep) {
@@ -63,18 +187,33 @@ void array_free(array_t *array, int deep, int managed)
 	free(array);
 }
 
+static void array_reserve(array_t *array, int size)
+{
+	int capacity = array->a_size;
+
+	if (size <= capacity)
+		return;
+
+	while (capacity < size)
+		capacity *= 2;
+
+	array->a_data = arena_or_heap_grow(array->a_arena, array->a_data,
+	    array->a_count * sizeof(void *), capacity * sizeof(void *));
+	array->a_size = capacity;
+}
+
 void array_append(array_t *array, void *data)
 {
-	array->a_count++;
-	array->a_data = xrealloc(array->a_data, array->a_count * sizeof(void *));
-	array->a_data[array->a_count-1] = data;
+	array_reserve(array, array->a_count + 1);
+	array->a_data[array->a_count++] = data;
 }
 
 void array_prepend(array_t *array, void *data)
 {
-	array->a_count++;
-	array->a_data = xrealloc(array->a_data, array->a_count * sizeof(void *));
+	array_reserve(array, array->a_count + 1);
 	memmove((void *)(array->a_data + 1), array->a_data, array->a_count * sizeof(void *));
+	array->a_data[0] = data;
+	array->a_count++;
 }
 
 void *array_get(array_t *array, int index)
@@ -89,8 +228,8 @@ void *array_get(array_t *array, int index)
 
 void array_set(array_t *array, int index, void *data)
 {
-	if (index > array->a_count)
-		array_resize(array, index);
+	if (index >= array->a_count)
+		array_resize(array, index + 1);
 	
 	array->a_data[index] = data;
 }
@@ -102,7 +241,7 @@ void array_resize(array_t *array, int size)
 		return;
 	}
 	
-	array->a_data = xrealloc(array->a_data, size * sizeof(void *));
+	array_reserve(array, size);
 	array->a_count = size;
 }
 
@@ -111,19 +250,25 @@ int array_count(array_t *array)
 	return array->a_count;
 }
 
-hash_t *hash_init()
+hash_t *hash_init_arena(arena_t *arena)
 {
-	hash_t *hash = xcmalloc(sizeof(hash_t));
+	hash_t *hash = arena ? arena_calloc(arena, sizeof(hash_t)) : xcmalloc(sizeof(hash_t));
+	hash->h_arena = arena;
 	return hash;
 }
 
+hash_t *hash_init()
+{
+	return hash_init_arena(NULL);
+}
+
 void hash_free(hash_t *hash, int deep, int managed)
 {
 	int i;
 	const char *key;
 	void *value;
 
-	if (!hash)
+	if (!hash || hash->h_arena)
 		return;
 
 	FOREACH_HASH(hash, i, key, value) {
@@ -158,9 +303,19 @@ char *hash_get_string(hash_t *hash, const char *skey)
 	return ret ? ret : xstrdup("");
 }
 
+/*
+ * Liczby w wierszach z bazy (storage_step()) są 64-bitowe; hash_get_int()
+ * zwraca je obcięte do int, a znaczniki czasu trzeba czytać przez
+ * hash_get_int64().
+ */
 int hash_get_int(hash_t *hash, const char *skey)
 {
-	int *ret = (int *)hash_get(hash, skey);
+	return hash_get_int64(hash, skey);
+}
+
+int64_t hash_get_int64(hash_t *hash, const char *skey)
+{
+	int64_t *ret = (int64_t *)hash_get(hash, skey);
 	return ret ? *ret : 0;
 }
 
@@ -174,21 +329,48 @@ void hash_set(hash_t *hash, const char *key, void *value, int free_old)
 			item = &(hash->h_data[i]);
 	}
 	
-	if (item && free_old) {
+	if (item && free_old && !hash->h_arena) {
 		free((char *)item->h_key);
 		free(item->h_data);
 	}
 	
 	if (!item) {
-		hash->h_count++;
-		hash->h_data = xrealloc(hash->h_data, (hash->h_count + 1) * sizeof(hash_kv_t));
-		item = (hash_kv_t *)&(hash->h_data[hash->h_count - 1]);
+		if (hash->h_count == hash->h_size) {
+			int capacity = hash->h_size ? hash->h_size * 2 : 8;
+			hash->h_data = arena_or_heap_grow(hash->h_arena, hash->h_data,
+			    hash->h_count * sizeof(hash_kv_t), capacity * sizeof(hash_kv_t));
+			hash->h_size = capacity;
+		}
+
+		item = &(hash->h_data[hash->h_count++]);
 	}
 	
 	item->h_key = key;
 	item->h_data = value;
 }
 
+int hash_unset(hash_t *hash, const char *skey, int free_value)
+{
+	int i;
+
+	for (i = 0; i < hash_count(hash); i++) {
+		if (strcmp(skey, hash->h_data[i].h_key))
+			continue;
+
+		if (!hash->h_arena) {
+			free((char *)hash->h_data[i].h_key);
+			if (free_value)
+				free(hash->h_data[i].h_data);
+		}
+
+		memmove(&hash->h_data[i], &hash->h_data[i + 1], (hash->h_count - i - 1) * sizeof(hash_kv_t));
+		hash->h_count--;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 int hash_key_exists(hash_t *hash, const char *skey)
 {
 	int i;
@@ -213,6 +395,127 @@ int hash_count(hash_t *hash)
 	return hash->h_count;
 }
 
+/*
+ * Filtr dobierany do oczekiwanej liczby kluczy n i dopuszczalnego odsetka
+ * fałszywych trafień p: m = -n ln p / (ln 2)^2 bitów, k = m/n ln 2 funkcji.
+ */
+bloom_t *bloom_init(uint32_t n, double p)
+{
+	bloom_t *bloom = xcmalloc(sizeof(bloom_t));
+
+	if (n < 64)
+		n = 64;
+
+	bloom->b_bits = ((uint32_t)(-(double)n * log(p) / (M_LN2 * M_LN2)) + 7) & ~7U;
+	bloom->b_hashes = (uint32_t)((double)bloom->b_bits / n * M_LN2 + 0.5);
+	if (bloom->b_hashes < 1) bloom->b_hashes = 1;
+	bloom->b_data = xcmalloc(bloom->b_bits / 8);
+	return bloom;
+}
+
+bloom_t *bloom_load(const void *data, int nbytes)
+{
+	const uint32_t *header = data;
+	bloom_t *bloom;
+
+	if (nbytes < BLOOM_HEADER_SIZE || header[0] != BLOOM_MAGIC || header[1] / 8 + BLOOM_HEADER_SIZE != nbytes)
+		return NULL;
+
+	/* Zerowe pola dałyby dzielenie przez zero, a niepełny bajt - odczyt poza tablicą. */
+	if (!header[1] || header[1] % 8 || !header[2])
+		return NULL;
+
+	bloom = xcmalloc(sizeof(bloom_t));
+	bloom->b_bits = header[1];
+	bloom->b_hashes = header[2];
+	bloom->b_count = header[3];
+	bloom->b_data = xmalloc(bloom->b_bits / 8);
+	memcpy(bloom->b_data, (const char *)data + BLOOM_HEADER_SIZE, bloom->b_bits / 8);
+	return bloom;
+}
+
+void *bloom_save(bloom_t *bloom, int *nbytes)
+{
+	uint32_t *ret;
+
+	*nbytes = BLOOM_HEADER_SIZE + bloom->b_bits / 8;
+	ret = xmalloc(*nbytes);
+	ret[0] = BLOOM_MAGIC;
+	ret[1] = bloom->b_bits;
+	ret[2] = bloom->b_hashes;
+	ret[3] = bloom->b_count;
+	memcpy((char *)ret + BLOOM_HEADER_SIZE, bloom->b_data, bloom->b_bits / 8);
+	return ret;
+}
+
+void bloom_free(bloom_t *bloom)
+{
+	if (!bloom)
+		return;
+
+	free(bloom->b_data);
+	free(bloom);
+}
+
+/*
+ * Podwójne mieszanie (Kirsch, Mitzenmacher): i-ta funkcja to h1 + i * h2,
+ * gdzie h1 i h2 są połówkami 64-bitowego FNV-1a.
+ */
+static uint64_t bloom_hash(const char *key)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (*key) {
+		hash ^= (uint8_t)*key++;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+void bloom_add(bloom_t *bloom, const char *key)
+{
+	uint64_t hash = bloom_hash(key);
+	uint32_t i, h1 = hash, h2 = (hash >> 32) | 1;
+
+	for (i = 0; i < bloom->b_hashes; i++) {
+		uint32_t bit = (h1 + i * h2) % bloom->b_bits;
+		bloom->b_data[bit >> 3] |= 1 << (bit & 7);
+	}
+
+	bloom->b_count++;
+}
+
+int bloom_check(bloom_t *bloom, const char *key)
+{
+	uint64_t hash = bloom_hash(key);
+	uint32_t i, h1 = hash, h2 = (hash >> 32) | 1;
+
+	for (i = 0; i < bloom->b_hashes; i++) {
+		uint32_t bit = (h1 + i * h2) % bloom->b_bits;
+		if (!(bloom->b_data[bit >> 3] & (1 << (bit & 7))))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Szacowany odsetek fałszywych trafień przy obecnej liczbie kluczy.
+ */
+double bloom_fp_rate(bloom_t *bloom)
+{
+	return pow(1.0 - exp(-(double)bloom->b_hashes * bloom->b_count / bloom->b_bits), bloom->b_hashes);
+}
+
+/*
+ * Ile kluczy zmieści filtr, nie przekraczając odsetka fałszywych trafień p.
+ */
+uint32_t bloom_capacity(bloom_t *bloom, double p)
+{
+	return (uint32_t)(-(double)bloom->b_bits / bloom->b_hashes * log(1.0 - pow(p, 1.0 / bloom->b_hashes)));
+}
+
 void *managed_new(size_t nbytes, void (*destructor)(void *))
 {
 	void *ret = xcmalloc(nbytes);
@@ -228,21 +531,24 @@ void managed_delete(void *data)
 	free(tmp);
 }
 
-void *xmalloc(size_t nbytes)
+/*
+ * Nazwy w nawiasach nie są rozwijane przez makra z utils.h (MEM_ACCOUNTING).
+ */
+void *(xmalloc)(size_t nbytes)
 {
 	void *ptr = malloc(nbytes);
 	XASSERT(ptr);
 	return ptr;
 }
 
-void *xcmalloc(size_t nbytes)
+void *(xcmalloc)(size_t nbytes)
 {
 	void *ptr = xmalloc(nbytes);
 	memset(ptr, 0, nbytes);
 	return ptr;
 }
 
-void *xrealloc(void *ptr, size_t nbytes)
+void *(xrealloc)(void *ptr, size_t nbytes)
 {
 	ptr = realloc(ptr, nbytes);
 	XASSERT(ptr);
@@ -251,10 +557,13 @@ void *xrealloc(void *ptr, size_t nbytes)
 
 char *xfgetln(FILE *f)
 {
-	uint32_t nbytes = LINEMAX;
-	char *buf = xcmalloc(nbytes + 1);
-	getline(&buf, &nbytes, f);
-	return buf;
+	size_t nbytes = 0;
+	char *buf = NULL, *ret;
+
+	/* Bufor przydziela (i powiększa) getline(); zwracamy własną kopię. */
+	ret = xstrdup(getline(&buf, &nbytes, f) < 0 ? "" : buf);
+	free(buf);
+	return ret;
 }
 
 int xprintf(const char *format, ...)
@@ -267,7 +576,7 @@ int xprintf(const char *format, ...)
 	return ret;
 }
 
-int xread(FILE *f, char **buf, int nbytes, void (*callback)(int, int))
+int xread(FILE *f, char **buf, int nbytes, void (*callback)(void *, int, int), void *arg)
 {
 	int ret, todo, done = 0;
 	
@@ -275,27 +584,30 @@ int xread(FILE *f, char **buf, int nbytes, void (*callback)(int, int))
 		todo = (nbytes == -1 || nbytes - done >= GRANULARITY) ? GRANULARITY : nbytes-done;
 		*buf = xrealloc(*buf, sizeof(char) * (done + todo + 1));
 		memset((void *)(*buf + done), 0, todo + 1);
-		if ((ret = fread((void *)(*buf + done), 1, todo, f)) < 1) {
-			if (errno == EINTR || errno == EAGAIN)
+		/* Przy końcu strumienia errno może zostać po wcześniejszym EAGAIN. */
+		if ((ret = fread((void *)(*buf + done), 1, todo, f)) < 1 && !feof(f)) {
+			if (errno == EINTR || errno == EAGAIN) {
+				clearerr(f);
 				continue;
+			}
 		}
 				
 		done += ret;
 		
-		if (callback) callback(done, nbytes);
-		if (feof(f)) break;
+		if (callback) callback(arg, done, nbytes);
+		if (feof(f) || ferror(f)) break;
 	}
 	
 	return done;
 }
 
-int xread_chunked(FILE *f, char **buf, void (*callback)(int, int))
+int xread_chunked(FILE *f, char **buf, void (*callback)(void *, int, int), void *arg)
 {
 	char *line;
 	int ret, done = 0;
 	uint32_t todo;
 
-	do {
+	while (!feof(f) && !ferror(f)) {
 		line = xfgetln(f);
 		
 		if (sscanf(line, "%x\r", &todo) < 1) {
@@ -303,23 +615,26 @@ int xread_chunked(FILE *f, char **buf, void (*callback)(int, int))
 			continue;
 		}
 		
+		free(line);
+
+		/* Chunk o zerowej długości kończy odpowiedź. */
+		if (!todo)
+			break;
+		
 		*buf = xrealloc(*buf, sizeof(char) * (done + todo + 1));
-		if ((ret = fread((void *)(*buf + done), 1, todo, f)) < 1) {
-			if (errno == EINTR || errno == EAGAIN)
-				continue;
-		}
+		if ((ret = fread((void *)(*buf + done), 1, todo, f)) < 1)
+			break;
 			
 		done += ret;
-		free(line);
+		(*buf)[done] = '\0';
 		
-		if (callback) callback(done, -1);
-		if (feof(f)) break;
-	} while (0);
+		if (callback) callback(arg, done, -1);
+	}
 	
 	return done;	
 }
 
-char *xstrdup(const char *str)
+char *(xstrdup)(const char *str)
 {
 	char *ret = strdup(str);
 	XASSERT(ret);
@@ -340,6 +655,13 @@ int *xintdup(int number)
 	return ret;
 }
 
+int64_t *xint64dup(int64_t number)
+{
+	int64_t *ret = xmalloc(sizeof(int64_t));
+	*ret = number;
+	return ret;
+}
+
 char *xstrcat(char *dst, const char *src)
 {
 	size_t len = strlen(dst) + strlen(src) + 1;
@@ -367,6 +689,8 @@ array_t *regexp_match(const char *pattern, const char *str, int cflags)
 		char error[LINEMAX];
 		regerror(status, &regexp, error, LINEMAX);
 		regfree(&regexp);
+		free(regmatch);
+		array_free(ret, FALSE, FALSE);
 		errno = EINVAL;
 		return NULL;
 	}
@@ -380,54 +704,894 @@ array_t *regexp_match(const char *pattern, const char *str, int cflags)
 	return ret;
 }
 
+/*
+ * Zwraca wskaźnik na pierwsze wystąpienie znaku a lub b w [p, end), albo
+ * end. Wersje wektorowe porównują 16 (SSE2) lub 32 (AVX2) bajty naraz.
+ */
+static const char *html_scan_scalar(const char *p, const char *end, char a, char b)
+{
+	while (p < end && *p != a && *p != b)
+		p++;
+
+	return p;
+}
+
+#if defined(__x86_64__) || defined(__SSE2__)
+static const char *html_scan_sse2(const char *p, const char *end, char a, char b)
+{
+	__m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+
+	for (; p + 16 <= end; p += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return html_scan_scalar(p, end, a, b);
+}
+
+__attribute__((target("avx2")))
+static const char *html_scan_avx2(const char *p, const char *end, char a, char b)
+{
+	__m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+
+	for (; p + 32 <= end; p += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+		unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)));
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return html_scan_sse2(p, end, a, b);
+}
+#endif
+
+static const char *html_scan(const char *p, const char *end, char a, char b)
+{
+#if defined(__x86_64__) || defined(__SSE2__)
+	static const char *(*scan)(const char *, const char *, char, char) = NULL;
+
+	if (!scan)
+		scan = __builtin_cpu_supports("avx2") ? html_scan_avx2 : html_scan_sse2;
+
+	return scan(p, end, a, b);
+#else
+	return html_scan_scalar(p, end, a, b);
+#endif
+}
+
+static uint32_t html_entity_hash(const char *name, int len, uint32_t hash)
+{
+	while (len--) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * Zapisuje znak Unicode w UTF-8 pod out; zwraca liczbę bajtów.
+ */
+int utf8_encode(uint32_t cp, char *out)
+{
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	}
+
+	if (cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+
+	if (cp < 0x10000) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+
+	out[0] = 0xf0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3f);
+	out[2] = 0x80 | ((cp >> 6) & 0x3f);
+	out[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+/*
+ * Rozpoznaje encję zaczynającą się od '&' pod p (przed end). Zwraca
+ * długość encji (łącznie z ';') i znak w *cp, albo 0, jeśli to nie encja.
+ * Postać UTF-8 znaku nigdy nie jest dłuższa niż sama encja, dzięki czemu
+ * strip_html() może dekodować w miejscu.
+ */
+static int html_entity(const char *p, const char *end, uint32_t *cp)
+{
+	const char *name = p + 1, *semi;
+	int len, index;
+	uint32_t value = 0, slot;
+
+	if (name < end && *name == '#') {
+		int hex = (name + 1 < end && (name[1] == 'x' || name[1] == 'X'));
+
+		for (semi = name + 1 + hex; semi < end && semi - name < 10; semi++) {
+			int digit;
+
+			if (*semi >= '0' && *semi <= '9') digit = *semi - '0';
+			else if (hex && *semi >= 'a' && *semi <= 'f') digit = *semi - 'a' + 10;
+			else if (hex && *semi >= 'A' && *semi <= 'F') digit = *semi - 'A' + 10;
+			else break;
+
+			value = value * (hex ? 16 : 10) + digit;
+		}
+
+		if (semi >= end || *semi != ';' || semi == name + 1 + hex)
+			return 0;
+
+		if (value >= 0x80 && value < 0xa0)
+			value = html_cp1252[value - 0x80];
+		else if (!value || value > 0x10ffff || (value >= 0xd800 && value < 0xe000))
+			value = 0xfffd;
+
+		*cp = value;
+		return semi - p + 1;
+	}
+
+	for (semi = name; semi < end && semi - name <= HTML_ENTITY_MAXLEN && isalnum((unsigned char)*semi); semi++)
+		;
+
+	if (semi >= end || *semi != ';' || (len = semi - name) < 2 || len > HTML_ENTITY_MAXLEN)
+		return 0;
+
+	slot = html_entity_hash(name, len, HTML_ENTITY_BASIS2)
+	    + html_entity_disp[html_entity_hash(name, len, HTML_ENTITY_BASIS1) % HTML_ENTITY_BUCKETS];
+
+	if (!(index = html_entity_slots[slot % HTML_ENTITY_SLOTS]))
+		return 0;
+
+	if (strncmp(html_entities[index - 1].name, name, len) || html_entities[index - 1].name[len])
+		return 0;
+
+	*cp = html_entities[index - 1].cp;
+	return len + 2;
+}
+
+/*
+ * Usuwa znaczniki HTML i dekoduje encje (nazwane, &#dd; oraz &#xhh;) w
+ * miejscu, zwracając ten sam bufor. Między znakami '<', '>' i '&' kopiuje
+ * całe fragmenty naraz, szukając kolejnego znaku wektorowo.
+ */
 char *strip_html(char *text)
 {
-	int i;
-	char *orig = text;
-	char *ret = xcmalloc(strlen(text) + 1);
-	int done = 0, in_tag = FALSE, entity = FALSE;
-	
-	struct { const char *seq; const char ch; } entities[] = {
-		{ "lt;", '<' },
-		{ "gt;", '>' },
-		{ "amp;", '&' }
-	};	
-	
-	do {
-		if (*text == '<') {
-			in_tag = TRUE;
+	char *out = text;
+	const char *p = text, *next, *end = text + strlen(text);
+	uint32_t cp;
+	int len;
+
+	while (p < end) {
+		next = html_scan(p, end, '<', '&');
+
+		if (out != p)
+			memmove(out, p, next - p);
+
+		out += next - p;
+		p = next;
+
+		if (p >= end)
+			break;
+
+		if (*p == '<') {
+			/* Pomijamy znacznik; niezamknięty ucina resztę tekstu. */
+			p = html_scan(p + 1, end, '>', '>') + 1;
 			continue;
 		}
-		
-		if (*text == '>' && in_tag) {
-			in_tag = FALSE;
+
+		if ((len = html_entity(p, end, &cp))) {
+			out += utf8_encode(cp, out);
+			p += len;
+		} else {
+			*out++ = *p++;
+		}
+	}
+
+	*out = '\0';
+	return text;
+}
+
+/*
+ * Zwraca wskaźnik na pierwszy bajt spoza ASCII w [p, end), albo end.
+ * Bit najwyższy każdego bajtu zbiera movemask, więc pełne bloki czystego
+ * ASCII (zdecydowana większość tekstu) pomijamy po 16 lub 32 bajty.
+ */
+static const char *utf8_scan_scalar(const char *p, const char *end)
+{
+	while (p < end && !(*p & 0x80))
+		p++;
+
+	return p;
+}
+
+#if defined(__x86_64__) || defined(__SSE2__)
+static const char *utf8_scan_sse2(const char *p, const char *end)
+{
+	for (; p + 16 <= end; p += 16) {
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p));
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return utf8_scan_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *utf8_scan_avx2(const char *p, const char *end)
+{
+	for (; p + 32 <= end; p += 32) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)p));
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return utf8_scan_sse2(p, end);
+}
+#endif
+
+static const char *utf8_scan(const char *p, const char *end)
+{
+#if defined(__x86_64__) || defined(__SSE2__)
+	static const char *(*scan)(const char *, const char *) = NULL;
+
+	if (!scan)
+		scan = __builtin_cpu_supports("avx2") ? utf8_scan_avx2 : utf8_scan_sse2;
+
+	return scan(p, end);
+#else
+	return utf8_scan_scalar(p, end);
+#endif
+}
+
+/*
+ * Długość poprawnej sekwencji UTF-8 pod p albo 0. Odrzuca postaci
+ * nadmiarowe, surogaty i znaki powyżej U+10FFFF (RFC 3629).
+ */
+static int utf8_sequence(const unsigned char *p, const unsigned char *end)
+{
+	int len, i;
+	uint32_t cp;
+
+	if (*p < 0x80) return 1;
+	else if (*p >= 0xc2 && *p <= 0xdf) len = 2, cp = *p & 0x1f;
+	else if (*p >= 0xe0 && *p <= 0xef) len = 3, cp = *p & 0x0f;
+	else if (*p >= 0xf0 && *p <= 0xf4) len = 4, cp = *p & 0x07;
+	else return 0;
+
+	if (end - p < len)
+		return 0;
+
+	for (i = 1; i < len; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+
+		cp = (cp << 6) | (p[i] & 0x3f);
+	}
+
+	if ((len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10ffff)) || (cp >= 0xd800 && cp < 0xe000))
+		return 0;
+
+	return len;
+}
+
+/*
+ * Zwraca wskaźnik na pierwszy bajt niepoprawnej sekwencji UTF-8 w
+ * [p, end), albo end, jeśli cały tekst jest poprawny.
+ */
+const char *utf8_validate(const char *p, const char *end)
+{
+	int len;
+
+	while ((p = utf8_scan(p, end)) < end) {
+		if (!(len = utf8_sequence((const unsigned char *)p, (const unsigned char *)end)))
+			return p;
+
+		p += len;
+	}
+
+	return end;
+}
+
+/*
+ * Zwraca tekst, w którym każdy bajt spoza poprawnej sekwencji UTF-8
+ * zastąpiono znakiem U+FFFD. Poprawny tekst (przypadek typowy) zwraca bez
+ * kopiowania; w przeciwnym razie tworzy nowy bufor w arenie, a gdy
+ * arena == NULL - na stercie, zwalniając stary.
+ */
+char *utf8_repair(arena_t *arena, char *text)
+{
+	const char *p = text, *end = text + strlen(text), *bad;
+	char *ret, *out;
+
+	if ((bad = utf8_validate(p, end)) == end)
+		return text;
+
+	out = ret = arena ? arena_alloc(arena, (end - p) * 3 + 1) : xmalloc((end - p) * 3 + 1);
+
+	while (p < end) {
+		memcpy(out, p, bad - p);
+		out += bad - p;
+		p = bad;
+
+		if (p >= end)
+			break;
+
+		out += utf8_encode(0xfffd, out);
+		p++;
+
+		/* Pozostałe bajty kontynuacji tej samej sekwencji pomijamy. */
+		while (p < end && (*p & 0xc0) == 0x80)
+			p++;
+
+		bad = utf8_validate(p, end);
+	}
+
+	*out = '\0';
+
+	if (!arena)
+		free(text);
+
+	return ret;
+}
+
+/*
+ * Deskryptory iconv są drogie w tworzeniu (wczytanie tablic konwersji),
+ * więc trzymamy po jednym na kodowanie przez cały czas działania programu.
+ */
+static iconv_t charset_open(const char *charset)
+{
+	static hash_t *cache = NULL;
+	char key[64];
+	iconv_t *cd;
+	int i;
+
+	for (i = 0; charset[i] && i < sizeof(key) - 1; i++)
+		key[i] = toupper((unsigned char)charset[i]);
+
+	key[i] = '\0';
+
+	if (!cache)
+		cache = hash_init();
+
+	if (!(cd = hash_get(cache, key))) {
+		cd = xmalloc(sizeof(iconv_t));
+
+		if ((*cd = iconv_open("UTF-8", key)) == (iconv_t)-1) {
+			free(cd);
+			return (iconv_t)-1;
+		}
+
+		hash_set(cache, xstrdup(key), cd, FALSE);
+	}
+
+	iconv(*cd, NULL, NULL, NULL, NULL);
+	return *cd;
+}
+
+/*
+ * Przekodowuje len bajtów z podanego kodowania do UTF-8. Nieprzekodowalne
+ * bajty zastępuje znakiem U+FFFD. Zwraca NULL dla nieznanego kodowania.
+ */
+char *charset_to_utf8(const char *charset, const char *text, size_t len)
+{
+	iconv_t cd = charset_open(charset);
+	size_t size = len * 2 + 16, left = len, room;
+	char *in = (char *)text, *ret, *out;
+	int error;
+
+	if (cd == (iconv_t)-1)
+		return NULL;
+
+	out = ret = xmalloc(size);
+	room = size - 1;
+
+	while (left) {
+		if (iconv(cd, &in, &left, &out, &room) != (size_t)-1)
+			break;
+
+		if ((error = errno) != E2BIG && error != EILSEQ && error != EINVAL)
+			break;
+
+		if (error == E2BIG || room < 4) {
+			size_t used = out - ret;
+			size *= 2;
+			ret = xrealloc(ret, size);
+			out = ret + used;
+			room = size - used - 1;
+		}
+
+		if (error != E2BIG) {
+			out += utf8_encode(0xfffd, out);
+			room -= 3;
+			in++;
+			left--;
+		}
+	}
+
+	*out = '\0';
+	return ret;
+}
+
+/*
+ * Wyłuskuje nazwę kodowania z nagłówka Content-Type ("...; charset=X")
+ * albo z deklaracji XML (<?xml ... encoding="X"?>). Zwraca NULL, jeśli
+ * kodowanie nie zostało podane.
+ */
+char *charset_from_content_type(const char *content_type)
+{
+	const char *p, *end;
+
+	if (!content_type || !(p = strcasestr(content_type, "charset=")))
+		return NULL;
+
+	p += strlen("charset=");
+	if (*p == '"' || *p == '\'')
+		p++;
+
+	for (end = p; *end && *end != '"' && *end != '\'' && *end != ';' && !isspace((unsigned char)*end); end++)
+		;
+
+	return end > p ? xsubstrdup(p, 0, end - p) : NULL;
+}
+
+char *charset_from_xml(const char *text)
+{
+	const char *p, *end, *decl_end;
+
+	if (!strncmp(text, "\xef\xbb\xbf", 3))
+		return xstrdup("UTF-8");
+
+	if (strncmp(text, "<?xml", 5) || !(decl_end = strstr(text, "?>")))
+		return NULL;
+
+	for (p = text + 5; p < decl_end; p++) {
+		if (strncmp(p, "encoding", 8))
 			continue;
+
+		for (p += 8; p < decl_end && (isspace((unsigned char)*p) || *p == '='); p++)
+			;
+
+		if (p >= decl_end || (*p != '"' && *p != '\''))
+			return NULL;
+
+		end = memchr(p + 1, *p, decl_end - p - 1);
+		return end ? xsubstrdup(p + 1, 0, end - p - 1) : NULL;
+	}
+
+	return NULL;
+}
+
+/*
+ * Kompresja surowym strumieniem deflate (bez nagłówka zlib), opcjonalnie
+ * ze słownikiem: początkiem "historii", do którego mogą odwoływać się
+ * dopasowania. Strumienie są tworzone raz i tylko resetowane, bo
+ * deflateInit() przydziela ponad 256 KB.
+ */
+void *zlib_compress(const char *data, size_t len, const void *dict, size_t dict_len, size_t *out_len)
+{
+	static z_stream *zs = NULL;
+	size_t bound;
+	void *ret;
+
+	if (!zs) {
+		zs = xcmalloc(sizeof(z_stream));
+
+		if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(zs);
+			zs = NULL;
+			return NULL;
 		}
-		
-		if (*text == '&') {
-			entity = FALSE;
-			for (i = 0; i < N(entities); i++) {
-				if (!strncmp(text+1, entities[i].seq, strlen(entities[i].seq))) {
-					ret[done++] = entities[i].ch;
-					text = strchr(text, ';');
-					entity = TRUE;
+	} else {
+		deflateReset(zs);
+	}
+
+	if (dict_len)
+		deflateSetDictionary(zs, dict, dict_len);
+
+	bound = deflateBound(zs, len);
+	ret = xmalloc(bound);
+	zs->next_in = (Bytef *)data;
+	zs->avail_in = len;
+	zs->next_out = ret;
+	zs->avail_out = bound;
+
+	if (deflate(zs, Z_FINISH) != Z_STREAM_END) {
+		free(ret);
+		return NULL;
+	}
+
+	*out_len = zs->total_out;
+	return ret;
+}
+
+/*
+ * Rozpakowuje strumień z zlib_compress() do bufora out o długości
+ * out_len (znana długość tekstu) i kończy go znakiem NUL.
+ */
+int zlib_decompress(const void *data, size_t len, const void *dict, size_t dict_len, char *out, size_t out_len)
+{
+	static z_stream *zs = NULL;
+
+	if (!zs) {
+		zs = xcmalloc(sizeof(z_stream));
+
+		if (inflateInit2(zs, -15) != Z_OK) {
+			free(zs);
+			zs = NULL;
+			return FALSE;
+		}
+	} else {
+		inflateReset(zs);
+	}
+
+	if (dict_len && inflateSetDictionary(zs, dict, dict_len) != Z_OK)
+		return FALSE;
+
+	zs->next_in = (Bytef *)data;
+	zs->avail_in = len;
+	zs->next_out = (Bytef *)out;
+	zs->avail_out = out_len;
+
+	if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != out_len)
+		return FALSE;
+
+	out[out_len] = '\0';
+	return TRUE;
+}
+
+/*
+ * Uczenie słownika dla deflate z próbek tekstu. Kandydatami są ciągi od
+ * jednego do DICT_SEGMENT_WORDS kolejnych słów (z odstępami); ciąg jest
+ * tym cenniejszy, w im większej liczbie próbek występuje i im jest dłuższy.
+ * Najcenniejsze ciągi trafiają na koniec słownika, najbliżej kompresowanego
+ * tekstu, a te zawarte już w słowniku pomijamy.
+ */
+#define	DICT_SEGMENT_MIN	4
+#define	DICT_SEGMENT_MAX	128
+#define	DICT_SEGMENT_WORDS	4
+
+struct dict_segment
+{
+	const char	*ds_text;
+	uint32_t	ds_len;
+	uint32_t	ds_count;
+	int		ds_last;
+	uint64_t	ds_score;
+};
+
+static uint64_t dict_hash(const char *text, size_t len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (len--) {
+		hash ^= (uint8_t)*text++;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static int dict_segment_compare(const void *a, const void *b)
+{
+	const struct dict_segment *x = *(const struct dict_segment **)a, *y = *(const struct dict_segment **)b;
+	return x->ds_score < y->ds_score ? 1 : (x->ds_score > y->ds_score ? -1 : 0);
+}
+
+void *dict_train(const char **samples, int count, size_t max_size, size_t *size)
+{
+	struct dict_segment *table, **chosen;
+	size_t slots = 1024, used = 0, mask, i, total = 0, nchosen = 0;
+	const char *text, *word, *end;
+	char *ret;
+	int s, n;
+
+	for (s = 0; s < count; s++)
+		slots += strlen(samples[s]) / 2 * DICT_SEGMENT_WORDS;
+
+	while (slots & (slots - 1))
+		slots &= slots - 1;
+
+	slots <<= 1;
+	mask = slots - 1;
+	table = xcmalloc(slots * sizeof(struct dict_segment));
+
+	for (s = 0; s < count; s++) {
+		for (text = samples[s]; *text; ) {
+			while (*text && isspace((unsigned char)*text))
+				text++;
+
+			if (!*text)
+				break;
+
+			/* Ciągi zaczynające się od tego słowa: 1..DICT_SEGMENT_WORDS słów. */
+			for (word = text, end = text, n = 0; n < DICT_SEGMENT_WORDS && *end; n++) {
+				while (*end && !isspace((unsigned char)*end))
+					end++;
+
+				if (end - word > DICT_SEGMENT_MAX)
 					break;
+
+				if (end - word >= DICT_SEGMENT_MIN && used * 2 < slots) {
+					for (i = dict_hash(word, end - word) & mask; table[i].ds_text; i = (i + 1) & mask) {
+						if (table[i].ds_len == end - word && !memcmp(table[i].ds_text, word, end - word))
+							break;
+					}
+
+					if (!table[i].ds_text) {
+						table[i].ds_text = word;
+						table[i].ds_len = end - word;
+						table[i].ds_last = -1;
+						used++;
+					}
+
+					/* Liczymy próbki, w których ciąg występuje, nie wystąpienia. */
+					if (table[i].ds_last != s) {
+						table[i].ds_last = s;
+						table[i].ds_count++;
+					}
 				}
+
+				while (*end && isspace((unsigned char)*end))
+					end++;
 			}
-			
-			if (entity)
-				continue;
+
+			while (*text && !isspace((unsigned char)*text))
+				text++;
 		}
-		
-		if (!in_tag) {
-			ret[done++] = *text; 
+	}
+
+	chosen = xmalloc(used * sizeof(struct dict_segment *));
+
+	for (i = 0; i < slots; i++) {
+		if (table[i].ds_text && table[i].ds_count > 1) {
+			table[i].ds_score = (uint64_t)(table[i].ds_count - 1) * table[i].ds_len;
+			chosen[nchosen++] = &table[i];
 		}
-	} while (*text++);
-	
-	free(orig);
+	}
+
+	qsort(chosen, nchosen, sizeof(struct dict_segment *), dict_segment_compare);
+	ret = xmalloc(max_size);
+
+	/* Słownik budujemy od końca: najcenniejsze ciągi na końcu. */
+	for (i = 0; i < nchosen && total < max_size; i++) {
+		size_t len = chosen[i]->ds_len + 1;
+
+		if (total + len > max_size)
+			continue;
+
+		if (memmem(ret + max_size - total, total, chosen[i]->ds_text, chosen[i]->ds_len))
+			continue;
+
+		total += len;
+		memcpy(ret + max_size - total, chosen[i]->ds_text, len - 1);
+		ret[max_size - total + len - 1] = ' ';
+	}
+
+	memmove(ret, ret + max_size - total, total);
+	free(chosen);
+	free(table);
+	*size = total;
 	return ret;
 }
 
+/*
+ * Liczba dni od 1970-01-01 do podanej daty kalendarza gregoriańskiego
+ * (algorytm "days from civil" H. Hinnanta), bez udziału mktime() i stref.
+ */
+long days_from_civil(int y, int m, int d)
+{
+	long era, yoe, doy;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+#define	DATE_IS_DIGIT(c)	((c) >= '0' && (c) <= '9')
+
+static int date_digits(const char **str, int min, int max)
+{
+	int n = 0, ret = 0;
+
+	while (n < max && DATE_IS_DIGIT(**str)) {
+		ret = ret * 10 + (*(*str)++ - '0');
+		n++;
+	}
+
+	return n < min ? -1 : ret;
+}
+
+/*
+ * Przesunięcie strefy czasowej w sekundach: "+0100", "-05:00", "Z" oraz
+ * nazwy z RFC 822 i kilka popularnych w polskich kanałach (CET, CEST).
+ * Nieznane nazwy traktujemy, zgodnie z RFC 2822, jak UTC.
+ */
+static int date_zone(const char *str, long *offset)
+{
+	int hours, minutes = 0, sign;
+	static const struct { const char *name; int hours; } zones[] = {
+		{ "UT", 0 }, { "UTC", 0 }, { "GMT", 0 }, { "Z", 0 },
+		{ "EST", -5 }, { "EDT", -4 }, { "CST", -6 }, { "CDT", -5 },
+		{ "MST", -7 }, { "MDT", -6 }, { "PST", -8 }, { "PDT", -7 },
+		{ "CET", 1 }, { "CEST", 2 }, { "EET", 2 }, { "EEST", 3 },
+		{ "BST", 1 }, { "WET", 0 }, { "WEST", 1 }
+	};
+
+	while (*str == ' ')
+		str++;
+
+	*offset = 0;
+
+	if (*str == '+' || *str == '-') {
+		sign = (*str++ == '-') ? -1 : 1;
+		if ((hours = date_digits(&str, 2, 2)) < 0)
+			return FALSE;
+
+		if (*str == ':')
+			str++;
+
+		if (*str >= '0' && *str <= '9' && (minutes = date_digits(&str, 2, 2)) < 0)
+			return FALSE;
+
+		*offset = sign * (hours * 3600 + minutes * 60);
+		return TRUE;
+	}
+
+	if (*str >= 'A' && *str <= 'Z') {
+		int i, len = 0;
+
+		while (str[len] >= 'A' && str[len] <= 'Z')
+			len++;
+
+		for (i = 0; i < N(zones); i++) {
+			if (strlen(zones[i].name) == len && !strncmp(zones[i].name, str, len)) {
+				*offset = zones[i].hours * 3600;
+				break;
+			}
+		}
+
+		return TRUE;
+	}
+
+	/* Brak strefy - przyjmujemy UTC. */
+	return TRUE;
+}
+
+/*
+ * Numer miesiąca (1-12) z trzyliterowego skrótu angielskiej nazwy, bez
+ * względu na wielkość liter; 0 jeśli nierozpoznany.
+ */
+static int date_month(const char *str)
+{
+	int i;
+	uint32_t key = (uint32_t)(str[0] | 0x20) << 16 | (uint32_t)(str[1] | 0x20) << 8 | (str[2] | 0x20);
+	static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+
+	for (i = 0; i < 12; i++) {
+		if (key == ((uint32_t)months[i * 3] << 16 | (uint32_t)months[i * 3 + 1] << 8 | months[i * 3 + 2]))
+			return i + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Odczytuje datę w formacie RFC 822/1123 ("Mon, 17 Nov 2008 19:10:00 +0100",
+ * używany w RSS) lub RFC 3339/ISO 8601 ("2008-11-17T19:10:00+01:00", Atom)
+ * i zwraca czas uniksowy w *ret. Nie zależy od locale ani od strefy
+ * czasowej systemu. Zwraca FALSE, jeśli napisu nie udało się rozpoznać.
+ */
+int parse_date(const char *str, time_t *ret)
+{
+	int year, month, day, hour = 0, minute = 0, second = 0;
+	long offset = 0;
+
+	while (*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r')
+		str++;
+
+	if (DATE_IS_DIGIT(str[0]) && DATE_IS_DIGIT(str[1]) && DATE_IS_DIGIT(str[2]) && DATE_IS_DIGIT(str[3])
+	    && str[4] == '-') {
+		/* RFC 3339 / ISO 8601 */
+		if ((year = date_digits(&str, 4, 4)) < 0)
+			return FALSE;
+
+		str++;
+		if ((month = date_digits(&str, 2, 2)) < 0 || *str++ != '-')
+			return FALSE;
+
+		if ((day = date_digits(&str, 2, 2)) < 0)
+			return FALSE;
+
+		if (*str == 'T' || *str == 't' || *str == ' ') {
+			str++;
+			if ((hour = date_digits(&str, 2, 2)) < 0 || *str++ != ':')
+				return FALSE;
+
+			if ((minute = date_digits(&str, 2, 2)) < 0)
+				return FALSE;
+
+			if (*str == ':' && (str++, (second = date_digits(&str, 2, 2)) < 0))
+				return FALSE;
+
+			if (*str == '.' || *str == ',') {
+				str++;
+				while (*str >= '0' && *str <= '9')
+					str++;
+			}
+
+			if (!date_zone(str, &offset))
+				return FALSE;
+		}
+	} else {
+		/* RFC 822 / RFC 1123: opcjonalna nazwa dnia tygodnia */
+		while ((*str >= 'A' && *str <= 'Z') || (*str >= 'a' && *str <= 'z'))
+			str++;
+
+		while (*str == ',' || *str == ' ')
+			str++;
+
+		if ((day = date_digits(&str, 1, 2)) < 0)
+			return FALSE;
+
+		while (*str == ' ' || *str == '-')
+			str++;
+
+		if (!str[0] || !str[1] || !str[2] || !(month = date_month(str)))
+			return FALSE;
+
+		while (*str && *str != ' ' && *str != '-')
+			str++;
+
+		while (*str == ' ' || *str == '-')
+			str++;
+
+		if ((year = date_digits(&str, 2, 4)) < 0)
+			return FALSE;
+
+		if (year < 100)
+			year += (year < 50) ? 2000 : 1900;
+
+		while (*str == ' ')
+			str++;
+
+		if (*str >= '0' && *str <= '9') {
+			if ((hour = date_digits(&str, 1, 2)) < 0 || *str++ != ':')
+				return FALSE;
+
+			if ((minute = date_digits(&str, 2, 2)) < 0)
+				return FALSE;
+
+			if (*str == ':' && (str++, (second = date_digits(&str, 2, 2)) < 0))
+				return FALSE;
+
+			if (!date_zone(str, &offset))
+				return FALSE;
+		}
+	}
+
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 24 || minute > 59 || second > 60)
+		return FALSE;
+
+	*ret = (time_t)(days_from_civil(year, month, day) * 86400L
+	    + hour * 3600 + minute * 60 + second - offset);
+	return TRUE;
+}
+
 void FAIL(const char *fmt, ...)
 {
 	va_list args;
@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <time.h>
 
 #define TRUE		1
 #define FALSE		0
@@ -21,6 +23,35 @@
 			printf("assertion failed on %s:%d", __FILE__, __LINE__); \
 	} while (0)
 
+#define	ARENA_DEFAULT_SIZE	(64 * 1024)
+#define	ARENA_RETAIN_BLOCKS	16
+
+struct arena_block
+{
+	struct arena_block	*ab_next;
+	size_t			ab_size;
+	size_t			ab_used;
+	char			ab_data[] __attribute__((aligned(16)));
+};
+
+typedef struct arena_block arena_block_t;
+
+struct arena
+{
+	arena_block_t	*ar_head;
+	size_t		ar_block_size;
+	size_t		ar_allocated;
+};
+
+typedef struct arena arena_t;
+
+arena_t	*arena_init(size_t);
+void	*arena_alloc(arena_t *, size_t);
+void	*arena_calloc(arena_t *, size_t);
+char	*arena_strdup(arena_t *, const char *);
+void	arena_reset(arena_t *);
+void	arena_free(arena_t *);
+
 #define FOREACH_ARRAY(array, i, data) \
     for (i = 0, data = array_count(array) ? array_get(array, 0) : NULL; i < array_count(array); i++, data = array_get(array, i))
 
@@ -28,13 +59,16 @@ struct array
 {
 	void		**a_data;
 	int		a_count;
+	int		a_size;
+	arena_t		*a_arena;
 };
 
 typedef struct array array_t;
 
 array_t	*array_init(int);
+array_t	*array_init_arena(arena_t *, int);
 array_t	*array_init_with(const void *[], size_t);
-array_t	*array_init_split_string(char *, const char *);
+array_t	*array_init_split_string(arena_t *, char *, const char *);
 void	array_free(array_t *, int, int);
 void	array_append(array_t *, void *);
 void	array_prepend(array_t *, void *);
@@ -64,20 +98,50 @@ struct hash
 {
 	hash_kv_t	*h_data;
 	int		h_count;
+	int		h_size;
+	arena_t		*h_arena;
 };
 
 typedef struct hash hash_t;
 
 hash_t	*hash_init();
+hash_t	*hash_init_arena(arena_t *);
 void	hash_free(hash_t *, int, int);
 void	*hash_get(hash_t *, const char *);
 char	*hash_get_string(hash_t *, const char *);
 int	hash_get_int(hash_t *, const char *);
+int64_t	hash_get_int64(hash_t *, const char *);
 void	hash_set(hash_t *, const char *, void *, int);
 int	hash_unset(hash_t *, const char *, int);
 int	hash_key_exists(hash_t *, const char *);
 int	hash_count(hash_t *);
 
+/*
+ * Filtr Blooma nad kluczami tekstowymi. Postać szeregowa (do zapisu
+ * w bazie) to nagłówek BLOOM_HEADER_SIZE bajtów i tablica bitów.
+ */
+#define	BLOOM_MAGIC		0x424c4f31	/* "BLO1" */
+#define	BLOOM_HEADER_SIZE	16
+
+struct bloom
+{
+	uint32_t	b_bits;
+	uint32_t	b_hashes;
+	uint32_t	b_count;
+	uint8_t		*b_data;
+};
+
+typedef struct bloom bloom_t;
+
+bloom_t	*bloom_init(uint32_t, double);
+bloom_t	*bloom_load(const void *, int);
+void	*bloom_save(bloom_t *, int *);
+void	bloom_free(bloom_t *);
+void	bloom_add(bloom_t *, const char *);
+int	bloom_check(bloom_t *, const char *);
+double	bloom_fp_rate(bloom_t *);
+uint32_t bloom_capacity(bloom_t *, double);
+
 #define	NEW(type, destructor)			(type *)managed_new(sizeof(type), (void (*)(void*))destructor)
 #define	DELETE(data) 				managed_delete(data)
 #define	MANAGED 				void (*m_destructor)(void *)
@@ -91,18 +155,51 @@ void	*xrealloc(void *, size_t);
 char	*xstrdup(const char *);
 char	*xsubstrdup(const char *, int, int);
 int	*xintdup(int);
+int64_t	*xint64dup(int64_t);
 char	*xstrcat(char *, const char *);
 char	*xfgetln(FILE *);
 int	xprintf(const char *, ...);
-int	xread(FILE *, char **, int, void (*)(int, int));
-int	xread_chunked(FILE *, char **, void (*)(int, int));
+int	xread(FILE *, char **, int, void (*)(void *, int, int), void *);
+int	xread_chunked(FILE *, char **, void (*)(void *, int, int), void *);
 array_t *regexp_match(const char *, const char *, int);
 char	*strip_html(char *);
+int	utf8_encode(uint32_t, char *);
+const char *utf8_validate(const char *, const char *);
+char	*utf8_repair(arena_t *, char *);
+char	*charset_to_utf8(const char *, const char *, size_t);
+char	*charset_from_content_type(const char *);
+char	*charset_from_xml(const char *);
+void	*zlib_compress(const char *, size_t, const void *, size_t, size_t *);
+int	zlib_decompress(const void *, size_t, const void *, size_t, char *, size_t);
+void	*dict_train(const char **, int, size_t, size_t *);
+long	days_from_civil(int, int, int);
+int	parse_date(const char *, time_t *);
 
 /*
  * ISO C90 aka ANSI C nie lubi makr z varargsami...
  */
 void	FAIL(const char *, ...);
 
+/*
+ * Rozliczanie pamięci (mem.c). W budowie z -DMEM_ACCOUNTING wywołania
+ * xmalloc() i pokrewnych zapamiętują miejsce przydziału, a free() zdejmuje
+ * blok z rozliczenia.
+ */
+void	mem_report(FILE *, int);
+
+#ifdef MEM_ACCOUNTING
+void	*mem_malloc(size_t, const char *, int);
+void	*mem_calloc(size_t, const char *, int);
+void	*mem_realloc(void *, size_t, const char *, int);
+char	*mem_strdup(const char *, const char *, int);
+void	mem_free(void *);
+
+#define	xmalloc(n)		mem_malloc((n), __FILE__, __LINE__)
+#define	xcmalloc(n)		mem_calloc((n), __FILE__, __LINE__)
+#define	xrealloc(ptr, n)	mem_realloc((ptr), (n), __FILE__, __LINE__)
+#define	xstrdup(str)		mem_strdup((str), __FILE__, __LINE__)
+#define	free(ptr)		mem_free(ptr)
+#endif
+
 #endif	/* __UTILS_H */
 